@@ -18,7 +18,8 @@ struct StringArray make_string_array(void)
 bool string_append(struct String *str, char c)
 {
 	if (str->count >= str->size){
-		size_t nsize = str->size + 32;
+		/* Doubling keeps appending a character at a time linear. */
+		size_t nsize = str->size ? str->size * 2 : 32;
 		char *ncstr = realloc(str->cstr, nsize);
 		if (!ncstr)
 			return false;
@@ -51,26 +52,12 @@ struct String string_from_cstring(char *cstr)
 
 int string_compare(struct String s1, struct String s2)
 {
-	if (s1.count == 0 && s2.count == 0)
-		return 0;
-	else if (s1.count == 0)
-		return -1;
-	else if (s2.count == 0)
-		return 1;
-	else {
-		char *cs1 = s1.cstr;
-		char *cs2 = s2.cstr;
-		char *end1 = s1.cstr + s1.count;
-		char *end2 = s2.cstr + s2.count;
-		while (cs1 != end1 && cs2 != end2) {
-			int diff = (int)(*cs1) - (int)(*cs2);
-			if (diff)
-				return diff;
-			++cs1;
-			++cs2;
-		}
-		return s1.count - s2.count;
-	}
+	/* memcmp is vectorized by the C library, unlike a byte loop. */
+	size_t n = s1.count < s2.count ? s1.count : s2.count;
+	int diff = n ? memcmp(s1.cstr, s2.cstr, n) : 0;
+	if (diff)
+		return diff;
+	return s1.count < s2.count ? -1 : s1.count > s2.count;
 }
 
 bool string_array_append(struct StringArray *strs, struct String nstr)
@@ -135,3 +122,67 @@ char *strdup2(char *s1, char *s2)
 	return res;
 }
 
+
+struct StringBuffer *string_buffer_new(size_t size)
+{
+	struct StringBuffer *buffer = malloc(sizeof(*buffer) + size);
+	if (!buffer)
+		return 0;
+	buffer->refs = 1;
+	buffer->used = 0;
+	buffer->size = size;
+	return buffer;
+}
+
+void string_buffer_release(struct StringBuffer *buffer)
+{
+	if (buffer && !--buffer->refs)
+		free(buffer);
+}
+
+bool string_slice_init(struct StringSlice *slice, const char *chars,
+		size_t length)
+{
+	/* A slice over a new buffer holding a copy of chars. */
+	slice->buffer = string_buffer_new(length);
+	if (!slice->buffer)
+		return false;
+	memcpy(slice->buffer->bytes, chars, length);
+	slice->buffer->used = length;
+	slice->offset = 0;
+	slice->length = length;
+	return true;
+}
+
+bool string_slice_extend(struct StringSlice *slice, const char *chars,
+			size_t length)
+{
+	/*
+	 * Appends chars to slice.  When slice ends where its buffer's used
+	 * bytes do and there is room, they go straight in after it.
+	 * Otherwise slice moves to a new buffer twice the size it needs,
+	 * so a string grown by repeated appends is copied O(log n) times.
+	 * chars may lie in slice's own buffer.
+	 */
+	struct StringBuffer *buffer = slice->buffer;
+	if (buffer->used == slice->offset + slice->length
+	    && buffer->size - buffer->used >= length) {
+		memcpy(buffer->bytes + buffer->used, chars, length);
+		buffer->used += length;
+		slice->length += length;
+		return true;
+	}
+	size_t need = slice->length + length;
+	struct StringBuffer *nbuffer = string_buffer_new(need < 32 ? 64
+							: need * 2);
+	if (!nbuffer)
+		return false;
+	memcpy(nbuffer->bytes, buffer->bytes + slice->offset, slice->length);
+	memcpy(nbuffer->bytes + slice->length, chars, length);
+	nbuffer->used = need;
+	string_buffer_release(buffer);
+	slice->buffer = nbuffer;
+	slice->offset = 0;
+	slice->length = need;
+	return true;
+}
@@ -16,6 +16,26 @@ struct StringArray {
 	size_t size;
 };
 
+/*
+ * The bytes behind string values.  Any number of slices may share a
+ * buffer, each holding one of its refs, and it is freed with the last.
+ * Bytes below used are never changed, so slices are immutable, but the
+ * slice that ends exactly at used may grow in place into the bytes
+ * above it; see string_slice_extend().
+ */
+struct StringBuffer {
+	size_t refs;
+	size_t used;
+	size_t size;
+	char bytes[];
+};
+
+struct StringSlice {
+	struct StringBuffer *buffer;
+	size_t offset;
+	size_t length;
+};
+
 struct String make_string(void);
 struct StringArray make_string_array(void);
 bool string_append(struct String *str, char c);
@@ -27,5 +47,16 @@ void free_string_array(struct StringArray *stra);
 ptrdiff_t string_array_search(struct StringArray stra, struct String str);
 void free_string_array_shallow(struct StringArray *stra);
 char *strdup2(char *s1, char *s2);
+struct StringBuffer *string_buffer_new(size_t size);
+void string_buffer_release(struct StringBuffer *buffer);
+bool string_slice_init(struct StringSlice *slice, const char *chars,
+		size_t length);
+bool string_slice_extend(struct StringSlice *slice, const char *chars,
+			size_t length);
+
+static inline const char *string_slice_chars(struct StringSlice slice)
+{
+	return slice.buffer->bytes + slice.offset;
+}
 
 #endif
@@ -0,0 +1,338 @@
+#include "compile.h"
+#include "eval.h"
+#include "gc.h"
+#include "print.h"
+#include "read.h"
+#include "scheme.h"
+#include "vm.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Runs the workloads and prints what each cost as JSON, for comparing
+ * one commit with another.  Each runs in a child process with a fresh
+ * machine, so the peak RSS wait4() reports is that workload's own.
+ * A workload's setup is evaluated once and its op compiled once; the
+ * op is then run once to warm up and again until the time budget is
+ * spent.  The read-print workload has no op: it reads a large
+ * generated source text and prints every expression back to memory.
+ *
+ * Usage: bench [-t milliseconds] [-l label] [workload ...]
+ */
+
+struct Workload {
+	const char *name;
+	const char *setup;
+	const char *op;
+};
+
+static const struct Workload workloads[] = {
+	{"fib",
+	 "(define fib (lambda (n) (if (< n 2) n"
+	 " (+ (fib (- n 1)) (fib (- n 2))))))",
+	 "(fib 20)"},
+	{"tak",
+	 "(define tak (lambda (x y z) (if (< y x)"
+	 " (tak (tak (- x 1) y z) (tak (- y 1) z x) (tak (- z 1) x y))"
+	 " z)))",
+	 "(tak 18 12 6)"},
+	{"ackermann",
+	 "(define ack (lambda (m n) (if (= m 0) (+ n 1)"
+	 " (if (= n 0) (ack (- m 1) 1) (ack (- m 1) (ack m (- n 1)))))))",
+	 "(ack 3 5)"},
+	{"nqueens",
+	 "(define safe? (lambda (row dist placed) (if (null? placed) t"
+	 " (if (= (car placed) row) (quote ())"
+	 " (if (= (car placed) (+ row dist)) (quote ())"
+	 " (if (= (car placed) (- row dist)) (quote ())"
+	 " (safe? row (+ dist 1) (cdr placed))))))))"
+	 "(define place (lambda (n col placed) (if (= col n) 1"
+	 " (try-rows n col placed 0))))"
+	 "(define try-rows (lambda (n col placed row) (if (= row n) 0"
+	 " (+ (if (safe? row 1 placed) (place n (+ col 1) (cons row placed))"
+	 " 0) (try-rows n col placed (+ row 1))))))",
+	 "(place 8 0 (quote ()))"},
+	{"list-reverse",
+	 "(define build (lambda (n acc) (if (= n 0) acc"
+	 " (build (- n 1) (cons n acc)))))",
+	 "(reverse (build 10000 (quote ())))"},
+	{"read-print", 0, 0}
+};
+
+#define WORKLOAD_COUNT (sizeof(workloads) / sizeof(*workloads))
+
+/* Expressions in the text the read-print workload reads. */
+#define READ_PRINT_EXPRS 20000
+
+/* What a child sends back through its pipe. */
+struct Result {
+	bool ok;
+	unsigned long long ops;
+	unsigned long long ns;
+	unsigned long long allocations;
+	unsigned long long bytes;
+};
+
+static long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static bool failed(struct Object *obj)
+{
+	return !obj || obj_type(obj) == TypeError;
+}
+
+static bool eval_source(struct Machine *m, const char *src)
+{
+	struct Reader reader;
+	reader_init_buffer(&reader, src, strlen(src));
+	bool ok = true;
+	while (ok) {
+		struct Object *obj = read_scheme(m, &reader);
+		if (!obj) {
+			if (reader.eof)
+				break;
+			ok = false;
+			break;
+		}
+		ok = !failed(eval(m, obj));
+	}
+	reader_free(&reader);
+	return ok;
+}
+
+static struct Object *compile_source(struct Machine *m, const char *src)
+{
+	struct Reader reader;
+	reader_init_buffer(&reader, src, strlen(src));
+	struct Object *obj = read_scheme(m, &reader);
+	reader_free(&reader);
+	return obj ? compile(m, obj) : 0;
+}
+
+static void run_op(struct Machine *m, const struct Workload *w, long budget,
+		struct Result *r)
+{
+	if (!eval_source(m, w->setup))
+		return;
+	struct Object *code = compile_source(m, w->op);
+	if (!code)
+		return;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &code);
+	r->ok = !failed(vm_run(m, code, m->env));
+	size_t allocations = m->heap.allocations;
+	long start = now_ns();
+	long elapsed = 0;
+	while (r->ok && elapsed < budget) {
+		r->ok = !failed(vm_run(m, code, m->env));
+		++r->ops;
+		elapsed = now_ns() - start;
+	}
+	r->ns = elapsed;
+	r->allocations = m->heap.allocations - allocations;
+	gc_roots_restore(m, roots);
+}
+
+static char *generate_source(size_t *len)
+{
+	/* Every kind of atom the reader knows, in nested lists. */
+	struct Printer p;
+	printer_init(&p, -1);
+	for (int i = 0; i != READ_PRINT_EXPRS; ++i)
+		printer_printf(&p, "(define item-%d (quote (%d -%d.25"
+			" \"item %d\" symbol-%d (nested (list %d (deeper)))"
+			" #(1 2 %d) 123456789012345678901234567890)))\n",
+			i, i, i, i, i, i, i);
+	*len = p.count;
+	char *text = p.buf;
+	p.buf = 0;
+	printer_free(&p);
+	return text;
+}
+
+static void run_read_print(struct Machine *m, long budget, struct Result *r)
+{
+	size_t len;
+	char *text = generate_source(&len);
+	if (!text)
+		return;
+	struct Printer out;
+	printer_init(&out, -1);
+	size_t allocations = 0;
+	long start = 0;
+	long elapsed = 0;
+	r->ok = true;
+	/* The first pass is the warm-up and isn't counted. */
+	for (long pass = 0; r->ok && (!pass || elapsed < budget); ++pass) {
+		if (pass == 1) {
+			allocations = m->heap.allocations;
+			start = now_ns();
+		}
+		struct Reader reader;
+		reader_init_buffer(&reader, text, len);
+		out.count = 0;
+		struct Object *obj;
+		while ((obj = read_scheme(m, &reader))) {
+			print_object(m, &out, obj);
+			printer_puts(&out, "\n");
+		}
+		r->ok = reader.eof;
+		reader_free(&reader);
+		if (pass) {
+			++r->ops;
+			elapsed = now_ns() - start;
+		}
+	}
+	r->ns = elapsed;
+	r->allocations = m->heap.allocations - allocations;
+	r->bytes = len;
+	printer_free(&out);
+	free(text);
+}
+
+static bool run_child(const struct Workload *w, long budget, struct Result *r,
+		long *peakRssKb)
+{
+	/*
+	 * Run w in a child and collect its result.  A crash in the child
+	 * shows up as a short read.
+	 */
+	int fds[2];
+	if (pipe(fds) == -1) {
+		perror("pipe");
+		return false;
+	}
+	pid_t pid = fork();
+	if (pid == -1) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return false;
+	}
+	if (!pid) {
+		close(fds[0]);
+		struct Result res = {0};
+		struct Machine *m = create_machine();
+		if (m && w->op)
+			run_op(m, w, budget, &res);
+		else if (m)
+			run_read_print(m, budget, &res);
+		ssize_t n = write(fds[1], &res, sizeof(res));
+		_exit(n == sizeof(res) ? 0 : 1);
+	}
+	close(fds[1]);
+	size_t got = 0;
+	while (got != sizeof(*r)) {
+		ssize_t n = read(fds[0], (char *)r + got, sizeof(*r) - got);
+		if (n <= 0)
+			break;
+		got += n;
+	}
+	close(fds[0]);
+	int status;
+	struct rusage usage;
+	if (wait4(pid, &status, 0, &usage) == -1) {
+		perror("wait4");
+		return false;
+	}
+	*peakRssKb = usage.ru_maxrss;
+	return got == sizeof(*r) && WIFEXITED(status)
+		&& !WEXITSTATUS(status) && r->ok;
+}
+
+static void print_json_string(const char *s)
+{
+	putchar('"');
+	for (; *s; ++s) {
+		if (*s == '"' || *s == '\\')
+			printf("\\%c", *s);
+		else if ((unsigned char)*s < ' ')
+			printf("\\u%04x", *s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+static bool selected(const char *name, char **names, int count)
+{
+	if (!count)
+		return true;
+	for (int i = 0; i != count; ++i) {
+		if (!strcmp(name, names[i]))
+			return true;
+	}
+	return false;
+}
+
+int main(int argc, char *argv[])
+{
+	long budgetMs = 1000;
+	const char *label = "";
+	int opt;
+	while ((opt = getopt(argc, argv, "t:l:")) != -1) {
+		switch (opt) {
+		case 't':
+			budgetMs = atol(optarg);
+			break;
+		case 'l':
+			label = optarg;
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-t milliseconds] [-l label]"
+				" [workload ...]\n", argv[0]);
+			return 2;
+		}
+	}
+	for (int i = optind; i != argc; ++i) {
+		size_t j = 0;
+		while (j != WORKLOAD_COUNT
+		       && strcmp(workloads[j].name, argv[i]))
+			++j;
+		if (j == WORKLOAD_COUNT) {
+			fprintf(stderr, "No workload called %s.\n", argv[i]);
+			return 2;
+		}
+	}
+
+	bool ok = true;
+	const char *sep = "";
+	printf("{\"label\": ");
+	print_json_string(label);
+	printf(", \"budget_ms\": %ld, \"workloads\": [", budgetMs);
+	for (size_t i = 0; i != WORKLOAD_COUNT; ++i) {
+		const struct Workload *w = &workloads[i];
+		if (!selected(w->name, argv + optind, argc - optind))
+			continue;
+		struct Result r = {0};
+		long peakRssKb = 0;
+		printf("%s\n  {\"name\": \"%s\", ", sep, w->name);
+		sep = ",";
+		if (!run_child(w, budgetMs * 1000000L, &r, &peakRssKb)
+		    || !r.ops) {
+			printf("\"error\": \"failed\"}");
+			ok = false;
+			continue;
+		}
+		printf("\"ops\": %llu, \"ns_per_op\": %.1f, "
+			"\"allocs_per_op\": %.1f, \"peak_rss_kb\": %ld",
+			r.ops, (double)r.ns / r.ops,
+			(double)r.allocations / r.ops, peakRssKb);
+		if (r.bytes)
+			printf(", \"bytes_per_op\": %llu", r.bytes);
+		printf("}");
+		fflush(stdout);
+	}
+	printf("\n]}\n");
+	return ok ? 0 : 1;
+}
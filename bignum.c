@@ -0,0 +1,541 @@
+#include "bignum.h"
+#include "scheme.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * Magnitudes are arrays of 32-bit digits, least significant first, so
+ * that a digit times a digit plus two more fits in 64 bits.  The
+ * functions on them write to caller-provided arrays; only the object
+ * level functions allocate.
+ */
+
+/* Products with at least this many digits on each side use Karatsuba. */
+#define KARATSUBA_THRESHOLD 32
+
+typedef uint32_t digit;
+typedef uint64_t ddigit;
+
+/*
+ * A read-only view of an integer's magnitude.  A TypeInteger's digits
+ * are held in local, so a Mag must not be copied.
+ */
+struct Mag {
+	const digit *d;
+	size_t n;
+	bool neg;
+	digit local[2];
+};
+
+static void mag_of(struct Object *obj, struct Mag *mag)
+{
+	if (obj_type(obj) == TypeBignum) {
+		mag->d = obj->bignum.digits;
+		mag->n = obj->bignum.count;
+		mag->neg = obj->bignum.negative;
+		return;
+	}
+	int64_t v = obj_integer(obj);
+	uint64_t u = v < 0 ? 0 - (uint64_t)v : (uint64_t)v;
+	mag->local[0] = (digit)u;
+	mag->local[1] = (digit)(u >> 32);
+	mag->n = u >> 32 ? 2 : u ? 1 : 0;
+	mag->d = mag->local;
+	mag->neg = v < 0;
+}
+
+static size_t mag_trim(const digit *d, size_t n)
+{
+	while (n && !d[n - 1])
+		--n;
+	return n;
+}
+
+static int mag_cmp(const digit *a, size_t an, const digit *b, size_t bn)
+{
+	if (an != bn)
+		return an < bn ? -1 : 1;
+	while (an--) {
+		if (a[an] != b[an])
+			return a[an] < b[an] ? -1 : 1;
+	}
+	return 0;
+}
+
+static size_t mag_add(const digit *a, size_t an, const digit *b, size_t bn,
+		digit *out)
+{
+	/* out, with room for max(an, bn) + 1 digits, = a + b. */
+	if (an < bn) {
+		const digit *t = a;
+		a = b;
+		b = t;
+		size_t tn = an;
+		an = bn;
+		bn = tn;
+	}
+	ddigit carry = 0;
+	size_t i = 0;
+	for (; i != bn; ++i) {
+		carry += (ddigit)a[i] + b[i];
+		out[i] = (digit)carry;
+		carry >>= 32;
+	}
+	for (; i != an; ++i) {
+		carry += a[i];
+		out[i] = (digit)carry;
+		carry >>= 32;
+	}
+	out[i] = (digit)carry;
+	return an + 1;
+}
+
+static size_t mag_sub(const digit *a, size_t an, const digit *b, size_t bn,
+		digit *out)
+{
+	/* out, with room for an digits, = a - b, where a >= b. */
+	int64_t borrow = 0;
+	size_t i = 0;
+	for (; i != bn; ++i) {
+		int64_t t = (int64_t)a[i] - b[i] - borrow;
+		out[i] = (digit)t;
+		borrow = t < 0;
+	}
+	for (; i != an; ++i) {
+		int64_t t = (int64_t)a[i] - borrow;
+		out[i] = (digit)t;
+		borrow = t < 0;
+	}
+	return an;
+}
+
+static void mag_add_into(digit *dst, size_t dn, const digit *src, size_t sn)
+{
+	/* dst += src, where the sum fits in dn digits. */
+	sn = mag_trim(src, sn);
+	ddigit carry = 0;
+	size_t i = 0;
+	for (; i != sn; ++i) {
+		carry += (ddigit)dst[i] + src[i];
+		dst[i] = (digit)carry;
+		carry >>= 32;
+	}
+	for (; carry && i != dn; ++i) {
+		carry += dst[i];
+		dst[i] = (digit)carry;
+		carry >>= 32;
+	}
+}
+
+static void mag_sub_into(digit *dst, size_t dn, const digit *src, size_t sn)
+{
+	/* dst -= src, where dst >= src. */
+	sn = mag_trim(src, sn);
+	int64_t borrow = 0;
+	size_t i = 0;
+	for (; i != sn; ++i) {
+		int64_t t = (int64_t)dst[i] - src[i] - borrow;
+		dst[i] = (digit)t;
+		borrow = t < 0;
+	}
+	for (; borrow && i != dn; ++i) {
+		int64_t t = (int64_t)dst[i] - borrow;
+		dst[i] = (digit)t;
+		borrow = t < 0;
+	}
+}
+
+static void mag_mul_school(const digit *a, size_t an, const digit *b,
+			size_t bn, digit *out)
+{
+	/* out, an + bn digits, = a * b. */
+	memset(out, 0, (an + bn) * sizeof(*out));
+	for (size_t i = 0; i != an; ++i) {
+		ddigit ai = a[i];
+		ddigit carry = 0;
+		if (!ai)
+			continue;
+		for (size_t j = 0; j != bn; ++j) {
+			carry += ai * b[j] + out[i + j];
+			out[i + j] = (digit)carry;
+			carry >>= 32;
+		}
+		out[i + bn] = (digit)carry;
+	}
+}
+
+static bool mag_mul(const digit *a, size_t an, const digit *b, size_t bn,
+		digit *out)
+{
+	/*
+	 * out, an + bn digits, = a * b.  Karatsuba splits a and b at h
+	 * digits into a1 a0 and b1 b0, and makes do with three products:
+	 * a0 b0, a1 b1 and (a0 + a1)(b0 + b1), from which the middle term
+	 * is the difference.  When b is much shorter than a, it is
+	 * multiplied by a piece at a time instead.  False if memory ran
+	 * out.
+	 */
+	if (an < bn) {
+		const digit *t = a;
+		a = b;
+		b = t;
+		size_t tn = an;
+		an = bn;
+		bn = tn;
+	}
+	if (bn < KARATSUBA_THRESHOLD) {
+		mag_mul_school(a, an, b, bn, out);
+		return true;
+	}
+	if (2 * bn <= an) {
+		digit *t = malloc(2 * bn * sizeof(*t));
+		if (!t)
+			return false;
+		memset(out, 0, (an + bn) * sizeof(*out));
+		for (size_t i = 0; i < an; i += bn) {
+			size_t k = an - i < bn ? an - i : bn;
+			if (!mag_mul(a + i, k, b, bn, t)) {
+				free(t);
+				return false;
+			}
+			mag_add_into(out + i, an + bn - i, t, k + bn);
+		}
+		free(t);
+		return true;
+	}
+
+	/* Here bn > an / 2 >= h, so b1 has at least one digit. */
+	size_t h = an / 2;
+	size_t sa = an - h + 1;
+	size_t sb = (h > bn - h ? h : bn - h) + 1;
+	digit *t = malloc((sa + sb + sa + sb) * sizeof(*t));
+	if (!t)
+		return false;
+	digit *suma = t;
+	digit *sumb = t + sa;
+	digit *mid = t + sa + sb;
+	/* a0 b0 goes in the low 2h digits of out and a1 b1 above it. */
+	if (!mag_mul(a, h, b, h, out)
+	    || !mag_mul(a + h, an - h, b + h, bn - h, out + 2 * h)) {
+		free(t);
+		return false;
+	}
+	mag_add(a, h, a + h, an - h, suma);
+	mag_add(b, h, b + h, bn - h, sumb);
+	if (!mag_mul(suma, sa, sumb, sb, mid)) {
+		free(t);
+		return false;
+	}
+	mag_sub_into(mid, sa + sb, out, 2 * h);
+	mag_sub_into(mid, sa + sb, out + 2 * h, an + bn - 2 * h);
+	mag_add_into(out + h, an + bn - h, mid, sa + sb);
+	free(t);
+	return true;
+}
+
+static digit mag_div_short(const digit *a, size_t an, digit b, digit *q)
+{
+	/* q, an digits, = a / b.  Returns the remainder. */
+	ddigit rem = 0;
+	for (size_t i = an; i--;) {
+		ddigit cur = rem << 32 | a[i];
+		q[i] = (digit)(cur / b);
+		rem = cur % b;
+	}
+	return (digit)rem;
+}
+
+static bool mag_div(const digit *u, size_t un, const digit *v, size_t vn,
+		digit *q)
+{
+	/*
+	 * q, un - vn + 1 digits, = u / v, for un >= vn >= 2.  This is
+	 * Knuth's algorithm D: v is shifted so its top bit is set, which
+	 * makes the estimate of each quotient digit from the top two digits
+	 * at most two too big.  False if memory ran out.
+	 */
+	digit *un_ = malloc((un + 1 + vn) * sizeof(*un_));
+	if (!un_)
+		return false;
+	digit *vn_ = un_ + un + 1;
+	int s = 0;
+	while (!(v[vn - 1] << s & 0x80000000u))
+		++s;
+	for (size_t i = vn - 1; i > 0; --i)
+		vn_[i] = v[i] << s | (digit)((ddigit)v[i - 1] >> (32 - s));
+	vn_[0] = v[0] << s;
+	un_[un] = (digit)((ddigit)u[un - 1] >> (32 - s));
+	for (size_t i = un - 1; i > 0; --i)
+		un_[i] = u[i] << s | (digit)((ddigit)u[i - 1] >> (32 - s));
+	un_[0] = u[0] << s;
+
+	for (size_t j = un - vn + 1; j--;) {
+		ddigit num = (ddigit)un_[j + vn] << 32 | un_[j + vn - 1];
+		ddigit qhat = num / vn_[vn - 1];
+		ddigit rhat = num % vn_[vn - 1];
+		while (qhat >> 32 || qhat * vn_[vn - 2]
+		       > (rhat << 32 | un_[j + vn - 2])) {
+			--qhat;
+			rhat += vn_[vn - 1];
+			if (rhat >> 32)
+				break;
+		}
+		/* Multiply and subtract, then add back if qhat was too big. */
+		int64_t k = 0;
+		int64_t t;
+		for (size_t i = 0; i != vn; ++i) {
+			ddigit p = qhat * vn_[i];
+			t = (int64_t)un_[i + j] - k - (int64_t)(p & 0xffffffffu);
+			un_[i + j] = (digit)t;
+			k = (int64_t)(p >> 32) - (t >> 32);
+		}
+		t = (int64_t)un_[j + vn] - k;
+		un_[j + vn] = (digit)t;
+		q[j] = (digit)qhat;
+		if (t < 0) {
+			--q[j];
+			ddigit c = 0;
+			for (size_t i = 0; i != vn; ++i) {
+				c += (ddigit)un_[i + j] + vn_[i];
+				un_[i + j] = (digit)c;
+				c >>= 32;
+			}
+			un_[j + vn] += (digit)c;
+		}
+	}
+	free(un_);
+	return true;
+}
+
+static struct Object *make_integer(struct Machine *m, digit *d, size_t n,
+				bool neg)
+{
+	/*
+	 * The integer with magnitude d, n digits, and sign neg, as a
+	 * TypeInteger if it fits.  Takes ownership of d.
+	 */
+	n = mag_trim(d, n);
+	if (n <= 2) {
+		uint64_t u = n ? d[0] : 0;
+		if (n == 2)
+			u |= (uint64_t)d[1] << 32;
+		if (u <= (uint64_t)INT64_MAX + neg) {
+			free(d);
+			return create_integer_object(m,
+				neg ? (int64_t)(0 - u) : (int64_t)u);
+		}
+	}
+	struct Object *obj = create_bignum_object(m, d, n, neg);
+	if (!obj)
+		free(d);
+	return obj;
+}
+
+static struct Object *add_signed(struct Machine *m, struct Mag *a,
+				struct Mag *b, bool bneg)
+{
+	/* a + b, taking b's sign to be bneg. */
+	size_t n = (a->n > b->n ? a->n : b->n) + 1;
+	digit *d = malloc(n * sizeof(*d));
+	if (!d)
+		return 0;
+	bool neg;
+	if (a->neg == bneg) {
+		mag_add(a->d, a->n, b->d, b->n, d);
+		neg = bneg;
+	} else if (mag_cmp(a->d, a->n, b->d, b->n) >= 0) {
+		memset(d, 0, n * sizeof(*d));
+		mag_sub(a->d, a->n, b->d, b->n, d);
+		neg = a->neg;
+	} else {
+		memset(d, 0, n * sizeof(*d));
+		mag_sub(b->d, b->n, a->d, a->n, d);
+		neg = bneg;
+	}
+	return make_integer(m, d, n, neg);
+}
+
+struct Object *integer_add(struct Machine *m, struct Object *a,
+			struct Object *b)
+{
+	int64_t r;
+	if (obj_type(a) == TypeInteger && obj_type(b) == TypeInteger
+	    && !int64_add_overflow(obj_integer(a), obj_integer(b), &r))
+		return create_integer_object(m, r);
+	struct Mag x, y;
+	mag_of(a, &x);
+	mag_of(b, &y);
+	return add_signed(m, &x, &y, y.neg);
+}
+
+struct Object *integer_sub(struct Machine *m, struct Object *a,
+			struct Object *b)
+{
+	int64_t r;
+	if (obj_type(a) == TypeInteger && obj_type(b) == TypeInteger
+	    && !int64_sub_overflow(obj_integer(a), obj_integer(b), &r))
+		return create_integer_object(m, r);
+	struct Mag x, y;
+	mag_of(a, &x);
+	mag_of(b, &y);
+	return add_signed(m, &x, &y, !y.neg);
+}
+
+struct Object *integer_mul(struct Machine *m, struct Object *a,
+			struct Object *b)
+{
+	int64_t r;
+	if (obj_type(a) == TypeInteger && obj_type(b) == TypeInteger
+	    && !int64_mul_overflow(obj_integer(a), obj_integer(b), &r))
+		return create_integer_object(m, r);
+	struct Mag x, y;
+	mag_of(a, &x);
+	mag_of(b, &y);
+	if (!x.n || !y.n)
+		return make_fixnum(0);
+	digit *d = malloc((x.n + y.n) * sizeof(*d));
+	if (!d)
+		return 0;
+	if (!mag_mul(x.d, x.n, y.d, y.n, d)) {
+		free(d);
+		return 0;
+	}
+	return make_integer(m, d, x.n + y.n, x.neg != y.neg);
+}
+
+struct Object *integer_quotient(struct Machine *m, struct Object *a,
+				struct Object *b)
+{
+	/* a / b, rounded toward zero as in C.  Dividing by 0 is an error. */
+	if (obj_type(b) == TypeInteger && !obj_integer(b)) {
+		fprintf(stderr, "Division by zero.\n");
+		return create_error_object(m);
+	}
+	if (obj_type(a) == TypeInteger && obj_type(b) == TypeInteger
+	    && !(obj_integer(a) == INT64_MIN && obj_integer(b) == -1))
+		return create_integer_object(m, obj_integer(a) / obj_integer(b));
+	struct Mag x, y;
+	mag_of(a, &x);
+	mag_of(b, &y);
+	if (mag_cmp(x.d, x.n, y.d, y.n) < 0)
+		return make_fixnum(0);
+	size_t n = x.n - y.n + 1;
+	digit *d = malloc(n * sizeof(*d));
+	if (!d)
+		return 0;
+	if (y.n == 1) {
+		mag_div_short(x.d, x.n, y.d[0], d);
+	} else if (!mag_div(x.d, x.n, y.d, y.n, d)) {
+		free(d);
+		return 0;
+	}
+	return make_integer(m, d, n, x.neg != y.neg);
+}
+
+int integer_compare(struct Object *a, struct Object *b)
+{
+	/* Negative, zero or positive as a is less, equal or greater. */
+	if (obj_type(a) == TypeInteger && obj_type(b) == TypeInteger)
+		return (obj_integer(a) > obj_integer(b))
+			- (obj_integer(a) < obj_integer(b));
+	struct Mag x, y;
+	mag_of(a, &x);
+	mag_of(b, &y);
+	if (x.neg != y.neg)
+		return x.neg ? -1 : 1;
+	int c = mag_cmp(x.d, x.n, y.d, y.n);
+	return x.neg ? -c : c;
+}
+
+double integer_to_double(struct Object *obj)
+{
+	/* The top three digits hold more bits than a double keeps. */
+	if (obj_type(obj) == TypeInteger)
+		return obj_integer(obj);
+	const digit *d = obj->bignum.digits;
+	size_t n = obj->bignum.count;
+	size_t low = n > 3 ? n - 3 : 0;
+	double dbl = 0;
+	for (size_t i = n; i-- > low;)
+		dbl = dbl * 4294967296.0 + d[i];
+	dbl = ldexp(dbl, 32 * low);
+	return obj->bignum.negative ? -dbl : dbl;
+}
+
+struct Object *integer_parse(struct Machine *m, const char *s,
+			const char *end)
+{
+	/*
+	 * An integer from its text: an optional sign, then decimal digits
+	 * or 0x and hex digits, already checked by the reader.  Decimal is
+	 * taken nine digits at a time.
+	 */
+	bool neg = false;
+	if (s != end && (*s == '+' || *s == '-'))
+		neg = *s++ == '-';
+	bool hex = end - s > 2 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+	if (hex)
+		s += 2;
+	size_t size = (end - s) / 8 + 2;
+	digit *d = calloc(size, sizeof(*d));
+	if (!d)
+		return 0;
+	size_t n = 0;
+	while (s != end) {
+		digit chunk = 0;
+		digit scale = 1;
+		for (int k = 0; s != end && k != (hex ? 7 : 9); ++k, ++s) {
+			int v = *s <= '9' ? *s - '0' : (*s | 0x20) - 'a' + 10;
+			chunk = chunk * (hex ? 16 : 10) + v;
+			scale *= hex ? 16 : 10;
+		}
+		/* d = d * scale + chunk */
+		ddigit carry = chunk;
+		for (size_t i = 0; i != n; ++i) {
+			carry += (ddigit)d[i] * scale;
+			d[i] = (digit)carry;
+			carry >>= 32;
+		}
+		if (carry)
+			d[n++] = (digit)carry;
+	}
+	return make_integer(m, d, size, neg);
+}
+
+char *bignum_to_decimal(struct Object *obj, size_t *length)
+{
+	/*
+	 * The decimal text of a bignum, malloced, found nine digits at a
+	 * time by dividing a copy by 10^9.
+	 */
+	size_t n = obj->bignum.count;
+	size_t size = n * 10 + 2;
+	digit *q = malloc(n * sizeof(*q));
+	char *buf = malloc(size);
+	if (!q || !buf) {
+		free(q);
+		free(buf);
+		return 0;
+	}
+	memcpy(q, obj->bignum.digits, n * sizeof(*q));
+	char *p = buf + size;
+	while (n) {
+		digit rem = mag_div_short(q, n, 1000000000, q);
+		n = mag_trim(q, n);
+		for (int k = 0; k != 9; ++k) {
+			*--p = '0' + rem % 10;
+			rem /= 10;
+			if (!n && !rem)
+				break;
+		}
+	}
+	if (obj->bignum.negative)
+		*--p = '-';
+	*length = buf + size - p;
+	memmove(buf, p, *length);
+	buf[*length] = '\0';
+	free(q);
+	return buf;
+}
@@ -0,0 +1,71 @@
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+#include "scheme_forward.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Integer arithmetic of any size.  Every integer that fits in an
+ * int64_t is a TypeInteger, fixnum or boxed, and only larger ones are
+ * TypeBignum, so each value has one form.  These functions take and
+ * return either kind.  They read their arguments before allocating
+ * anything, so the arguments need not be rooted.  They return 0 when
+ * memory runs out.
+ */
+
+static inline bool int64_add_overflow(int64_t a, int64_t b, int64_t *res)
+{
+#ifdef __GNUC__
+	return __builtin_add_overflow(a, b, res);
+#else
+	if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b))
+		return true;
+	*res = a + b;
+	return false;
+#endif
+}
+
+static inline bool int64_sub_overflow(int64_t a, int64_t b, int64_t *res)
+{
+#ifdef __GNUC__
+	return __builtin_sub_overflow(a, b, res);
+#else
+	if ((b < 0 && a > INT64_MAX + b) || (b > 0 && a < INT64_MIN + b))
+		return true;
+	*res = a - b;
+	return false;
+#endif
+}
+
+static inline bool int64_mul_overflow(int64_t a, int64_t b, int64_t *res)
+{
+#ifdef __GNUC__
+	return __builtin_mul_overflow(a, b, res);
+#else
+	if (a && b) {
+		if (a > 0 ? (b > 0 ? a > INT64_MAX / b : b < INT64_MIN / a)
+		    : (b > 0 ? a < INT64_MIN / b : a < INT64_MAX / b))
+			return true;
+	}
+	*res = a * b;
+	return false;
+#endif
+}
+
+struct Object *integer_add(struct Machine *m, struct Object *a,
+			struct Object *b);
+struct Object *integer_sub(struct Machine *m, struct Object *a,
+			struct Object *b);
+struct Object *integer_mul(struct Machine *m, struct Object *a,
+			struct Object *b);
+struct Object *integer_quotient(struct Machine *m, struct Object *a,
+				struct Object *b);
+int integer_compare(struct Object *a, struct Object *b);
+double integer_to_double(struct Object *obj);
+struct Object *integer_parse(struct Machine *m, const char *s,
+			const char *end);
+char *bignum_to_decimal(struct Object *obj, size_t *length);
+
+#endif
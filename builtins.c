@@ -1,185 +1,282 @@
 #include "builtins.h"
+#include "bignum.h"
+#include "compile.h"
+#include "env.h"
 #include "eval.h"
+#include "gc.h"
 #include "scheme.h"
+#include "vm.h"
 #include <assert.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+
+static struct Object *pair_arg(struct Object *obj, const char *name)
+{
+	/*
+	 * obj if it is a non-empty pair.  Fixnums live in the pointer word,
+	 * so anything else must be turned away before touching ->pair.
+	 */
+	if (!obj || obj_type(obj) != TypePair || obj_is_nil(obj)) {
+		fprintf(stderr, "%s wants a non-empty list.\n", name);
+		return 0;
+	}
+	return obj;
+}
 
 struct Object *mcar(struct Machine *m, struct Object *args)
 {
-	struct Object *arg0 = car(args);
-	return car(arg0);
+	struct Object *arg0 = pair_arg(obj_is_nil(args) ? 0 : car(args), "car");
+	return arg0 ? car(arg0) : create_error_object(m);
 }
 
 struct Object *mcdr(struct Machine *m, struct Object *args)
 {
-	struct Object *arg0 = car(args);
-	return cdr(arg0);
+	struct Object *arg0 = pair_arg(obj_is_nil(args) ? 0 : car(args), "cdr");
+	return arg0 ? cdr(arg0) : create_error_object(m);
 }
 
 struct Object *mcadr(struct Machine *m, struct Object *args)
 {
-	struct Object *arg0 = car(args);
-	return car(cdr(arg0));
+	struct Object *arg0 = pair_arg(obj_is_nil(args) ? 0 : car(args),
+				"cadr");
+	struct Object *rest = arg0 ? pair_arg(cdr(arg0), "cadr") : 0;
+	return rest ? car(rest) : create_error_object(m);
 }
 
 struct Object *cons(struct Machine *m, struct Object *args)
 {
+	if (form_arity(args) != 2) {
+		fprintf(stderr, "cons wants two arguments.\n");
+		return create_error_object(m);
+	}
 	struct Object *arg0 = car(args);
 	struct Object *arg1 = cadr(args);
 	return create_pair_object(m, arg0, arg1);
 }
 
+struct Object *reverse(struct Machine *m, struct Object *args)
+{
+	/* form_arity() doubles as the test for a proper list. */
+	if (form_arity(args) != 1 || form_arity(car(args)) < 0) {
+		fprintf(stderr, "reverse wants a list.\n");
+		return create_error_object(m);
+	}
+	return reverse_list(m, car(args));
+}
 
 struct Object *meval(struct Machine *m, struct Object *args)
 {
+	if (form_arity(args) != 1) {
+		fprintf(stderr, "eval wants one expression.\n");
+		return create_error_object(m);
+	}
 	struct Object *arg0 = car(args);
 	return eval(m, arg0);
 }
 
 struct Object *quote(struct Machine *machine, struct Object *args)
 {
-	struct Object *arg0 = car(args);
-	return arg0;
+	if (form_arity(args) != 1) {
+		fprintf(stderr, "quote wants one datum.\n");
+		return create_error_object(machine);
+	}
+	return car(args);
 }
 
 struct Object *define(struct Machine *machine, struct Object *args)
 {
-	if (args->type == TypePair) {
+	if (form_arity(args) > 0) {
 		Object *key = car(args);
-		if (key->type != TypeSymbol) {
+		if (!key || obj_type(key) != TypeSymbol) {
 			fprintf(stderr,
 				"The key for a define must be a symbol.\n");
 			return create_error_object(machine);
 		}
-		if (cdr(args)->type != TypePair) {
+		if (form_arity(args) != 2) {
 			fprintf(stderr,
 				"Don't understand second argument for define.\n");
 			return create_error_object(machine);
 		}
 		Object *value = eval(machine, cadr(args));
-		env_update(&machine->rootEnv->env, key->symbol, value);
+		if (!global_define(machine, key->symbol, value))
+			return create_error_object(machine);
 		return create_pair_object(machine, 0, 0);
 	}
 	fprintf(stderr, "Don't know how to define what you asked for\n");
 	return create_error_object(machine);
 }
 
+static bool numbers_arg(struct Object *args, const char *name)
+{
+	/* True if every one of args is a number. */
+	for (; !obj_is_nil(args); args = cdr(args)) {
+		enum Type type = obj_type(car(args));
+		if (type != TypeInteger && type != TypeBignum
+		    && type != TypeDouble) {
+			fprintf(stderr, "%s wants numbers.\n", name);
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * The arithmetic builtins accumulate into C locals and only make an
+ * object for the result, which for an integer is a fixnum and so
+ * allocates nothing.  An integer result that overflows 64 bits moves
+ * to big, and from then on the bignum functions carry on.  Mixing in a
+ * double switches to double.  Arguments are checked to be numbers
+ * before any of that starts.
+ */
+
 struct Object *sum(struct Machine *machine, struct Object *args)
 {
-	struct Object *r = 0;
-	int integer;
-	double dbl;
+	int64_t integer = 0;
+	int64_t next;
+	struct Object *big = 0;
+	double dbl = 0;
+	bool isDouble = false;
+	if (!numbers_arg(args, "+"))
+		return create_error_object(machine);
 	while (!obj_is_nil(args)) {
 		struct Object *earg = car(args);
-		switch (earg->type) {
+		switch (obj_type(earg)) {
 		case TypeInteger:
-			integer = earg->integer;
-			if (!r) {
-				r = create_integer_object(machine, integer);
-			} else if (r->type == TypeInteger) {
-				r->integer += integer;
-			} else if (r->type == TypeDouble) {
-				r->dbl += integer;
-			} else {
-				assert(0);
+			if (!isDouble && !big && !int64_add_overflow(integer,
+						obj_integer(earg), &next)) {
+				integer = next;
+				break;
+			}
+			/* Fall through. */
+		case TypeBignum:
+			if (isDouble) {
+				dbl += integer_to_double(earg);
+				break;
 			}
+			if (!big)
+				big = create_integer_object(machine, integer);
+			big = integer_add(machine, big, earg);
+			if (!big)
+				return create_error_object(machine);
 			break;
 		case TypeDouble:
-			dbl = earg->dbl;
-			if (!r) {
-				r = create_double_object(machine, dbl);
-			} else if (r->type == TypeInteger) {
-				r->dbl = r->integer + dbl;
-				r->type = TypeDouble;
-			} else if (r->type == TypeDouble) {
-				r->dbl += dbl;
-			} else {
-				assert(0);
+			if (!isDouble) {
+				dbl = big ? integer_to_double(big) : integer;
+				isDouble = true;
 			}
+			dbl += earg->dbl;
 			break;
 		default:
 			assert(0);
 		}
 		args = cdr(args);
 	}
-	return r;
+	if (isDouble)
+		return create_double_object(machine, dbl);
+	if (big)
+		return big;
+	return create_integer_object(machine, integer);
 }
 
 struct Object *prod(struct Machine *machine, struct Object *args)
 {
-	struct Object *r = 0;
-	int integer;
-	double dbl;
+	int64_t integer = 1;
+	int64_t next;
+	struct Object *big = 0;
+	double dbl = 1;
+	bool isDouble = false;
+	if (!numbers_arg(args, "*"))
+		return create_error_object(machine);
 	while (!obj_is_nil(args)) {
 		struct Object *earg = car(args);
-		switch (earg->type) {
+		switch (obj_type(earg)) {
 		case TypeInteger:
-			integer = earg->integer;
-			if (!r) {
-				r = create_integer_object(machine, integer);
-			} else if (r->type == TypeInteger) {
-				r->integer *= integer;
-			} else if (r->type == TypeDouble) {
-				r->dbl *= integer;
-			} else {
-				assert(0);
+			if (!isDouble && !big && !int64_mul_overflow(integer,
+						obj_integer(earg), &next)) {
+				integer = next;
+				break;
 			}
+			/* Fall through. */
+		case TypeBignum:
+			if (isDouble) {
+				dbl *= integer_to_double(earg);
+				break;
+			}
+			if (!big)
+				big = create_integer_object(machine, integer);
+			big = integer_mul(machine, big, earg);
+			if (!big)
+				return create_error_object(machine);
 			break;
 		case TypeDouble:
-			dbl = earg->dbl;
-			if (!r) {
-				r = create_double_object(machine, dbl);
-			} else if (r->type == TypeInteger) {
-				r->dbl = r->integer * dbl ;
-				r->type = TypeDouble;
-			} else if (r->type == TypeDouble) {
-				r->dbl *= dbl;
-			} else {
-				assert(0);
+			if (!isDouble) {
+				dbl = big ? integer_to_double(big) : integer;
+				isDouble = true;
 			}
+			dbl *= earg->dbl;
 			break;
 		default:
 			assert(0);
 		}
 		args = cdr(args);
 	}
-	return r;
+	if (isDouble)
+		return create_double_object(machine, dbl);
+	if (big)
+		return big;
+	return create_integer_object(machine, integer);
 }
 
 struct Object *subtract(struct Machine *machine, struct Object *args)
 {
-	struct Object *r = 0;
-	int integer;
-	double dbl;
+	int64_t integer = 0;
+	int64_t next;
+	struct Object *big = 0;
+	double dbl = 0;
+	bool isDouble = false;
 	int count = 0;
+	if (!numbers_arg(args, "-"))
+		return create_error_object(machine);
 	while (!obj_is_nil(args)) {
 		struct Object *earg = car(args);
 		++count;
-		switch (earg->type) {
+		switch (obj_type(earg)) {
 		case TypeInteger:
-			integer = earg->integer;
-			if (!r) {
-				r = create_integer_object(machine, integer);
-			} else if (r->type == TypeInteger) {
-				r->integer -= integer;
-			} else if (r->type == TypeDouble) {
-				r->dbl -= integer;
-			} else {
-				assert(0);
+			if (count == 1) {
+				integer = obj_integer(earg);
+				break;
+			}
+			if (!isDouble && !big && !int64_sub_overflow(integer,
+						obj_integer(earg), &next)) {
+				integer = next;
+				break;
+			}
+			/* Fall through. */
+		case TypeBignum:
+			if (count == 1) {
+				big = earg;
+				break;
 			}
+			if (isDouble) {
+				dbl -= integer_to_double(earg);
+				break;
+			}
+			if (!big)
+				big = create_integer_object(machine, integer);
+			big = integer_sub(machine, big, earg);
+			if (!big)
+				return create_error_object(machine);
 			break;
 		case TypeDouble:
-			dbl = earg->dbl;
-			if (!r) {
-				r = create_double_object(machine, dbl);
-			} else if (r->type == TypeInteger) {
-				r->dbl = r->integer - dbl ;
-				r->type = TypeDouble;
-			} else if (r->type == TypeDouble) {
-				r->dbl -= dbl;
-			} else {
-				assert(0);
+			if (!isDouble) {
+				dbl = big ? integer_to_double(big) : integer;
+				isDouble = true;
 			}
+			if (count == 1)
+				dbl = earg->dbl;
+			else
+				dbl -= earg->dbl;
 			break;
 		default:
 			assert(0);
@@ -187,54 +284,75 @@ struct Object *subtract(struct Machine *machine, struct Object *args)
 		args = cdr(args);
 	}
 	if (count == 1) {
-		switch (r->type) {
-		case TypeInteger:
-			r->integer = -r->integer;
-			break;
-		case TypeDouble:
-			r->dbl = -r->dbl;
-			break;
-		default:
-			assert(0);
-		}
+		if (isDouble)
+			dbl = -dbl;
+		else if (big || integer == INT64_MIN)
+			big = integer_sub(machine, make_fixnum(0), big ? big
+					: create_integer_object(machine, integer));
+		else
+			integer = -integer;
 	}
-	return r;
+	if (isDouble)
+		return create_double_object(machine, dbl);
+	if (big)
+		return big;
+	return create_integer_object(machine, integer);
 }
 
 struct Object *divide(struct Machine *machine, struct Object *args)
 {
-	struct Object *r = 0;
-	int integer;
-	double dbl;
+	int64_t integer = 0;
+	struct Object *big = 0;
+	double dbl = 0;
+	bool isDouble = false;
 	int count = 0;
+	if (!numbers_arg(args, "/"))
+		return create_error_object(machine);
 	while (!obj_is_nil(args)) {
 		struct Object *earg = car(args);
 		++count;
-		switch (earg->type) {
+		switch (obj_type(earg)) {
 		case TypeInteger:
-			integer = earg->integer;
-			if (!r) {
-				r = create_integer_object(machine, integer);
-			} else if (r->type == TypeInteger) {
-				r->integer /= integer;
-			} else if (r->type == TypeDouble) {
-				r->dbl /= integer;
-			} else {
-				assert(0);
+			if (count == 1) {
+				integer = obj_integer(earg);
+				break;
+			}
+			if (isDouble) {
+				dbl /= obj_integer(earg);
+				break;
 			}
+			if (!big && obj_integer(earg)
+			    && !(integer == INT64_MIN && obj_integer(earg) == -1)) {
+				integer /= obj_integer(earg);
+				break;
+			}
+			/* Fall through. */
+		case TypeBignum:
+			if (count == 1) {
+				big = earg;
+				break;
+			}
+			if (isDouble) {
+				dbl /= integer_to_double(earg);
+				break;
+			}
+			if (!big)
+				big = create_integer_object(machine, integer);
+			big = integer_quotient(machine, big, earg);
+			if (!big)
+				return create_error_object(machine);
+			if (obj_type(big) == TypeError)
+				return big;
 			break;
 		case TypeDouble:
-			dbl = earg->dbl;
-			if (!r) {
-				r = create_double_object(machine, dbl);
-			} else if (r->type == TypeInteger) {
-				r->dbl = r->integer / dbl ;
-				r->type = TypeDouble;
-			} else if (r->type == TypeDouble) {
-				r->dbl /= dbl;
-			} else {
-				assert(0);
+			if (!isDouble) {
+				dbl = big ? integer_to_double(big) : integer;
+				isDouble = true;
 			}
+			if (count == 1)
+				dbl = earg->dbl;
+			else
+				dbl /= earg->dbl;
 			break;
 		default:
 			assert(0);
@@ -242,24 +360,490 @@ struct Object *divide(struct Machine *machine, struct Object *args)
 		args = cdr(args);
 	}
 	if (count == 1) {
-		switch (r->type) {
-		case TypeInteger:
-			r->dbl = 1.0 / r->integer;
-			r->type = TypeDouble;
-			break;
-		case TypeDouble:
-			r->dbl = 1.0 / r->dbl;
-			break;
-		default:
-			assert(0);
-		}
+		if (!isDouble)
+			dbl = big ? integer_to_double(big) : integer;
+		dbl = 1.0 / dbl;
+		isDouble = true;
+	}
+	if (isDouble)
+		return create_double_object(machine, dbl);
+	if (big)
+		return big;
+	return create_integer_object(machine, integer);
+}
+
+struct Object *truth(struct Machine *m, bool b)
+{
+	/* There are no booleans: false is (), and true is t. */
+	return b ? m->trueObj : create_pair_object(m, 0, 0);
+}
+
+static int num_compare(struct Object *a, struct Object *b)
+{
+	/* Negative, zero or positive as a is less, equal or greater. */
+	if (obj_type(a) != TypeDouble && obj_type(b) != TypeDouble)
+		return integer_compare(a, b);
+	double x = obj_type(a) == TypeDouble ? a->dbl : integer_to_double(a);
+	double y = obj_type(b) == TypeDouble ? b->dbl : integer_to_double(b);
+	return (x > y) - (x < y);
+}
+
+static struct Object *num_chain(struct Machine *m, struct Object *args,
+				int want, const char *name)
+{
+	/* True if each neighbouring pair of args compares as want. */
+	if (!numbers_arg(args, name))
+		return create_error_object(m);
+	while (!obj_is_nil(args) && !obj_is_nil(cdr(args))) {
+		struct Object *a = car(args);
+		struct Object *b = cadr(args);
+		int c = num_compare(a, b);
+		if ((c > 0) - (c < 0) != want)
+			return truth(m, false);
+		args = cdr(args);
+	}
+	return truth(m, true);
+}
+
+struct Object *num_eq(struct Machine *m, struct Object *args)
+{
+	return num_chain(m, args, 0, "=");
+}
+
+struct Object *num_lt(struct Machine *m, struct Object *args)
+{
+	return num_chain(m, args, -1, "<");
+}
+
+struct Object *num_gt(struct Machine *m, struct Object *args)
+{
+	return num_chain(m, args, 1, ">");
+}
+
+struct Object *null_p(struct Machine *m, struct Object *args)
+{
+	return truth(m, obj_is_nil(car(args)));
+}
+
+struct Object *mif(struct Machine *machine, struct Object *args)
+{
+	/*
+	 * (if test then [else]).  The compiler handles well-formed ifs
+	 * itself, so this only runs for ones it could not compile.
+	 */
+	ptrdiff_t n = form_arity(args);
+	if (n != 2 && n != 3) {
+		fprintf(stderr, "if wants a test, a consequent and "
+			"an optional alternative.\n");
+		return create_error_object(machine);
 	}
-	return r;
+	if (!obj_is_nil(eval(machine, car(args))))
+		return eval(machine, cadr(args));
+	if (n == 3)
+		return eval(machine, car(cdr(cdr(args))));
+	return create_pair_object(machine, 0, 0);
 }
 
 struct Object *lambda(struct Machine *machine, struct Object *args)
 {
+	if (form_arity(args) != 2) {
+		fprintf(stderr, "lambda wants parameters and a body.\n");
+		return create_error_object(machine);
+	}
 	struct Object *largs = car(args);
-	struct Object *lbody = cadr(args);
-	return create_closure_object(machine, largs, lbody, machine->env);
+	if (!params_valid(largs)) {
+		fprintf(stderr,
+			"The parameters of a lambda must be a list of symbols.\n");
+		return create_error_object(machine);
+	}
+	struct Object *code = compile_lambda(machine, largs, cadr(args));
+	if (!code)
+		return create_error_object(machine);
+	size_t roots = gc_roots_save(machine);
+	gc_push_root(machine, &code);
+	struct Object *closure = create_closure_object(machine, largs, code,
+						machine->env);
+	gc_roots_restore(machine, roots);
+	return closure;
+}
+
+struct Object *mgc(struct Machine *m, struct Object *args)
+{
+	gc_collect(m);
+	return create_pair_object(m, 0, 0);
+}
+
+struct Object *mgc_pause_target(struct Machine *m, struct Object *args)
+{
+	/* (gc-pause-target usec) sets the target; with no argument it reads it. */
+	if (!obj_is_nil(args)) {
+		struct Object *arg0 = car(args);
+		if (obj_type(arg0) != TypeInteger || obj_integer(arg0) <= 0) {
+			fprintf(stderr,
+				"gc-pause-target wants a positive integer.\n");
+			return create_error_object(m);
+		}
+		gc_set_pause_target(m, obj_integer(arg0));
+	}
+	return create_integer_object(m, m->heap.pauseTargetNs / 1000);
+}
+
+struct Object *slab_stats(struct Machine *m, struct Object *args)
+{
+	/*
+	 * One entry per type:
+	 * (type bytes-per-object pages-in-use live-objects)
+	 */
+	struct Object *res = create_pair_object(m, 0, 0);
+	struct Object *row = 0;
+	struct Object *item = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &res);
+	gc_push_root(m, &row);
+	gc_push_root(m, &item);
+	for (size_t i = m->slabs.count; i; --i) {
+		struct SlabClass *c = &m->slabs.classes[i - 1];
+		size_t fields[] = {c->objectSize, c->count, c->live};
+		row = create_pair_object(m, 0, 0);
+		for (size_t j = 3; j; --j) {
+			item = create_integer_object(m, fields[j - 1]);
+			row = create_pair_object(m, item, row);
+		}
+		const char *name = type_name(slab_class_type(i - 1));
+		item = create_symbol_object(m,
+					string_from_cstring((char *)name));
+		row = create_pair_object(m, item, row);
+		res = create_pair_object(m, row, res);
+	}
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *mdisassemble(struct Machine *m, struct Object *args)
+{
+	/* (disassemble f) prints the bytecode of the closure f. */
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeClosure) {
+		fprintf(stderr, "disassemble wants a closure.\n");
+		return create_error_object(m);
+	}
+	disassemble(m, arg0->closure.code);
+	return create_pair_object(m, 0, 0);
+}
+
+struct Object *max_call_depth(struct Machine *m, struct Object *args)
+{
+	/*
+	 * The deepest nesting of VM activations so far.  Tail calls
+	 * reuse theirs, so a loop written as a tail call leaves this flat.
+	 */
+	return create_integer_object(m, m->maxCallDepth);
+}
+
+struct Object *callcc(struct Machine *m, struct Object *args)
+{
+	/*
+	 * Compiled calls to call/cc are handled by the VM, which owns the
+	 * stack.  This is only reached through apply-like paths from C.
+	 */
+	fprintf(stderr, "call/cc can only be called from compiled code.\n");
+	return create_error_object(m);
+}
+
+static bool vector_index(struct Object *args, const char *name,
+			struct Object **vec, size_t *index)
+{
+	/* The vector and in-range index at the head of args, or false. */
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeVector) {
+		fprintf(stderr, "%s wants a vector.\n", name);
+		return false;
+	}
+	struct Object *arg1 = obj_is_nil(cdr(args)) ? 0 : cadr(args);
+	if (!arg1 || obj_type(arg1) != TypeInteger || obj_integer(arg1) < 0
+	    || (uint64_t)obj_integer(arg1) >= arg0->vector.count) {
+		fprintf(stderr, "%s index out of range.\n", name);
+		return false;
+	}
+	*vec = arg0;
+	*index = obj_integer(arg1);
+	return true;
+}
+
+struct Object *make_vector(struct Machine *m, struct Object *args)
+{
+	/* (make-vector n [fill]); the fill defaults to (). */
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeInteger || obj_integer(arg0) < 0) {
+		fprintf(stderr, "make-vector wants a non-negative integer.\n");
+		return create_error_object(m);
+	}
+	if ((uint64_t)obj_integer(arg0) > SIZE_MAX / sizeof(struct Object *)) {
+		fprintf(stderr, "make-vector: %lld items is too many.\n",
+			(long long)obj_integer(arg0));
+		return create_error_object(m);
+	}
+	struct Object *fill = obj_is_nil(cdr(args)) ? 0 : cadr(args);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &fill);
+	if (!fill)
+		fill = create_pair_object(m, 0, 0);
+	struct Object *vec = fill ? create_vector_object(m,
+						obj_integer(arg0), fill) : 0;
+	gc_roots_restore(m, roots);
+	if (!vec) {
+		fprintf(stderr, "make-vector: out of memory.\n");
+		return create_error_object(m);
+	}
+	return vec;
+}
+
+struct Object *vector_ref(struct Machine *m, struct Object *args)
+{
+	/* Indexing goes straight into the items, with no walk. */
+	struct Object *vec;
+	size_t i;
+	if (!vector_index(args, "vector-ref", &vec, &i))
+		return create_error_object(m);
+	return vec->vector.items[i];
+}
+
+struct Object *vector_set(struct Machine *m, struct Object *args)
+{
+	struct Object *vec;
+	size_t i;
+	if (!vector_index(args, "vector-set!", &vec, &i))
+		return create_error_object(m);
+	if (obj_is_nil(cdr(cdr(args)))) {
+		fprintf(stderr, "vector-set! wants a value.\n");
+		return create_error_object(m);
+	}
+	vec->vector.items[i] = car(cdr(cdr(args)));
+	gc_write_barrier(m, vec);
+	return create_pair_object(m, 0, 0);
+}
+
+struct Object *vector_length(struct Machine *m, struct Object *args)
+{
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeVector) {
+		fprintf(stderr, "vector-length wants a vector.\n");
+		return create_error_object(m);
+	}
+	return create_integer_object(m, arg0->vector.count);
+}
+
+struct Object *vector_fill(struct Machine *m, struct Object *args)
+{
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeVector || obj_is_nil(cdr(args))) {
+		fprintf(stderr, "vector-fill! wants a vector and a value.\n");
+		return create_error_object(m);
+	}
+	struct Object *fill = cadr(args);
+	for (size_t i = 0; i != arg0->vector.count; ++i)
+		arg0->vector.items[i] = fill;
+	gc_write_barrier(m, arg0);
+	return create_pair_object(m, 0, 0);
+}
+
+struct Object *list_to_vector(struct Machine *m, struct Object *args)
+{
+	/* The list must be proper, since its length is taken first. */
+	struct Object *list = obj_is_nil(args) ? 0 : car(args);
+	struct Object *it = list;
+	while (it && obj_type(it) == TypePair && !obj_is_nil(it))
+		it = it->pair.cdr;
+	if (!it || obj_type(it) != TypePair) {
+		fprintf(stderr, "list->vector wants a list.\n");
+		return create_error_object(m);
+	}
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &list);
+	struct Object *vec = create_vector_from_list(m, list);
+	gc_roots_restore(m, roots);
+	if (!vec) {
+		fprintf(stderr, "list->vector: out of memory.\n");
+		return create_error_object(m);
+	}
+	return vec;
+}
+
+struct Object *vector_to_list(struct Machine *m, struct Object *args)
+{
+	struct Object *vec = obj_is_nil(args) ? 0 : car(args);
+	if (!vec || obj_type(vec) != TypeVector) {
+		fprintf(stderr, "vector->list wants a vector.\n");
+		return create_error_object(m);
+	}
+	struct Object *res = create_pair_object(m, 0, 0);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &vec);
+	gc_push_root(m, &res);
+	for (size_t i = vec->vector.count; res && i; --i)
+		res = create_pair_object(m, vec->vector.items[i - 1], res);
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *vector_p(struct Machine *m, struct Object *args)
+{
+	return truth(m, !obj_is_nil(args) && car(args)
+			&& obj_type(car(args)) == TypeVector);
+}
+
+struct Object *msimd_level(struct Machine *m, struct Object *args)
+{
+	/* The kernels in use: scalar, sse2 or avx2; see simd.h. */
+	const char *name = simd_level_name(m->simd);
+	return create_symbol_object_n(m, name, strlen(name));
+}
+
+static struct Object *string_arg(struct Object *args, const char *name)
+{
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeString) {
+		fprintf(stderr, "%s wants a string.\n", name);
+		return 0;
+	}
+	return arg0;
+}
+
+struct Object *string_p(struct Machine *m, struct Object *args)
+{
+	return truth(m, !obj_is_nil(args) && car(args)
+			&& obj_type(car(args)) == TypeString);
+}
+
+struct Object *string_length(struct Machine *m, struct Object *args)
+{
+	struct Object *str = string_arg(args, "string-length");
+	if (!str)
+		return create_error_object(m);
+	return create_integer_object(m, str->string.length);
+}
+
+struct Object *substring(struct Machine *m, struct Object *args)
+{
+	/*
+	 * (substring s start [end]) shares s's bytes rather than copying
+	 * them, so even a small substring keeps all of them alive.
+	 */
+	struct Object *str = string_arg(args, "substring");
+	if (!str)
+		return create_error_object(m);
+	size_t length = str->string.length;
+	int64_t bounds[2] = {0, length};
+	struct Object *rest = cdr(args);
+	for (size_t i = 0; i != 2 && !obj_is_nil(rest); ++i) {
+		struct Object *arg = car(rest);
+		if (!arg || obj_type(arg) != TypeInteger) {
+			fprintf(stderr, "substring wants integer bounds.\n");
+			return create_error_object(m);
+		}
+		bounds[i] = obj_integer(arg);
+		rest = cdr(rest);
+	}
+	if (bounds[0] < 0 || bounds[0] > bounds[1]
+	    || (uint64_t)bounds[1] > length) {
+		fprintf(stderr, "substring bounds out of range.\n");
+		return create_error_object(m);
+	}
+	struct StringSlice slice = str->string;
+	slice.offset += bounds[0];
+	slice.length = bounds[1] - bounds[0];
+	++slice.buffer->refs;
+	return create_string_from_slice(m, TypeString, slice);
+}
+
+static bool slice_append_args(struct StringSlice *slice, struct Object *args,
+			const char *name)
+{
+	for (; !obj_is_nil(args); args = cdr(args)) {
+		struct Object *str = car(args);
+		if (!str || obj_type(str) != TypeString) {
+			fprintf(stderr, "%s wants strings.\n", name);
+			return false;
+		}
+		if (!string_slice_extend(slice, string_slice_chars(str->string),
+					str->string.length))
+			return false;
+	}
+	return true;
+}
+
+struct Object *mstring_append(struct Machine *m, struct Object *args)
+{
+	/*
+	 * The result starts as the first string, so when that one ends
+	 * its buffer the rest are copied in after it and nothing else is.
+	 * A loop that keeps appending to its own result is then linear.
+	 */
+	struct StringSlice slice;
+	if (obj_is_nil(args)) {
+		if (!string_slice_init(&slice, "", 0))
+			return 0;
+		return create_string_from_slice(m, TypeString, slice);
+	}
+	struct Object *first = string_arg(args, "string-append");
+	if (!first)
+		return create_error_object(m);
+	slice = first->string;
+	++slice.buffer->refs;
+	if (!slice_append_args(&slice, cdr(args), "string-append")) {
+		string_buffer_release(slice.buffer);
+		return create_error_object(m);
+	}
+	return create_string_from_slice(m, TypeString, slice);
+}
+
+struct Object *make_string_builder(struct Machine *m, struct Object *args)
+{
+	struct StringSlice slice;
+	if (!string_slice_init(&slice, "", 0))
+		return 0;
+	return create_string_from_slice(m, TypeStringBuilder, slice);
+}
+
+static struct Object *builder_arg(struct Object *args, const char *name)
+{
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeStringBuilder) {
+		fprintf(stderr, "%s wants a string builder.\n", name);
+		return 0;
+	}
+	return arg0;
+}
+
+struct Object *string_builder_append(struct Machine *m, struct Object *args)
+{
+	/* (string-builder-append! b s ...) */
+	struct Object *b = builder_arg(args, "string-builder-append!");
+	if (!b || !slice_append_args(&b->string, cdr(args),
+					"string-builder-append!"))
+		return create_error_object(m);
+	return create_pair_object(m, 0, 0);
+}
+
+struct Object *string_builder_to_string(struct Machine *m,
+					struct Object *args)
+{
+	/*
+	 * The string shares the builder's buffer.  Later appends go after
+	 * its bytes, so it never sees them.
+	 */
+	struct Object *b = builder_arg(args, "string-builder->string");
+	if (!b)
+		return create_error_object(m);
+	struct StringSlice slice = b->string;
+	++slice.buffer->refs;
+	return create_string_from_slice(m, TypeString, slice);
+}
+
+struct Object *string_builder_length(struct Machine *m, struct Object *args)
+{
+	struct Object *b = builder_arg(args, "string-builder-length");
+	if (!b)
+		return create_error_object(m);
+	return create_integer_object(m, b->string.length);
 }
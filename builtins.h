@@ -2,11 +2,13 @@
 #define BUILTINS_H
 
 #include "scheme_forward.h"
+#include <stdbool.h>
 
 struct Object *mcar(struct Machine *m, struct Object *args);
 struct Object *mcdr(struct Machine *m, struct Object *args);
 struct Object *mcadr(struct Machine *m, struct Object *args);
 struct Object *cons(struct Machine *m, struct Object *args);
+struct Object *reverse(struct Machine *m, struct Object *args);
 struct Object *meval(struct Machine *m, struct Object *args);
 struct Object *quote(struct Machine *machine, struct Object *args);
 struct Object *define(struct Machine *machine, struct Object *args);
@@ -14,6 +16,36 @@ struct Object *sum(struct Machine *machine, struct Object *args);
 struct Object *prod(struct Machine *machine, struct Object *args);
 struct Object *subtract(struct Machine *machine, struct Object *args);
 struct Object *divide(struct Machine *machine, struct Object *args);
+struct Object *truth(struct Machine *m, bool b);
+struct Object *num_eq(struct Machine *m, struct Object *args);
+struct Object *num_lt(struct Machine *m, struct Object *args);
+struct Object *num_gt(struct Machine *m, struct Object *args);
+struct Object *null_p(struct Machine *m, struct Object *args);
+struct Object *mif(struct Machine *machine, struct Object *args);
 struct Object *lambda(struct Machine *machine, struct Object *args);
+struct Object *mgc(struct Machine *m, struct Object *args);
+struct Object *mgc_pause_target(struct Machine *m, struct Object *args);
+struct Object *slab_stats(struct Machine *m, struct Object *args);
+struct Object *mdisassemble(struct Machine *m, struct Object *args);
+struct Object *max_call_depth(struct Machine *m, struct Object *args);
+struct Object *callcc(struct Machine *m, struct Object *args);
+struct Object *make_vector(struct Machine *m, struct Object *args);
+struct Object *vector_ref(struct Machine *m, struct Object *args);
+struct Object *vector_set(struct Machine *m, struct Object *args);
+struct Object *vector_length(struct Machine *m, struct Object *args);
+struct Object *vector_fill(struct Machine *m, struct Object *args);
+struct Object *list_to_vector(struct Machine *m, struct Object *args);
+struct Object *vector_to_list(struct Machine *m, struct Object *args);
+struct Object *vector_p(struct Machine *m, struct Object *args);
+struct Object *msimd_level(struct Machine *m, struct Object *args);
+struct Object *string_p(struct Machine *m, struct Object *args);
+struct Object *string_length(struct Machine *m, struct Object *args);
+struct Object *substring(struct Machine *m, struct Object *args);
+struct Object *mstring_append(struct Machine *m, struct Object *args);
+struct Object *make_string_builder(struct Machine *m, struct Object *args);
+struct Object *string_builder_append(struct Machine *m, struct Object *args);
+struct Object *string_builder_to_string(struct Machine *m,
+					struct Object *args);
+struct Object *string_builder_length(struct Machine *m, struct Object *args);
 
 #endif
@@ -0,0 +1,347 @@
+#include "compile.h"
+#include "builtins.h"
+#include "env.h"
+#include "gc.h"
+#include "scheme.h"
+#include "vm.h"
+#include <stdlib.h>
+
+/*
+ * The compiler turns an expression into a Code object for vm_run().
+ * Symbols are resolved as they are compiled.  One that names a
+ * parameter of a lambda being compiled, or of a frame that will
+ * enclose the code at run time, becomes a frame depth and slot.
+ * Anything else refers to the symbol's global cell, which need not be
+ * bound yet.  quote, lambda, define and if are compiled inline when a
+ * call's head names them; any other form is applied at run time.
+ *
+ * A call whose value is the value of the whole body is in tail
+ * position and compiles to OpTailCall, which reuses the caller's
+ * activation.
+ */
+
+struct Scope {
+	struct Object *params;
+	struct Scope *parent;
+};
+
+struct Compiler {
+	struct Machine *machine;
+	struct Object *code;
+	struct Scope *scope;
+	struct Object *env;
+	int depth;
+};
+
+bool params_valid(struct Object *params)
+{
+	while (obj_type(params) == TypePair && !obj_is_nil(params)) {
+		struct Object *param = car(params);
+		if (!param || obj_type(param) != TypeSymbol)
+			return false;
+		params = cdr(params);
+	}
+	return obj_is_nil(params);
+}
+
+ptrdiff_t form_arity(struct Object *args)
+{
+	/* How many arguments a form has, or -1 if they aren't a list. */
+	ptrdiff_t n = 0;
+	while (obj_type(args) == TypePair && !obj_is_nil(args)) {
+		++n;
+		args = cdr(args);
+	}
+	return obj_is_nil(args) ? n : -1;
+}
+
+static ptrdiff_t scope_search(struct Stats *stats, struct Object *names,
+			ptrdiff_t sym)
+{
+	/* names_search(), counting the scope and the names compared. */
+	++stats->scopesWalked;
+	for (ptrdiff_t i = 0; !obj_is_nil(names); ++i, names = cdr(names)) {
+		++stats->namesCompared;
+		if (car(names)->symbol == sym)
+			return i;
+	}
+	return -1;
+}
+
+static bool scope_lookup(struct Compiler *c, ptrdiff_t sym, int *depth,
+			int *slot)
+{
+	/*
+	 * First the lambdas being compiled, innermost first, then the
+	 * frames that will enclose the code at run time.
+	 */
+	struct Stats *stats = &c->machine->stats;
+	struct Scope *scope = c->scope;
+	struct Object *env = c->env;
+	int d = 0;
+	++stats->lookups;
+	for (; scope; scope = scope->parent, ++d) {
+		ptrdiff_t i = scope_search(stats, scope->params, sym);
+		if (i != -1) {
+			*depth = d;
+			*slot = i;
+			return true;
+		}
+	}
+	for (; env && obj_type(env) == TypeFrame; env = env->frame.parent, ++d) {
+		ptrdiff_t i = scope_search(stats, env->frame.names, sym);
+		if (i != -1) {
+			*depth = d;
+			*slot = i;
+			return true;
+		}
+	}
+	return false;
+}
+
+static builtinForm special_form(struct Compiler *c, struct Object *head)
+{
+	/* The builtin form a call's head names, unless a local shadows it. */
+	int depth, slot;
+	if (!head || obj_type(head) != TypeSymbol)
+		return 0;
+	if (scope_lookup(c, head->symbol, &depth, &slot))
+		return 0;
+	struct GlobalCell *cell = global_find(&c->machine->globals,
+					head->symbol);
+	if (!cell || !cell->value || obj_type(cell->value) != TypeBuiltinForm)
+		return 0;
+	return cell->value->builtinForm.f;
+}
+
+static bool emit(struct Compiler *c, int word)
+{
+	struct Code *code = &c->code->code;
+	if (code->count >= code->size) {
+		size_t nsize = code->size ? code->size * 2 : 16;
+		int *nops = realloc(code->ops, nsize * sizeof(*nops));
+		if (!nops)
+			return false;
+		code->ops = nops;
+		code->size = nsize;
+	}
+	code->ops[code->count++] = word;
+	return true;
+}
+
+static bool emit_op(struct Compiler *c, enum Op op, int effect)
+{
+	/* effect is the change the instruction makes to the stack depth. */
+	c->depth += effect;
+	if (c->depth > c->code->code.maxStack)
+		c->code->code.maxStack = c->depth;
+	return emit(c, op);
+}
+
+static int add_const(struct Compiler *c, struct Object *obj)
+{
+	/* The index of obj among the constants, adding it if need be. */
+	struct Code *code = &c->code->code;
+	for (size_t i = 0; i != code->constCount; ++i) {
+		if (code->consts[i] == obj)
+			return i;
+	}
+	if (code->constCount >= code->constSize) {
+		size_t nsize = code->constSize ? code->constSize * 2 : 8;
+		struct Object **nconsts = realloc(code->consts,
+						nsize * sizeof(*nconsts));
+		if (!nconsts)
+			return -1;
+		code->consts = nconsts;
+		code->constSize = nsize;
+	}
+	code->consts[code->constCount] = obj;
+	gc_write_barrier(c->machine, c->code);
+	return code->constCount++;
+}
+
+static bool emit_const_op(struct Compiler *c, enum Op op, int effect,
+			struct Object *obj)
+{
+	int k = add_const(c, obj);
+	return k != -1 && emit_op(c, op, effect) && emit(c, k);
+}
+
+static struct Object *compile_code(struct Machine *machine,
+				struct Scope *scope, struct Object *env,
+				struct Object *params, struct Object *body);
+
+static bool compile_expr(struct Compiler *c, struct Object *expr, bool tail);
+
+static bool compile_symbol(struct Compiler *c, ptrdiff_t sym)
+{
+	int depth, slot;
+	if (scope_lookup(c, sym, &depth, &slot)) {
+		if (!depth)
+			return emit_op(c, OpLocal0, 1) && emit(c, slot);
+		return emit_op(c, OpLocal, 1) && emit(c, depth)
+			&& emit(c, slot);
+	}
+	struct GlobalCell *cell = global_cell(&c->machine->globals, sym);
+	if (!cell)
+		return false;
+	struct Object *ref = create_global_ref_object(c->machine, cell);
+	return ref && emit_const_op(c, OpGlobal, 1, ref);
+}
+
+static bool compile_form(struct Compiler *c, struct Object *expr)
+{
+	/*
+	 * Applies a form to its unevaluated arguments when the code runs.
+	 * This is also how malformed quote, lambda, define and if report.
+	 */
+	struct Object *form = global_find(&c->machine->globals,
+					car(expr)->symbol)->value;
+	int k = add_const(c, form);
+	int j = add_const(c, cdr(expr));
+	return k != -1 && j != -1 && emit_op(c, OpForm, 1) && emit(c, k)
+		&& emit(c, j);
+}
+
+static bool compile_lambda_expr(struct Compiler *c, struct Object *expr,
+				ptrdiff_t name)
+{
+	/* (lambda params body), named by the define it is the value of. */
+	if (form_arity(cdr(expr)) != 2 || !params_valid(cadr(expr)))
+		return compile_form(c, expr);
+	struct Object *params = cadr(expr);
+	struct Scope inner = {.params = params, .parent = c->scope};
+	struct Object *code = compile_code(c->machine, &inner, c->env, params,
+					car(cdr(cdr(expr))));
+	if (!code)
+		return false;
+	code->code.name = name;
+	/* Nothing allocates between here and code being a constant. */
+	return emit_const_op(c, OpClosure, 1, code);
+}
+
+static bool compile_define(struct Compiler *c, struct Object *expr)
+{
+	/* (define key value) */
+	struct Object *args = cdr(expr);
+	if (form_arity(args) != 2 || !car(args)
+	    || obj_type(car(args)) != TypeSymbol)
+		return compile_form(c, expr);
+	struct GlobalCell *cell = global_cell(&c->machine->globals,
+					car(args)->symbol);
+	if (!cell)
+		return false;
+	struct Object *ref = create_global_ref_object(c->machine, cell);
+	if (!ref)
+		return false;
+	struct Object *value = cadr(args);
+	bool ok;
+	if (obj_type(value) == TypePair && !obj_is_nil(value)
+	    && special_form(c, car(value)) == lambda)
+		ok = compile_lambda_expr(c, value, car(args)->symbol);
+	else
+		ok = compile_expr(c, value, false);
+	return ok && emit_const_op(c, OpDefine, 0, ref);
+}
+
+static bool compile_if(struct Compiler *c, struct Object *expr, bool tail)
+{
+	/*
+	 * (if test then [else]).  Both branches are in tail position if
+	 * the if is.  The branches are compiled at the same stack depth.
+	 */
+	struct Object *args = cdr(expr);
+	ptrdiff_t n = form_arity(args);
+	if (n != 2 && n != 3)
+		return compile_form(c, expr);
+	if (!compile_expr(c, car(args), false) || !emit_op(c, OpJumpFalse, -1))
+		return false;
+	size_t toElse = c->code->code.count;
+	int depth = c->depth;
+	if (!emit(c, 0) || !compile_expr(c, cadr(args), tail)
+	    || !emit_op(c, OpJump, 0))
+		return false;
+	size_t toEnd = c->code->code.count;
+	if (!emit(c, 0))
+		return false;
+	c->code->code.ops[toElse] = c->code->code.count;
+	c->depth = depth;
+	if (n == 3 ? !compile_expr(c, car(cdr(cdr(args))), tail)
+	    : !emit_op(c, OpNil, 1))
+		return false;
+	c->code->code.ops[toEnd] = c->code->code.count;
+	return true;
+}
+
+static bool compile_call(struct Compiler *c, struct Object *expr, bool tail)
+{
+	if (!compile_expr(c, car(expr), false))
+		return false;
+	int n = 0;
+	for (struct Object *args = cdr(expr);
+	     obj_type(args) == TypePair && !obj_is_nil(args);
+	     args = cdr(args)) {
+		if (!compile_expr(c, car(args), false))
+			return false;
+		++n;
+	}
+	return emit_op(c, tail ? OpTailCall : OpCall, -n) && emit(c, n);
+}
+
+static bool compile_expr(struct Compiler *c, struct Object *expr, bool tail)
+{
+	builtinForm form;
+	switch (obj_type(expr)) {
+	case TypeSymbol:
+		return compile_symbol(c, expr->symbol);
+	case TypePair:
+		if (obj_is_nil(expr) || !car(expr))
+			return emit_op(c, OpNilCall, 1);
+		form = special_form(c, car(expr));
+		if (form == quote && form_arity(cdr(expr)) == 1)
+			return emit_const_op(c, OpConst, 1, cadr(expr));
+		if (form == lambda)
+			return compile_lambda_expr(c, expr, -1);
+		if (form == define)
+			return compile_define(c, expr);
+		if (form == mif)
+			return compile_if(c, expr, tail);
+		if (form)
+			return compile_form(c, expr);
+		return compile_call(c, expr, tail);
+	default:
+		/* Everything else evaluates to itself. */
+		return emit_const_op(c, OpConst, 1, expr);
+	}
+}
+
+static struct Object *compile_code(struct Machine *machine,
+				struct Scope *scope, struct Object *env,
+				struct Object *params, struct Object *body)
+{
+	struct Compiler c = {
+		.machine = machine, .code = 0,
+		.scope = scope, .env = env, .depth = 0
+	};
+	size_t roots = gc_roots_save(machine);
+	gc_push_root(machine, &c.code);
+	c.code = create_code_object(machine, params);
+	bool ok = c.code && compile_expr(&c, body, true)
+		&& emit_op(&c, OpReturn, -1);
+	gc_roots_restore(machine, roots);
+	return ok ? c.code : 0;
+}
+
+struct Object *compile(struct Machine *machine, struct Object *expr)
+{
+	/* Top-level code runs in machine->env, with no parameters. */
+	return compile_code(machine, 0, machine->env, 0, expr);
+}
+
+struct Object *compile_lambda(struct Machine *machine, struct Object *params,
+			struct Object *body)
+{
+	/* The code of a closure that will be made in machine->env. */
+	struct Scope top = {.params = params, .parent = 0};
+	return compile_code(machine, &top, machine->env, params, body);
+}
@@ -0,0 +1,14 @@
+#ifndef COMPILE_H
+#define COMPILE_H
+
+#include "scheme_forward.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+bool params_valid(struct Object *params);
+ptrdiff_t form_arity(struct Object *args);
+struct Object *compile(struct Machine *machine, struct Object *expr);
+struct Object *compile_lambda(struct Machine *machine, struct Object *params,
+			struct Object *body);
+
+#endif
@@ -1,70 +1,86 @@
 #include "env.h"
+#include "gc.h"
 #include "scheme.h"
 #include <stdio.h>
 #include <stdlib.h>
 
-struct Env make_env(void)
+ptrdiff_t names_search(struct Object *names, ptrdiff_t sym)
 {
-	struct Env e = {.map = 0, .count = 0, .size = 0, .parent = 0};
-	return e;
+	/* The position of sym in a list of symbols, such as a Frame's names. */
+	for (ptrdiff_t i = 0; !obj_is_nil(names); ++i, names = cdr(names)) {
+		if (car(names)->symbol == sym)
+			return i;
+	}
+	return -1;
 }
 
-struct Object *env_get(struct Env *env, ptrdiff_t sym)
+struct Globals make_globals(void)
 {
-	/* NOTE: this one is recursive */
-	while (env) {
-		for (ptrdiff_t i = 0; i != env->count; ++i) {
-			if (sym == env->map[i].key) {
-				return env->map[i].value;
-			}
-		}
-		if (env->parent)
-			env = &(env->parent->env);
-		else
-			env = 0;
-	}
-	return 0;
+	struct Globals g = {.blocks = 0, .count = 0, .size = 0};
+	return g;
 }
 
-ptrdiff_t env_search(struct Env *env, ptrdiff_t sym)
+void free_globals(struct Globals *globals)
 {
-	/* NOTE: this one is not recursive. */
-	for (ptrdiff_t i = 0; i != env->count; ++i) {
-		if (sym == env->map[i].key) {
-			return i;
-		}
-	}
-	return -1;
+	for (size_t i = 0; i != globals->count; ++i)
+		free(globals->blocks[i]);
+	free(globals->blocks);
+	*globals = make_globals();
 }
 
-bool env_map_append(struct Env *env, struct EnvEntry ent)
+struct GlobalCell *global_find(struct Globals *globals, ptrdiff_t sym)
 {
-	if (env->count >= env->size) {
-		size_t nsize = (env->size + 8);
-		size_t nbytes = nsize * sizeof(struct EnvEntry);
-		struct EnvEntry *nmap = realloc(env->map, nbytes);
-		if (!nmap)
-			return false;
-		env->map = nmap;
-		env->size = nsize;
-	}
-	ptrdiff_t entryNum = env->count;
-	(env->map)[entryNum] = ent;
-	++(env->count);
-	return true;
+	/* The cell for sym, or 0 if its block was never made. */
+	size_t block = sym / GLOBAL_BLOCK_SIZE;
+	if (block >= globals->count || !globals->blocks[block])
+		return 0;
+	return &globals->blocks[block][sym % GLOBAL_BLOCK_SIZE];
 }
 
-bool env_update(struct Env *env, ptrdiff_t sym, struct Object *obj)
+struct GlobalCell *global_cell(struct Globals *globals, ptrdiff_t sym)
 {
-	/* NOTE: this one is not recursive.  This will overwrite an
-	 * entry in the Env passed in, but will shadow an entry in a
-	 * parent Env.
-	 */
-	ptrdiff_t i = env_search(env, sym);
-	if (i == -1) {
-		struct EnvEntry ent = {.key = sym, .value = obj};
-		return env_map_append(env, ent);
+	/* The cell for sym, making it if needed. */
+	size_t block = sym / GLOBAL_BLOCK_SIZE;
+	if (block >= globals->size) {
+		size_t nsize = globals->size ? globals->size * 2 : 16;
+		while (nsize <= block)
+			nsize *= 2;
+		size_t nbytes = nsize * sizeof(struct GlobalCell *);
+		struct GlobalCell **nblocks = realloc(globals->blocks, nbytes);
+		if (!nblocks)
+			return 0;
+		for (size_t i = globals->size; i != nsize; ++i)
+			nblocks[i] = 0;
+		globals->blocks = nblocks;
+		globals->size = nsize;
+	}
+	if (!globals->blocks[block]) {
+		struct GlobalCell *cells = malloc(GLOBAL_BLOCK_SIZE
+						* sizeof(struct GlobalCell));
+		if (!cells)
+			return 0;
+		for (size_t i = 0; i != GLOBAL_BLOCK_SIZE; ++i) {
+			struct GlobalCell cell = {
+				.value = 0, .ref = 0,
+				.sym = block * GLOBAL_BLOCK_SIZE + i,
+				.remembered = false
+			};
+			cells[i] = cell;
+		}
+		globals->blocks[block] = cells;
 	}
-	env->map[i].value = obj;
+	if (block >= globals->count)
+		globals->count = block + 1;
+	return &globals->blocks[block][sym % GLOBAL_BLOCK_SIZE];
+}
+
+bool global_define(struct Machine *m, ptrdiff_t sym, struct Object *value)
+{
+	/* Updates the cell in place, so compiled references see it. */
+	struct GlobalCell *cell = global_cell(&m->globals, sym);
+	if (!cell)
+		return false;
+	cell->value = value;
+	gc_cell_barrier(m, cell);
 	return true;
 }
@@ -5,23 +5,33 @@
 #include <stdbool.h>
 #include <stddef.h>
 
-struct EnvEntry {
-	ptrdiff_t key;
+/*
+ * Global variables, one cell per symbol id.  Cells live in fixed
+ * blocks so their addresses never change and compiled references can
+ * keep pointing at them.  A null value means unbound.
+ */
+
+#define GLOBAL_BLOCK_SIZE 256
+
+struct GlobalCell {
 	struct Object *value;
+	struct Object *ref;
+	ptrdiff_t sym;
+	bool remembered;
 };
 
-struct Env {
-	struct EnvEntry *map;
+struct Globals {
+	struct GlobalCell **blocks;
 	size_t count;
 	size_t size;
-	struct Object *parent;
 };
 
-struct Env make_env(void);
-struct Object *env_get(struct Env *env, ptrdiff_t sym);
-ptrdiff_t env_search(struct Env *env, ptrdiff_t sym);
-bool env_map_append(struct Env *env, struct EnvEntry ent);
-bool env_update(struct Env *env, ptrdiff_t sym, struct Object *obj);
+ptrdiff_t names_search(struct Object *names, ptrdiff_t sym);
+struct Globals make_globals(void);
+void free_globals(struct Globals *globals);
+struct GlobalCell *global_cell(struct Globals *globals, ptrdiff_t sym);
+struct GlobalCell *global_find(struct Globals *globals, ptrdiff_t sym);
+bool global_define(struct Machine *m, ptrdiff_t sym, struct Object *value);
 
 
 #endif
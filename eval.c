@@ -1,117 +1,93 @@
 #include "eval.h"
-#include "scheme.h"
+#include "compile.h"
+#include "gc.h"
 #include "print.h"
-#include <assert.h>
-#include <stdio.h>
-
-struct Object *eval_pair(struct Machine *machine, struct Object *obj);
+#include "read.h"
+#include "scheme.h"
+#include "vm.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 struct Object *eval(struct Machine *machine, struct Object *obj)
 {
-	struct Object *nobj = 0;
-	switch (obj->type) {
-	case TypeString:
-	case TypeInteger:
-	case TypeDouble:
-	case TypeError:
-	case TypeEnv:
-	case TypeBuiltinForm:
-	case TypeBuiltinFunc:
-		nobj = obj;
-		break;
-	case TypeSymbol:
-		nobj = env_get(&machine->env->env, obj->symbol);
-		if (!nobj) {
-			char *symStr = machine->symbols.strs[obj->symbol].cstr;
-			fprintf(stderr,
-				"Failed to find %s in environment.\n",
-				symStr);
-			nobj = create_error_object(machine);
-		}
-		break;
-	case TypePair:
-		nobj = eval_pair(machine, obj);
-		break;
-	default:
-		assert(0);
-	}
-	return nobj;
-}
-
-struct Object *eval_list_items(struct Machine *machine, struct Object *inList)
-{
-	struct Object *first = create_pair_object(machine, 0, 0);
-	if (!first)
-		return 0;
-	if (obj_is_nil(inList))
-		return first;
-	struct Object *into = first;
-	do {
-		into->pair.car = eval(machine, car(inList));
-		into->pair.cdr = create_pair_object(machine, 0, 0);
-		if (!into->pair.cdr)
-			return 0;
-		into = cdr(into);
-		inList = cdr(inList);
-	} while (!obj_is_nil(inList));
-	return first;
+	/*
+	 * Compile obj and run it in machine->env.  Closures keep the
+	 * code for their bodies, so only the top level is compiled
+	 * each time it is evaluated.
+	 */
+	++machine->stats.evals;
+	struct Object *code = compile(machine, obj);
+	if (!code)
+		return create_error_object(machine);
+	size_t roots = gc_roots_save(machine);
+	gc_push_root(machine, &code);
+	struct Object *res = vm_run(machine, code, machine->env);
+	gc_roots_restore(machine, roots);
+	return res;
 }
 
-struct Object *eval_closure(struct Machine *m, struct Object *closure,
-			struct Object *argVals)
+void eval_print(struct Machine *machine, struct Reader *reader,
+		bool interactive)
 {
-	// Create new env, with parent captured when the closure was defined
-	struct Object * newEnv = create_env_object(m);
-	newEnv->env.parent = closure->closure.env;
-
-	// Populate the new environment with the args passed in
-	struct Object *argDefs = closure->closure.args;
-	while (!obj_is_nil(argDefs) && !obj_is_nil(argVals)) {
-		struct Object *key = car(argDefs);
-		struct Object *val = car(argVals);
-		env_update(&newEnv->env, key->symbol, val);
-		argDefs = cdr(argDefs);
-		argVals = cdr(argDefs);
+	/*
+	 * Evaluates and prints every expression the reader has.  Output
+	 * is flushed after each one only when someone is waiting for it.
+	 */
+	while (1) {
+		struct Object *obj = read_scheme(machine, reader);
+		if (!obj) {
+			if (reader->eof)
+				break;
+			continue;
+		}
+		size_t roots = gc_roots_save(machine);
+		gc_push_root(machine, &obj);
+		struct Object *nobj = eval(machine, obj);
+		gc_roots_restore(machine, roots);
+		obj_print(machine, nobj);
+		printer_puts(&machine->out, "\n\n");
+		if (interactive)
+			printer_flush(&machine->out);
 	}
-
-	// Push new env
-	struct Object * oldEnv = m->env;
-	m->env = newEnv;
-
-	struct Object *res = eval(m, closure->closure.body);
-
-	// Pop new env
-	m->env = oldEnv;
-
-	return res;
+	printer_flush(&machine->out);
 }
 
-struct Object *eval_pair(struct Machine *machine, struct Object *obj)
+bool eval_file(struct Machine *machine, const char *path)
 {
-	if (obj->pair.car) {
-		struct Object *ecar = eval(machine, obj->pair.car);
-		struct Object *eargs;
-		switch (ecar->type) {
-		case TypeBuiltinForm:
-			return ecar->builtinForm.f(machine, obj->pair.cdr);
-		case TypeBuiltinFunc:
-			eargs = eval_list_items(machine, obj->pair.cdr);
-			return ecar->builtinFunc.f(machine, eargs);
-		case TypeClosure:
-			eargs = eval_list_items(machine, obj->pair.cdr);
-			return eval_closure(machine, ecar, eargs);
-		case TypeSymbol:
-		case TypeString:
-		case TypeInteger:
-		case TypeDouble:
-		case TypePair:
-		case TypeEnv:
-		case TypeError:
-			fprintf(stderr, "The first element isn't something executable\n");
-			return create_error_object(machine);
+	/*
+	 * The file is mapped rather than read, and the reader scans the
+	 * mapping directly.
+	 */
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		perror(path);
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		perror(path);
+		close(fd);
+		return false;
+	}
+	size_t len = st.st_size;
+	char *buf = 0;
+	if (len) {
+		buf = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (buf == MAP_FAILED) {
+			perror(path);
+			close(fd);
+			return false;
 		}
+		madvise(buf, len, MADV_SEQUENTIAL);
 	}
-	fprintf(stderr, "eval_pair: car is null.\n");
-	return create_error_object(machine);
+	close(fd);
+	struct Reader reader;
+	reader_init_buffer(&reader, buf, len);
+	eval_print(machine, &reader, false);
+	reader_free(&reader);
+	if (len)
+		munmap(buf, len);
+	return true;
 }
-
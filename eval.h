@@ -2,7 +2,13 @@
 #define EVAL_H
 
 #include "scheme_forward.h"
+#include <stdbool.h>
+
+struct Reader;
 
 struct Object *eval(struct Machine *machine, struct Object *obj);
+void eval_print(struct Machine *machine, struct Reader *reader,
+		bool interactive);
+bool eval_file(struct Machine *machine, const char *path);
 
 #endif
@@ -0,0 +1,537 @@
+#include "gc.h"
+#include "scheme.h"
+#include "slab.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define GC_MIN_NURSERY 256
+#define GC_MAX_NURSERY (1 << 20)
+#define GC_DEFAULT_NURSERY 4096
+#define GC_MIN_MAJOR_THRESHOLD 65536
+#define GC_DEFAULT_PAUSE_NS 1000000
+
+static long now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static bool past_deadline(long deadline, size_t n)
+{
+	/* Only look at the clock every so often; it is not free. */
+	return deadline && (n & 255) == 0 && now_ns() >= deadline;
+}
+
+struct Heap make_heap(void)
+{
+	struct Heap h = {
+		.young = 0, .youngCount = 0, .youngSize = 0,
+		.oldCount = 0, .allocsSinceStep = 0,
+		.nurserySize = GC_DEFAULT_NURSERY,
+		.majorThreshold = GC_MIN_MAJOR_THRESHOLD,
+		.phase = GcIdle, .minor = false,
+		.pauseTargetNs = GC_DEFAULT_PAUSE_NS,
+		.sweepClass = 0, .sweepPage = 0, .sweepSlot = 0,
+		.roots = 0, .rootCount = 0, .rootSize = 0,
+		.remembered = 0, .rememberedCount = 0, .rememberedSize = 0,
+		.rememberedCells = 0, .rememberedCellCount = 0,
+		.rememberedCellSize = 0,
+		.markStack = 0, .markCount = 0, .markSize = 0,
+		.allocations = 0,
+		.minorCollections = 0, .majorCollections = 0, .maxPauseNs = 0
+	};
+	return h;
+}
+
+void free_heap(struct Heap *h)
+{
+	/* The collector's own arrays; the objects are the slabs' to free. */
+	free(h->young);
+	free(h->roots);
+	free(h->remembered);
+	free(h->rememberedCells);
+	free(h->markStack);
+	*h = make_heap();
+}
+
+static void *grow_array(void *arr, size_t *size, size_t elemSize)
+{
+	size_t nsize = *size ? *size * 2 : 64;
+	void *narr = realloc(arr, nsize * elemSize);
+	if (!narr) {
+		/* There is no way to carry on without losing track of objects. */
+		fprintf(stderr, "gc: out of memory for collector bookkeeping.\n");
+		abort();
+	}
+	*size = nsize;
+	return narr;
+}
+
+static void gc_mark(struct Heap *h, struct Object *obj)
+{
+	if (!obj || obj_is_fixnum(obj) || obj->marked
+	    || obj->generation == GenPermanent
+	    || (h->minor && obj->generation == GenOld))
+		return;
+	obj->marked = 1;
+	if (h->markCount >= h->markSize)
+		h->markStack = grow_array(h->markStack, &h->markSize,
+					sizeof(*h->markStack));
+	h->markStack[h->markCount++] = obj;
+}
+
+static void gc_scan(struct Heap *h, struct Object *obj)
+{
+	switch (obj->type) {
+	case TypePair:
+		gc_mark(h, obj->pair.car);
+		gc_mark(h, obj->pair.cdr);
+		return;
+		return;
+	case TypeClosure:
+		gc_mark(h, obj->closure.args);
+		gc_mark(h, obj->closure.code);
+		gc_mark(h, obj->closure.env);
+		return;
+	case TypeFrame:
+		for (size_t i = 0; i != obj->frame.count; ++i)
+			gc_mark(h, obj->frame.slots[i]);
+		gc_mark(h, obj->frame.names);
+		gc_mark(h, obj->frame.parent);
+		return;
+	case TypeCode:
+		for (size_t i = 0; i != obj->code.constCount; ++i)
+			gc_mark(h, obj->code.consts[i]);
+		gc_mark(h, obj->code.params);
+		return;
+	case TypeChunk:
+		for (size_t i = 0; i != obj->chunk.count; ++i)
+			gc_mark(h, obj->chunk.slots[i]);
+		gc_mark(h, obj->chunk.parent);
+		return;
+	case TypeVector:
+		for (size_t i = 0; i != obj->vector.count; ++i)
+			gc_mark(h, obj->vector.items[i]);
+		return;
+	case TypeHashTable:
+		for (size_t i = 0; i != obj->hashTable.size; ++i) {
+			struct HashEntry *e = &obj->hashTable.entries[i];
+			if (e->key) {
+				gc_mark(h, e->key);
+				gc_mark(h, e->value);
+			}
+		}
+		return;
+	case TypeHamt:
+		gc_mark(h, obj->hamt.root);
+		return;
+	case TypeHamtNode:
+		for (size_t i = 0; i != obj->hamtNode.count; ++i)
+			gc_mark(h, obj->hamtNode.slots[i]);
+		return;
+	case TypeRecordType:
+		gc_mark(h, obj->recordType.name);
+		return;
+	case TypeRecord:
+		for (size_t i = 0; i != obj->record.count; ++i)
+			gc_mark(h, obj->record.slots[i]);
+		gc_mark(h, obj->record.type);
+		return;
+	case TypeRecordProc:
+		gc_mark(h, obj->recordProc.type);
+		gc_mark(h, obj->recordProc.name);
+		return;
+	case TypeContinuation:
+		gc_mark(h, obj->continuation.chunk);
+		gc_mark(h, obj->continuation.code);
+		gc_mark(h, obj->continuation.frame);
+		return;
+	case TypeSymbol:
+	case TypeString:
+	case TypeInteger:
+	case TypeDouble:
+	case TypeError:
+	case TypeBuiltinForm:
+	case TypeBuiltinFunc:
+	case TypeGlobalRef:
+	case TypeBignum:
+	case TypeF64Vector:
+	case TypeS64Vector:
+	case TypeStringBuilder:
+		return;
+	}
+}
+
+static void gc_mark_stack(struct Machine *m)
+{
+	/*
+	 * The VM writes stack chunks without barriers, so the ones it
+	 * may have written since the last collection are roots.  Those
+	 * are the dirty ones, which always sit at the top of the chain.
+	 * Below them every chunk is either sealed, having had a barrier
+	 * when it was sealed, or was scanned by an earlier collection
+	 * and not written since.
+	 */
+	struct Heap *h = &m->heap;
+	gc_mark(h, m->chunk);
+	for (struct Object *c = m->chunk; c && !c->chunk.sealed;
+	     c = c->chunk.parent) {
+		if (!c->chunk.dirty && c != m->chunk)
+			break;
+		for (size_t i = 0; i != c->chunk.count; ++i)
+			gc_mark(h, c->chunk.slots[i]);
+		c->chunk.dirty = c == m->chunk;
+	}
+}
+
+static void gc_mark_roots(struct Machine *m)
+{
+	struct Heap *h = &m->heap;
+	gc_mark(h, m->env);
+	for (size_t i = 0; i != h->rootCount; ++i)
+		gc_mark(h, *h->roots[i]);
+	gc_mark(h, m->code);
+	gc_mark_stack(m);
+	/*
+	 * Global cells are roots too.  A minor collection only needs the
+	 * ones defined since the last collection.
+	 */
+	if (h->minor) {
+		for (size_t i = 0; i != h->rememberedCellCount; ++i)
+			gc_mark(h, h->rememberedCells[i]->value);
+	} else {
+		struct Globals *g = &m->globals;
+		for (size_t b = 0; b != g->count; ++b) {
+			if (!g->blocks[b])
+				continue;
+			for (size_t i = 0; i != GLOBAL_BLOCK_SIZE; ++i)
+				gc_mark(h, g->blocks[b][i].value);
+		}
+	}
+	/*
+	 * The symbol table's objects are permanent and refer to nothing,
+	 * so there is nothing to trace there.
+	 */
+}
+
+static bool gc_drain(struct Heap *h, long deadline)
+{
+	size_t n = 0;
+	while (h->markCount) {
+		if (past_deadline(deadline, ++n))
+			return false;
+		gc_scan(h, h->markStack[--h->markCount]);
+	}
+	return true;
+}
+
+static void gc_forget_remembered(struct Heap *h)
+{
+	for (size_t i = 0; i != h->rememberedCount; ++i)
+		h->remembered[i]->remembered = 0;
+	h->rememberedCount = 0;
+	for (size_t i = 0; i != h->rememberedCellCount; ++i)
+		h->rememberedCells[i]->remembered = false;
+	h->rememberedCellCount = 0;
+}
+
+static bool gc_already_swept(struct Heap *h, struct Object *obj)
+{
+	struct SlabPage *page = slab_page_of(obj);
+	if (page->cls != h->sweepClass)
+		return page->cls < h->sweepClass;
+	if (page->index != h->sweepPage)
+		return page->index < h->sweepPage;
+	return slab_slot_of(page, obj) < h->sweepSlot;
+}
+
+static void gc_release(struct Machine *m, struct Object *obj)
+{
+	destroy_object(m, obj);
+	slab_free(&m->slabs, obj);
+}
+
+static void gc_sweep_young(struct Heap *h, struct Machine *m)
+{
+	/*
+	 * Survivors are promoted; they never go back to the nursery.
+	 * While a major sweep is under way, a survivor that the sweeper
+	 * has yet to reach keeps its mark so that it is not taken for
+	 * garbage.  Walk backwards so that freed slots come back in
+	 * allocation order.
+	 */
+	for (size_t i = h->youngCount; i; --i) {
+		struct Object *obj = h->young[i - 1];
+		if (obj->marked) {
+			obj->marked = h->phase == GcSweeping
+				&& !gc_already_swept(h, obj);
+			obj->generation = GenOld;
+			++h->oldCount;
+		} else {
+			gc_release(m, obj);
+		}
+	}
+	h->youngCount = 0;
+}
+
+static long gc_minor(struct Machine *m)
+{
+	/* Returns how long rescanning the remembered set took. */
+	struct Heap *h = &m->heap;
+	h->minor = true;
+	gc_mark_roots(m);
+	long start = now_ns();
+	for (size_t i = 0; i != h->rememberedCount; ++i)
+		gc_scan(h, h->remembered[i]);
+	long rescan = now_ns() - start;
+	gc_forget_remembered(h);
+	gc_drain(h, 0);
+	h->minor = false;
+	gc_sweep_young(h, m);
+	++h->minorCollections;
+	return rescan;
+}
+
+static void gc_major_begin(struct Machine *m)
+{
+	/* Called right after a minor collection, so the nursery is empty. */
+	m->heap.phase = GcMarking;
+	gc_mark_roots(m);
+}
+
+static void gc_major_finish_mark(struct Machine *m)
+{
+	struct Heap *h = &m->heap;
+	/*
+	 * Roots are not barriered, so look at them again before finishing,
+	 * and rescan whatever was written since it was marked.
+	 */
+	gc_mark_roots(m);
+	for (size_t i = 0; i != h->rememberedCount; ++i)
+		if (h->remembered[i]->marked)
+			gc_scan(h, h->remembered[i]);
+	gc_forget_remembered(h);
+	gc_drain(h, 0);
+
+	h->phase = GcSweeping;
+	h->sweepClass = 0;
+	h->sweepPage = 0;
+	h->sweepSlot = 0;
+	gc_sweep_young(h, m);
+	++h->majorCollections;
+}
+
+static bool gc_sweep_old(struct Machine *m, long deadline)
+{
+	/*
+	 * Walk every page in every class.  Young objects belong to the
+	 * nursery and are left alone.
+	 */
+	struct Heap *h = &m->heap;
+	struct Slabs *slabs = &m->slabs;
+	size_t n = 0;
+	for (; h->sweepClass != slabs->count; ++h->sweepClass) {
+		struct SlabClass *c = &slabs->classes[h->sweepClass];
+		for (; h->sweepPage != c->count; ++h->sweepPage) {
+			struct SlabPage *page = c->pages[h->sweepPage];
+			for (; h->sweepSlot != page->bump; ++h->sweepSlot) {
+				if (past_deadline(deadline, ++n))
+					return false;
+				struct Object *obj =
+					slab_object_at(page, h->sweepSlot);
+				if (!obj->live || obj->generation != GenOld)
+					continue;
+				if (obj->marked) {
+					obj->marked = 0;
+				} else {
+					gc_release(m, obj);
+					--h->oldCount;
+				}
+			}
+			h->sweepSlot = 0;
+		}
+		h->sweepPage = 0;
+	}
+	slabs_release_empty(slabs);
+	h->phase = GcIdle;
+	h->majorThreshold = h->oldCount * 2;
+	if (h->majorThreshold < GC_MIN_MAJOR_THRESHOLD)
+		h->majorThreshold = GC_MIN_MAJOR_THRESHOLD;
+	return true;
+}
+
+static void gc_adapt_nursery(struct Heap *h, long pause, long rescan)
+{
+	/*
+	 * The nursery size is what bounds a minor pause, so steer it
+	 * towards the pause target.  Rescanning remembered objects is the
+	 * exception: a big vector or table written between every pair of
+	 * collections costs the same however small the nursery is, so when
+	 * that dominates, grow the nursery to rescan less often.
+	 */
+	pause -= rescan;
+	if (rescan > pause && h->nurserySize < GC_MAX_NURSERY)
+		h->nurserySize *= 2;
+	else if (pause > h->pauseTargetNs && h->nurserySize > GC_MIN_NURSERY)
+		h->nurserySize /= 2;
+	else if (pause < h->pauseTargetNs / 4 && h->nurserySize < GC_MAX_NURSERY)
+		h->nurserySize *= 2;
+}
+
+static void gc_step(struct Machine *m)
+{
+	struct Heap *h = &m->heap;
+	long start = now_ns();
+	long deadline = start + h->pauseTargetNs;
+	long rescan = 0;
+	h->allocsSinceStep = 0;
+	switch (h->phase) {
+	case GcIdle:
+		rescan = gc_minor(m);
+		if (h->oldCount >= h->majorThreshold)
+			gc_major_begin(m);
+		break;
+	case GcMarking:
+		/*
+		 * No minor collections while marking; the nursery simply
+		 * keeps growing until the cycle finishes.
+		 */
+		if (gc_drain(h, deadline))
+			gc_major_finish_mark(m);
+		break;
+	case GcSweeping:
+		rescan = gc_minor(m);
+		gc_sweep_old(m, deadline);
+		break;
+	}
+	long pause = now_ns() - start;
+	if (pause > h->maxPauseNs)
+		h->maxPauseNs = pause;
+	gc_adapt_nursery(h, pause, rescan);
+}
+
+struct Object *gc_alloc(struct Machine *m, size_t cls)
+{
+	struct Heap *h = &m->heap;
+	if (++h->allocsSinceStep >= h->nurserySize)
+		gc_step(m);
+	if (h->youngCount >= h->youngSize)
+		h->young = grow_array(h->young, &h->youngSize,
+				sizeof(*h->young));
+	struct Object *obj = slab_alloc(&m->slabs, cls);
+	if (!obj) {
+		gc_collect(m);
+		obj = slab_alloc(&m->slabs, cls);
+		if (!obj)
+			return 0;
+	}
+	obj->marked = 0;
+	obj->generation = GenYoung;
+	obj->remembered = 0;
+	h->young[h->youngCount++] = obj;
+	++h->allocations;
+	return obj;
+}
+
+struct Object *gc_alloc_permanent(struct Machine *m, size_t cls)
+{
+	/* Outside the nursery and never swept. */
+	struct Object *obj = slab_alloc(&m->slabs, cls);
+	if (obj) {
+		obj->marked = 0;
+		obj->generation = GenPermanent;
+		obj->remembered = 0;
+	}
+	return obj;
+}
+
+void gc_collect(struct Machine *m)
+{
+	/*
+	 * Run a whole major cycle without regard for the pause target.
+	 * If one was already under way, finish it and then do a fresh
+	 * one so that everything dead right now is reclaimed.
+	 */
+	struct Heap *h = &m->heap;
+	for (int cycles = h->phase == GcIdle ? 1 : 2; cycles; --cycles) {
+		if (h->phase == GcIdle) {
+			gc_minor(m);
+			gc_major_begin(m);
+		}
+		if (h->phase == GcMarking) {
+			gc_drain(h, 0);
+			gc_major_finish_mark(m);
+		}
+		gc_sweep_old(m, 0);
+	}
+	h->allocsSinceStep = 0;
+}
+
+void gc_write_barrier(struct Machine *m, struct Object *obj)
+{
+	/*
+	 * While marking, an object that was already marked is remembered
+	 * too, whatever its generation, and made grey again.  Writing it
+	 * again only needs the rescan that finishing the mark gives every
+	 * remembered object; making a big vector or table grey on each
+	 * store would rescan all of it every time.
+	 */
+	struct Heap *h = &m->heap;
+	if (obj->remembered)
+		return;
+	bool grey = h->phase == GcMarking && obj->marked;
+	if (obj->generation != GenOld && !grey)
+		return;
+	obj->remembered = 1;
+	if (h->rememberedCount >= h->rememberedSize)
+		h->remembered = grow_array(h->remembered,
+					&h->rememberedSize,
+					sizeof(*h->remembered));
+	h->remembered[h->rememberedCount++] = obj;
+	if (grey) {
+		if (h->markCount >= h->markSize)
+			h->markStack = grow_array(h->markStack, &h->markSize,
+						sizeof(*h->markStack));
+		h->markStack[h->markCount++] = obj;
+	}
+}
+
+void gc_cell_barrier(struct Machine *m, struct GlobalCell *cell)
+{
+	struct Heap *h = &m->heap;
+	if (cell->remembered)
+		return;
+	cell->remembered = true;
+	if (h->rememberedCellCount >= h->rememberedCellSize)
+		h->rememberedCells = grow_array(h->rememberedCells,
+						&h->rememberedCellSize,
+						sizeof(*h->rememberedCells));
+	h->rememberedCells[h->rememberedCellCount++] = cell;
+}
+
+void gc_push_root(struct Machine *m, struct Object **root)
+{
+	struct Heap *h = &m->heap;
+	if (h->rootCount >= h->rootSize)
+		h->roots = grow_array(h->roots, &h->rootSize,
+				sizeof(*h->roots));
+	h->roots[h->rootCount++] = root;
+}
+
+size_t gc_roots_save(struct Machine *m)
+{
+	return m->heap.rootCount;
+}
+
+void gc_roots_restore(struct Machine *m, size_t saved)
+{
+	m->heap.rootCount = saved;
+}
+
+void gc_set_pause_target(struct Machine *m, long usec)
+{
+	if (usec > 0)
+		m->heap.pauseTargetNs = usec * 1000;
+}
@@ -0,0 +1,89 @@
+#ifndef GC_H
+#define GC_H
+
+#include "scheme_forward.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A generational, non-moving, precise collector.
+ *
+ * New objects are logged in the nursery (the young array).  When enough
+ * objects have been allocated since the last step we run a minor
+ * collection, which traces only young objects starting from the
+ * roots and the remembered set, and promotes the survivors.  Once the
+ * old generation grows past majorThreshold a major cycle starts.  It
+ * marks incrementally and then sweeps incrementally, in slices that
+ * are cut off when they reach the pause target.
+ *
+ * Anything stored into an existing object must be followed by
+ * gc_write_barrier(), and into a global cell by gc_cell_barrier().
+ * C locals that must survive an allocation are registered with
+ * gc_push_root(); the VM's registers and stack are roots as well.
+ * Permanent objects are never traced or freed, so they must not point
+ * at anything collectable.
+ */
+
+/* Values of struct Object::generation. */
+enum Generation {
+	GenYoung,
+	GenOld,
+	GenPermanent
+};
+
+enum GcPhase {
+	GcIdle,
+	GcMarking,
+	GcSweeping
+};
+
+struct Heap {
+	struct Object **young;
+	size_t youngCount;
+	size_t youngSize;
+	size_t oldCount;
+	size_t allocsSinceStep;
+	size_t nurserySize;
+	size_t majorThreshold;
+	enum GcPhase phase;
+	bool minor;
+	long pauseTargetNs;
+	size_t sweepClass;
+	size_t sweepPage;
+	size_t sweepSlot;
+
+	struct Object ***roots;
+	size_t rootCount;
+	size_t rootSize;
+
+	struct Object **remembered;
+	size_t rememberedCount;
+	size_t rememberedSize;
+
+	struct GlobalCell **rememberedCells;
+	size_t rememberedCellCount;
+	size_t rememberedCellSize;
+
+	struct Object **markStack;
+	size_t markCount;
+	size_t markSize;
+
+	size_t allocations;
+	size_t minorCollections;
+	size_t majorCollections;
+	long maxPauseNs;
+};
+
+struct Heap make_heap(void);
+void free_heap(struct Heap *h);
+struct Object *gc_alloc(struct Machine *m, size_t cls);
+struct Object *gc_alloc_permanent(struct Machine *m, size_t cls);
+void gc_collect(struct Machine *m);
+void gc_write_barrier(struct Machine *m, struct Object *obj);
+void gc_cell_barrier(struct Machine *m, struct GlobalCell *cell);
+void gc_push_root(struct Machine *m, struct Object **root);
+size_t gc_roots_save(struct Machine *m);
+void gc_roots_restore(struct Machine *m, size_t saved);
+void gc_set_pause_target(struct Machine *m, long usec);
+
+#endif
@@ -0,0 +1,616 @@
+#include "hamt.h"
+#include "builtins.h"
+#include "gc.h"
+#include "hashtab.h"
+#include "scheme.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Persistent maps keyed as by equal?, as hash array mapped tries.
+ * Each level of the trie uses the next HAMT_BITS bits of the key's
+ * hash to pick a branch, and a node only has slots for the branches
+ * that are there, found by counting the bits below in its bitmap.
+ * Changing a map copies just the nodes on the path to the key, and
+ * the new map shares the rest with the old one.  A transient map owns
+ * the nodes it copies and changes those in place, so building a map
+ * up through one allocates little more than the nodes it ends with.
+ */
+
+/* Hash bits at and past this shift are used up; see struct HamtNode. */
+#define HAMT_HASH_BITS 64
+
+/* The most slots a node with a bitmap can have. */
+#define HAMT_MAX_SLOTS (2 << HAMT_BITS)
+
+static uint32_t node_bit(uint64_t hash, unsigned shift)
+{
+	return (uint32_t)1 << ((hash >> shift) & ((1 << HAMT_BITS) - 1));
+}
+
+static size_t node_index(const struct HamtNode *n, uint32_t bit)
+{
+	/* Where bit's branch starts among the slots. */
+	return 2 * (size_t)__builtin_popcount(n->bitmap & (bit - 1));
+}
+
+static struct Object *node_edit(struct Machine *m, struct Object *node,
+				size_t count, uint64_t edit)
+{
+	/*
+	 * node itself if the transient edit owns it and it has room for
+	 * count slots, or else a copy with that room.  A transient's
+	 * copies get spare room so that it can go on adding in place.
+	 */
+	struct HamtNode *n = &node->hamtNode;
+	if (edit && n->edit == edit && n->capacity >= count)
+		return node;
+	size_t capacity = count;
+	if (edit && count < HAMT_MAX_SLOTS)
+		capacity = count * 2 < HAMT_MAX_SLOTS ? count * 2
+			: HAMT_MAX_SLOTS;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &node);
+	struct Object *copy = create_hamt_node_object(m, capacity, edit);
+	gc_roots_restore(m, roots);
+	if (!copy)
+		return 0;
+	n = &node->hamtNode;
+	copy->hamtNode.bitmap = n->bitmap;
+	copy->hamtNode.count = n->count;
+	memcpy(copy->hamtNode.slots, n->slots,
+		n->count * sizeof(struct Object *));
+	return copy;
+}
+
+static struct Object *node_insert(struct Machine *m, struct Object *node,
+				size_t i, struct Object *key,
+				struct Object *value, uint64_t edit)
+{
+	/* key and value are rooted by the caller. */
+	struct Object *res = node_edit(m, node, node->hamtNode.count + 2, edit);
+	if (!res)
+		return 0;
+	struct HamtNode *n = &res->hamtNode;
+	memmove(n->slots + i + 2, n->slots + i,
+		(n->count - i) * sizeof(struct Object *));
+	n->slots[i] = key;
+	n->slots[i + 1] = value;
+	n->count += 2;
+	return res;
+}
+
+static struct Object *node_pair(struct Machine *m, unsigned shift,
+				struct Object *key1, struct Object *value1,
+				uint64_t hash1, struct Object *key2,
+				struct Object *value2, uint64_t hash2,
+				uint64_t edit)
+{
+	/*
+	 * A trie of just two entries whose keys differ, from level shift
+	 * down.  The caller roots the keys and values.
+	 */
+	struct Object *node;
+	if (shift >= HAMT_HASH_BITS) {
+		node = create_hamt_node_object(m, 4, edit);
+		if (!node)
+			return 0;
+		struct Object *slots[] = {key1, value1, key2, value2};
+		memcpy(node->hamtNode.slots, slots, sizeof(slots));
+		node->hamtNode.count = 4;
+		return node;
+	}
+	uint32_t bit1 = node_bit(hash1, shift);
+	uint32_t bit2 = node_bit(hash2, shift);
+	if (bit1 == bit2) {
+		struct Object *child = node_pair(m, shift + HAMT_BITS,
+						key1, value1, hash1,
+						key2, value2, hash2, edit);
+		if (!child)
+			return 0;
+		size_t roots = gc_roots_save(m);
+		gc_push_root(m, &child);
+		node = create_hamt_node_object(m, 2, edit);
+		gc_roots_restore(m, roots);
+		if (!node)
+			return 0;
+		node->hamtNode.bitmap = bit1;
+		node->hamtNode.slots[0] = 0;
+		node->hamtNode.slots[1] = child;
+		node->hamtNode.count = 2;
+		return node;
+	}
+	node = create_hamt_node_object(m, 4, edit);
+	if (!node)
+		return 0;
+	struct Object **slots = node->hamtNode.slots;
+	size_t first = bit1 < bit2 ? 0 : 2;
+	slots[first] = key1;
+	slots[first + 1] = value1;
+	slots[2 - first] = key2;
+	slots[3 - first] = value2;
+	node->hamtNode.bitmap = bit1 | bit2;
+	node->hamtNode.count = 4;
+	return node;
+}
+
+static struct Object *node_set(struct Machine *m, struct Object *node,
+			unsigned shift, uint64_t hash, struct Object *key,
+			struct Object *value, uint64_t edit, bool *added)
+{
+	/*
+	 * The node to have in place of node, which may be null, once key
+	 * maps to value under it.  That is node itself if nothing
+	 * changed or it was changed in place.
+	 */
+	struct Object *child = 0;
+	struct Object *res = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &node);
+	gc_push_root(m, &key);
+	gc_push_root(m, &value);
+	gc_push_root(m, &child);
+	if (!node) {
+		res = create_hamt_node_object(m, 2, edit);
+		if (res) {
+			res->hamtNode.bitmap = node_bit(hash, shift);
+			res->hamtNode.slots[0] = key;
+			res->hamtNode.slots[1] = value;
+			res->hamtNode.count = 2;
+			*added = true;
+		}
+	} else if (shift >= HAMT_HASH_BITS) {
+		struct HamtNode *n = &node->hamtNode;
+		size_t i = 0;
+		while (i != n->count && !obj_equal(n->slots[i], key))
+			i += 2;
+		if (i == n->count) {
+			res = node_insert(m, node, i, key, value, edit);
+			*added = res != 0;
+		} else if (n->slots[i + 1] == value) {
+			res = node;
+		} else if ((res = node_edit(m, node, n->count, edit))) {
+			res->hamtNode.slots[i + 1] = value;
+		}
+	} else {
+		struct HamtNode *n = &node->hamtNode;
+		uint32_t bit = node_bit(hash, shift);
+		size_t i = node_index(n, bit);
+		if (!(n->bitmap & bit)) {
+			res = node_insert(m, node, i, key, value, edit);
+			if (res) {
+				res->hamtNode.bitmap |= bit;
+				*added = true;
+			}
+		} else if (!n->slots[i]) {
+			child = node_set(m, n->slots[i + 1], shift + HAMT_BITS,
+					hash, key, value, edit, added);
+			if (!child || child == n->slots[i + 1])
+				res = child ? node : 0;
+			else if ((res = node_edit(m, node, n->count, edit)))
+				res->hamtNode.slots[i + 1] = child;
+		} else if (obj_equal(n->slots[i], key)) {
+			if (n->slots[i + 1] == value)
+				res = node;
+			else if ((res = node_edit(m, node, n->count, edit)))
+				res->hamtNode.slots[i + 1] = value;
+		} else {
+			child = node_pair(m, shift + HAMT_BITS,
+					n->slots[i], n->slots[i + 1],
+					obj_hash(n->slots[i]),
+					key, value, hash, edit);
+			if (child)
+				res = node_edit(m, node, n->count, edit);
+			if (res) {
+				res->hamtNode.slots[i] = 0;
+				res->hamtNode.slots[i + 1] = child;
+				*added = true;
+			}
+		}
+	}
+	gc_roots_restore(m, roots);
+	if (res)
+		gc_write_barrier(m, res);
+	return res;
+}
+
+static bool node_remove(struct Machine *m, struct Object *node, size_t i,
+			uint32_t bit, uint64_t edit, struct Object **out)
+{
+	/* Drops the branch at slot i, whose bit is bit, or null if none. */
+	if (node->hamtNode.count == 2) {
+		*out = 0;
+		return true;
+	}
+	struct Object *res = node_edit(m, node, node->hamtNode.count, edit);
+	if (!res)
+		return false;
+	struct HamtNode *n = &res->hamtNode;
+	n->count -= 2;
+	memmove(n->slots + i, n->slots + i + 2,
+		(n->count - i) * sizeof(struct Object *));
+	n->bitmap &= ~bit;
+	*out = res;
+	return true;
+}
+
+static bool node_delete(struct Machine *m, struct Object *node,
+			unsigned shift, uint64_t hash, struct Object *key,
+			uint64_t edit, struct Object **out, bool *removed)
+{
+	/*
+	 * Sets *out to what to have in place of node once key is gone
+	 * from under it, which is null when nothing is left.  A child
+	 * left with a single entry is folded into its parent, so that
+	 * only the root can have a branch of one entry.
+	 */
+	struct HamtNode *n = &node->hamtNode;
+	*out = node;
+	if (shift >= HAMT_HASH_BITS) {
+		size_t i = 0;
+		while (i != n->count && !obj_equal(n->slots[i], key))
+			i += 2;
+		if (i == n->count)
+			return true;
+		*removed = true;
+		return node_remove(m, node, i, 0, edit, out);
+	}
+	uint32_t bit = node_bit(hash, shift);
+	if (!(n->bitmap & bit))
+		return true;
+	size_t i = node_index(n, bit);
+	if (n->slots[i]) {
+		if (!obj_equal(n->slots[i], key))
+			return true;
+		*removed = true;
+		return node_remove(m, node, i, bit, edit, out);
+	}
+	struct Object *child = n->slots[i + 1];
+	struct Object *sub;
+	if (!node_delete(m, child, shift + HAMT_BITS, hash, key, edit, &sub,
+			removed))
+		return false;
+	if (sub == child)
+		return true;
+	if (!sub)
+		return node_remove(m, node, i, bit, edit, out);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &sub);
+	struct Object *res = node_edit(m, node, n->count, edit);
+	gc_roots_restore(m, roots);
+	if (!res)
+		return false;
+	struct HamtNode *s = &sub->hamtNode;
+	if (s->count == 2 && s->slots[0]) {
+		res->hamtNode.slots[i] = s->slots[0];
+		res->hamtNode.slots[i + 1] = s->slots[1];
+	} else {
+		res->hamtNode.slots[i + 1] = sub;
+	}
+	gc_write_barrier(m, res);
+	*out = res;
+	return true;
+}
+
+static struct Object **node_find(struct Object *node, uint64_t hash,
+				struct Object *key)
+{
+	/* The slot of key's value, or null if key is not there. */
+	for (unsigned shift = 0; node; shift += HAMT_BITS) {
+		struct HamtNode *n = &node->hamtNode;
+		if (shift >= HAMT_HASH_BITS) {
+			for (size_t i = 0; i != n->count; i += 2) {
+				if (obj_equal(n->slots[i], key))
+					return &n->slots[i + 1];
+			}
+			return 0;
+		}
+		uint32_t bit = node_bit(hash, shift);
+		if (!(n->bitmap & bit))
+			return 0;
+		size_t i = node_index(n, bit);
+		if (n->slots[i])
+			return obj_equal(n->slots[i], key) ? &n->slots[i + 1]
+				: 0;
+		node = n->slots[i + 1];
+	}
+	return 0;
+}
+
+static bool map_set(struct Machine *m, struct Hamt *map, struct Object *key,
+		struct Object *value)
+{
+	/*
+	 * Points map at a root where key maps to value, changing nodes in
+	 * place only if map is a transient that owns them.
+	 */
+	bool added = false;
+	struct Object *root = node_set(m, map->root, 0, obj_hash(key), key,
+				value, map->edit, &added);
+	if (!root)
+		return false;
+	map->root = root;
+	map->count += added;
+	return true;
+}
+
+static bool map_delete(struct Machine *m, struct Hamt *map,
+		struct Object *key)
+{
+	struct Object *root;
+	bool removed = false;
+	if (!map->root)
+		return true;
+	if (!node_delete(m, map->root, 0, obj_hash(key), key, map->edit,
+			&root, &removed))
+		return false;
+	map->root = root;
+	map->count -= removed;
+	return true;
+}
+
+enum MapUse {
+	MapAny,
+	MapPersistent,
+	MapTransient
+};
+
+static struct Object *map_arg(struct Object *args, const char *name,
+			enum MapUse use, bool key)
+{
+	/* The map at the head of args, and if key, checks a key follows. */
+	struct Object *map = obj_is_nil(args) ? 0 : car(args);
+	if (!map || obj_type(map) != TypeHamt) {
+		fprintf(stderr, "%s wants a map.\n", name);
+		return 0;
+	}
+	if (use == MapPersistent && map->hamt.edit) {
+		fprintf(stderr, "%s wants a persistent map.\n", name);
+		return 0;
+	}
+	if (use == MapTransient && !map->hamt.edit) {
+		fprintf(stderr, "%s wants a transient map.\n", name);
+		return 0;
+	}
+	if (key && obj_is_nil(cdr(args))) {
+		fprintf(stderr, "%s wants a key.\n", name);
+		return 0;
+	}
+	return map;
+}
+
+static struct Object *map_build(struct Machine *m, struct Object *list,
+				bool alist)
+{
+	/*
+	 * A map of the keys and values in list, built through a
+	 * transient: k v k v ..., or (k . v) pairs if alist.  A later
+	 * key wins over an earlier equal one.
+	 */
+	struct Hamt map = {.root = 0, .count = 0, .edit = ++m->lastEdit};
+	struct Object *res = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &list);
+	gc_push_root(m, &map.root);
+	for (struct Object *it = list; !obj_is_nil(it);) {
+		struct Object *key = alist ? it->pair.car->pair.car
+			: it->pair.car;
+		struct Object *value = alist ? it->pair.car->pair.cdr
+			: it->pair.cdr->pair.car;
+		if (!map_set(m, &map, key, value))
+			goto out;
+		it = alist ? it->pair.cdr : it->pair.cdr->pair.cdr;
+	}
+	res = create_hamt_object(m, map.root, map.count, 0);
+out:
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *hamt(struct Machine *m, struct Object *args)
+{
+	/* (hamt key value ...) */
+	size_t count = 0;
+	for (struct Object *it = args; !obj_is_nil(it); it = it->pair.cdr)
+		++count;
+	if (count % 2) {
+		fprintf(stderr, "hamt wants keys and values in pairs.\n");
+		return create_error_object(m);
+	}
+	return map_build(m, args, false);
+}
+
+struct Object *hamt_p(struct Machine *m, struct Object *args)
+{
+	return truth(m, !obj_is_nil(args) && car(args)
+			&& obj_type(car(args)) == TypeHamt);
+}
+
+struct Object *hamt_ref(struct Machine *m, struct Object *args)
+{
+	/* (hamt-ref map key [default]); a missing key needs default. */
+	struct Object *map = map_arg(args, "hamt-ref", MapAny, true);
+	if (!map)
+		return create_error_object(m);
+	struct Object *key = cadr(args);
+	struct Object **value = node_find(map->hamt.root, obj_hash(key), key);
+	if (value)
+		return *value;
+	struct Object *rest = cdr(cdr(args));
+	if (!obj_is_nil(rest))
+		return car(rest);
+	fprintf(stderr, "hamt-ref found no such key.\n");
+	return create_error_object(m);
+}
+
+struct Object *hamt_contains_p(struct Machine *m, struct Object *args)
+{
+	struct Object *map = map_arg(args, "hamt-contains?", MapAny, true);
+	if (!map)
+		return create_error_object(m);
+	struct Object *key = cadr(args);
+	return truth(m, node_find(map->hamt.root, obj_hash(key), key));
+}
+
+struct Object *hamt_set(struct Machine *m, struct Object *args)
+{
+	/* (hamt-set map key value) is a new map; map stays as it was. */
+	struct Object *map = map_arg(args, "hamt-set", MapPersistent, true);
+	if (!map)
+		return create_error_object(m);
+	if (obj_is_nil(cdr(cdr(args)))) {
+		fprintf(stderr, "hamt-set wants a value.\n");
+		return create_error_object(m);
+	}
+	struct Hamt res = map->hamt;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &map);
+	gc_push_root(m, &args);
+	gc_push_root(m, &res.root);
+	struct Object *obj = 0;
+	if (map_set(m, &res, cadr(args), car(cdr(cdr(args)))))
+		obj = res.root == map->hamt.root ? map
+			: create_hamt_object(m, res.root, res.count, 0);
+	gc_roots_restore(m, roots);
+	return obj;
+}
+
+struct Object *hamt_delete(struct Machine *m, struct Object *args)
+{
+	/* (hamt-delete map key) is a new map without key. */
+	struct Object *map = map_arg(args, "hamt-delete", MapPersistent, true);
+	if (!map)
+		return create_error_object(m);
+	struct Hamt res = map->hamt;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &map);
+	gc_push_root(m, &res.root);
+	struct Object *obj = 0;
+	if (map_delete(m, &res, cadr(args)))
+		obj = res.root == map->hamt.root ? map
+			: create_hamt_object(m, res.root, res.count, 0);
+	gc_roots_restore(m, roots);
+	return obj;
+}
+
+struct Object *hamt_count(struct Machine *m, struct Object *args)
+{
+	struct Object *map = map_arg(args, "hamt-count", MapAny, false);
+	if (!map)
+		return create_error_object(m);
+	return create_integer_object(m, map->hamt.count);
+}
+
+static struct Object *node_to_alist(struct Machine *m, struct Object *node,
+				struct Object *res)
+{
+	/* Conses node's entries onto res, which the caller roots. */
+	struct Object *item = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &res);
+	gc_push_root(m, &item);
+	struct HamtNode *n = &node->hamtNode;
+	for (size_t i = n->count; res && i; i -= 2) {
+		if (n->slots[i - 2]) {
+			item = create_pair_object(m, n->slots[i - 2],
+						n->slots[i - 1]);
+			res = item ? create_pair_object(m, item, res) : 0;
+		} else {
+			res = node_to_alist(m, n->slots[i - 1], res);
+		}
+	}
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *hamt_to_alist(struct Machine *m, struct Object *args)
+{
+	/* The (key . value) pairs, in the trie's order. */
+	struct Object *map = map_arg(args, "hamt->alist", MapAny, false);
+	if (!map)
+		return create_error_object(m);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &map);
+	struct Object *res = create_pair_object(m, 0, 0);
+	if (res && map->hamt.root)
+		res = node_to_alist(m, map->hamt.root, res);
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *alist_to_hamt(struct Machine *m, struct Object *args)
+{
+	struct Object *list = obj_is_nil(args) ? 0 : car(args);
+	struct Object *it = list;
+	while (it && obj_type(it) == TypePair && !obj_is_nil(it)
+	       && it->pair.car && obj_type(it->pair.car) == TypePair
+	       && !obj_is_nil(it->pair.car))
+		it = it->pair.cdr;
+	if (!it || obj_type(it) != TypePair || !obj_is_nil(it)) {
+		fprintf(stderr, "alist->hamt wants a list of pairs.\n");
+		return create_error_object(m);
+	}
+	return map_build(m, list, true);
+}
+
+struct Object *hamt_transient(struct Machine *m, struct Object *args)
+{
+	/*
+	 * (hamt-transient map) is a map to change in place with
+	 * hamt-set! and hamt-delete! until hamt-persistent! turns it back
+	 * into a persistent one.  map itself is left alone.
+	 */
+	struct Object *map = map_arg(args, "hamt-transient", MapPersistent,
+				false);
+	if (!map)
+		return create_error_object(m);
+	return create_hamt_object(m, map->hamt.root, map->hamt.count,
+				++m->lastEdit);
+}
+
+struct Object *transient_set(struct Machine *m, struct Object *args)
+{
+	/* (hamt-set! transient key value) */
+	struct Object *map = map_arg(args, "hamt-set!", MapTransient, true);
+	if (!map)
+		return create_error_object(m);
+	if (obj_is_nil(cdr(cdr(args)))) {
+		fprintf(stderr, "hamt-set! wants a value.\n");
+		return create_error_object(m);
+	}
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &map);
+	bool ok = map_set(m, &map->hamt, cadr(args), car(cdr(cdr(args))));
+	gc_write_barrier(m, map);
+	gc_roots_restore(m, roots);
+	return ok ? create_pair_object(m, 0, 0) : 0;
+}
+
+struct Object *transient_delete(struct Machine *m, struct Object *args)
+{
+	/* (hamt-delete! transient key) */
+	struct Object *map = map_arg(args, "hamt-delete!", MapTransient, true);
+	if (!map)
+		return create_error_object(m);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &map);
+	bool ok = map_delete(m, &map->hamt, cadr(args));
+	gc_write_barrier(m, map);
+	gc_roots_restore(m, roots);
+	return ok ? create_pair_object(m, 0, 0) : 0;
+}
+
+struct Object *hamt_persistent(struct Machine *m, struct Object *args)
+{
+	/*
+	 * (hamt-persistent! transient) makes the map persistent for good
+	 * and returns it.  No map has its edit any more, so the nodes it
+	 * owned can never change again.
+	 */
+	struct Object *map = map_arg(args, "hamt-persistent!", MapTransient,
+				false);
+	if (!map)
+		return create_error_object(m);
+	map->hamt.edit = 0;
+	return map;
+}
@@ -0,0 +1,51 @@
+#ifndef HAMT_H
+#define HAMT_H
+
+#include "scheme_forward.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* Hash bits used at each level of the trie. */
+#define HAMT_BITS 5
+
+/*
+ * A trie node.  Each bit set in bitmap is a branch, in bit order, with
+ * two slots: a key and its value, or a null key and a child node.  A
+ * node below the last level of hash bits has no bitmap and holds every
+ * entry whose hash collides, unordered.  Nodes are shared between maps
+ * and never change, except those owned by the transient map whose edit
+ * they carry, which that map may change in place while it has room.
+ */
+struct HamtNode {
+	uint32_t bitmap;
+	uint32_t count;
+	uint32_t capacity;
+	uint64_t edit;
+	struct Object **slots;
+};
+
+/*
+ * A map is its root node, or null when empty.  A transient map has a
+ * nonzero edit, which nothing else has ever had.
+ */
+struct Hamt {
+	struct Object *root;
+	size_t count;
+	uint64_t edit;
+};
+
+struct Object *hamt(struct Machine *m, struct Object *args);
+struct Object *hamt_p(struct Machine *m, struct Object *args);
+struct Object *hamt_ref(struct Machine *m, struct Object *args);
+struct Object *hamt_contains_p(struct Machine *m, struct Object *args);
+struct Object *hamt_set(struct Machine *m, struct Object *args);
+struct Object *hamt_delete(struct Machine *m, struct Object *args);
+struct Object *hamt_count(struct Machine *m, struct Object *args);
+struct Object *hamt_to_alist(struct Machine *m, struct Object *args);
+struct Object *alist_to_hamt(struct Machine *m, struct Object *args);
+struct Object *hamt_transient(struct Machine *m, struct Object *args);
+struct Object *transient_set(struct Machine *m, struct Object *args);
+struct Object *transient_delete(struct Machine *m, struct Object *args);
+struct Object *hamt_persistent(struct Machine *m, struct Object *args);
+
+#endif
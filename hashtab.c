@@ -0,0 +1,579 @@
+#include "hashtab.h"
+#include "bignum.h"
+#include "builtins.h"
+#include "compile.h"
+#include "gc.h"
+#include "scheme.h"
+#include "vm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* How much of a list or vector hash_equal() looks at, and how deep. */
+#define HASH_EQUAL_ITEMS 16
+#define HASH_EQUAL_DEPTH 4
+
+static uint64_t mix64(uint64_t x)
+{
+	/* MurmurHash3's finalizer: every input bit affects every output bit. */
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ULL;
+	x ^= x >> 33;
+	return x;
+}
+
+static uint64_t hash_bytes(const char *s, size_t n)
+{
+	/* Eight bytes at a time. */
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ n;
+	size_t i = 0;
+	for (; i + 8 <= n; i += 8) {
+		uint64_t k;
+		memcpy(&k, s + i, 8);
+		h = (h ^ mix64(k)) * 0x9e3779b97f4a7c15ULL;
+	}
+	uint64_t k = 0;
+	memcpy(&k, s + i, n - i);
+	return mix64(h ^ k);
+}
+
+static uint64_t hash_eq(struct Object *obj)
+{
+	/* Symbols by their interned id, everything else by address. */
+	if (obj && obj_type(obj) == TypeSymbol)
+		return mix64(obj->symbol);
+	return mix64((uintptr_t)obj);
+}
+
+static uint64_t hash_eqv(struct Object *obj)
+{
+	/* Numbers by value; eqv? treats equal numbers as the same. */
+	uint64_t bits;
+	if (!obj)
+		return 0;
+	switch (obj_type(obj)) {
+	case TypeInteger:
+		return mix64(obj_integer(obj));
+	case TypeDouble:
+		memcpy(&bits, &obj->dbl, sizeof(bits));
+		return mix64(bits ^ 0xd0d0d0d0d0d0d0d0ULL);
+	case TypeBignum:
+		return hash_bytes((const char *)obj->bignum.digits,
+				obj->bignum.count * sizeof(uint32_t))
+			^ obj->bignum.negative;
+	default:
+		return hash_eq(obj);
+	}
+}
+
+static uint64_t hash_equal(struct Object *obj, int depth)
+{
+	/*
+	 * Structure by content.  Only the first few items of a list or
+	 * vector count, and only to a small depth, which bounds the time
+	 * spent; equal keys still hash the same.
+	 */
+	uint64_t h = 0;
+	if (!obj)
+		return 0;
+	switch (obj_type(obj)) {
+	case TypeString:
+		return hash_bytes(string_slice_chars(obj->string),
+				obj->string.length);
+	case TypePair:
+		if (depth == HASH_EQUAL_DEPTH)
+			return 1;
+		for (size_t i = 0; i != HASH_EQUAL_ITEMS && obj
+		     && obj_type(obj) == TypePair && !obj_is_nil(obj); ++i) {
+			h = mix64(h ^ hash_equal(obj->pair.car, depth + 1));
+			obj = obj->pair.cdr;
+		}
+		return h;
+	case TypeVector:
+		if (depth == HASH_EQUAL_DEPTH)
+			return 2;
+		h = obj->vector.count;
+		for (size_t i = 0; i != obj->vector.count
+		     && i != HASH_EQUAL_ITEMS; ++i) {
+			uint64_t item = hash_equal(obj->vector.items[i],
+						depth + 1);
+			h = mix64(h ^ item);
+		}
+		return h;
+	case TypeF64Vector:
+	case TypeS64Vector:
+		return hash_bytes((const char *)obj->numvec.f64,
+				obj->numvec.count * sizeof(double));
+	default:
+		return hash_eqv(obj);
+	}
+}
+
+bool obj_eqv(struct Object *a, struct Object *b)
+{
+	if (a == b)
+		return true;
+	if (!a || !b || obj_type(a) != obj_type(b))
+		return false;
+	switch (obj_type(a)) {
+	case TypeInteger:
+		return obj_integer(a) == obj_integer(b);
+	case TypeDouble:
+		/* Bit for bit, so 0.0 and -0.0 differ and a NaN is itself. */
+		return !memcmp(&a->dbl, &b->dbl, sizeof(double));
+	case TypeBignum:
+		return !integer_compare(a, b);
+	default:
+		return false;
+	}
+}
+
+bool obj_equal(struct Object *a, struct Object *b)
+{
+	/* Iterative along a list's cdrs, recursive only into its cars. */
+	while (true) {
+		if (obj_eqv(a, b))
+			return true;
+		if (!a || !b || obj_type(a) != obj_type(b))
+			return false;
+		switch (obj_type(a)) {
+		case TypeString:
+			return a->string.length == b->string.length
+				&& !memcmp(string_slice_chars(a->string),
+					string_slice_chars(b->string),
+					a->string.length);
+		case TypePair:
+			if (obj_is_nil(a) || obj_is_nil(b))
+				return obj_is_nil(a) && obj_is_nil(b);
+			if (!obj_equal(a->pair.car, b->pair.car))
+				return false;
+			a = a->pair.cdr;
+			b = b->pair.cdr;
+			continue;
+		case TypeVector:
+			if (a->vector.count != b->vector.count)
+				return false;
+			for (size_t i = 0; i != a->vector.count; ++i) {
+				if (!obj_equal(a->vector.items[i],
+						b->vector.items[i]))
+					return false;
+			}
+			return true;
+		case TypeF64Vector:
+		case TypeS64Vector:
+			return a->numvec.count == b->numvec.count
+				&& !memcmp(a->numvec.f64, b->numvec.f64,
+					a->numvec.count * sizeof(double));
+		default:
+			return false;
+		}
+	}
+}
+
+uint64_t obj_hash(struct Object *obj)
+{
+	/* The same for any two objects that obj_equal() finds equal. */
+	return hash_equal(obj, 0);
+}
+
+static uint64_t hashtab_hash(const struct HashTable *t, struct Object *key)
+{
+	switch (t->kind) {
+	case HashEq:
+		return hash_eq(key);
+	case HashEqv:
+		return hash_eqv(key);
+	default:
+		return hash_equal(key, 0);
+	}
+}
+
+static bool hashtab_same(const struct HashTable *t, struct Object *a,
+			struct Object *b)
+{
+	switch (t->kind) {
+	case HashEq:
+		return a == b;
+	case HashEqv:
+		return obj_eqv(a, b);
+	default:
+		return obj_equal(a, b);
+	}
+}
+
+bool hashtab_init(struct HashTable *t, enum HashKind kind)
+{
+	t->entries = 0;
+	t->count = 0;
+	t->size = 0;
+	t->kind = kind;
+	return true;
+}
+
+void hashtab_free(struct HashTable *t)
+{
+	free(t->entries);
+	hashtab_init(t, t->kind);
+}
+
+static size_t hashtab_slot(const struct HashTable *t, struct Object *key,
+			uint64_t hash)
+{
+	/* key's slot if it is there, or else the empty slot it would take. */
+	size_t mask = t->size - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		struct HashEntry *e = &t->entries[i];
+		if (!e->key
+		    || (e->hash == hash && hashtab_same(t, e->key, key)))
+			return i;
+	}
+}
+
+static bool hashtab_grow(struct HashTable *t)
+{
+	size_t nsize = t->size ? t->size * 2 : 8;
+	struct HashEntry *nentries = calloc(nsize, sizeof(*nentries));
+	if (!nentries)
+		return false;
+	size_t mask = nsize - 1;
+	for (size_t i = 0; i != t->size; ++i) {
+		struct HashEntry *e = &t->entries[i];
+		if (!e->key)
+			continue;
+		size_t j = e->hash & mask;
+		while (nentries[j].key)
+			j = (j + 1) & mask;
+		nentries[j] = *e;
+	}
+	free(t->entries);
+	t->entries = nentries;
+	t->size = nsize;
+	return true;
+}
+
+struct HashEntry *hashtab_find(struct HashTable *t, struct Object *key)
+{
+	if (!t->count)
+		return 0;
+	struct HashEntry *e = &t->entries[hashtab_slot(t, key,
+						hashtab_hash(t, key))];
+	return e->key ? e : 0;
+}
+
+bool hashtab_set(struct HashTable *t, struct Object *key,
+		struct Object *value)
+{
+	if ((t->count + 1) * 4 > t->size * 3 && !hashtab_grow(t))
+		return false;
+	uint64_t hash = hashtab_hash(t, key);
+	struct HashEntry *e = &t->entries[hashtab_slot(t, key, hash)];
+	if (!e->key) {
+		e->key = key;
+		e->hash = hash;
+		++t->count;
+	}
+	e->value = value;
+	return true;
+}
+
+bool hashtab_delete(struct HashTable *t, struct Object *key)
+{
+	/*
+	 * Entries later in the run move back into the hole when that is
+	 * no further from their home slot than where they are.
+	 */
+	if (!t->count)
+		return false;
+	size_t mask = t->size - 1;
+	size_t i = hashtab_slot(t, key, hashtab_hash(t, key));
+	if (!t->entries[i].key)
+		return false;
+	for (size_t j = (i + 1) & mask; t->entries[j].key; j = (j + 1) & mask) {
+		size_t home = t->entries[j].hash & mask;
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			t->entries[i] = t->entries[j];
+			i = j;
+		}
+	}
+	t->entries[i].key = 0;
+	t->entries[i].value = 0;
+	--t->count;
+	return true;
+}
+
+static struct Object *pair_p(struct Machine *m, struct Object *args,
+			bool (*same)(struct Object *, struct Object *),
+			const char *name)
+{
+	if (obj_is_nil(args) || obj_is_nil(cdr(args))) {
+		fprintf(stderr, "%s wants two arguments.\n", name);
+		return create_error_object(m);
+	}
+	struct Object *a = car(args);
+	struct Object *b = cadr(args);
+	return truth(m, same ? same(a, b) : a == b);
+}
+
+struct Object *eq_p(struct Machine *m, struct Object *args)
+{
+	return pair_p(m, args, 0, "eq?");
+}
+
+struct Object *eqv_p(struct Machine *m, struct Object *args)
+{
+	return pair_p(m, args, obj_eqv, "eqv?");
+}
+
+struct Object *equal_p(struct Machine *m, struct Object *args)
+{
+	return pair_p(m, args, obj_equal, "equal?");
+}
+
+struct Object *make_hash_table(struct Machine *m, struct Object *args)
+{
+	/* (make-hash-table [kind]), kind being eq, eqv, equal or string. */
+	static const char *const kinds[] = {"eq", "eqv", "equal", "string"};
+	enum HashKind kind = HashEqual;
+	if (!obj_is_nil(args)) {
+		struct Object *arg0 = car(args);
+		const char *name = arg0 && obj_type(arg0) == TypeSymbol
+			? symbol_name(&m->symbols, arg0->symbol) : "";
+		size_t k = 0;
+		while (k != 4 && strcmp(name, kinds[k]))
+			++k;
+		if (k == 4) {
+			fprintf(stderr, "make-hash-table wants eq, eqv, equal"
+				" or string.\n");
+			return create_error_object(m);
+		}
+		kind = k;
+	}
+	return create_hash_table_object(m, kind);
+}
+
+struct Object *hash_table_p(struct Machine *m, struct Object *args)
+{
+	return truth(m, !obj_is_nil(args) && car(args)
+			&& obj_type(car(args)) == TypeHashTable);
+}
+
+static struct Object *table_arg(struct Object *args, const char *name,
+				bool key)
+{
+	/* The table at the head of args, and if key, a usable key next. */
+	struct Object *t = obj_is_nil(args) ? 0 : car(args);
+	if (!t || obj_type(t) != TypeHashTable) {
+		fprintf(stderr, "%s wants a hash table.\n", name);
+		return 0;
+	}
+	if (!key)
+		return t;
+	struct Object *k = obj_is_nil(cdr(args)) ? 0 : cadr(args);
+	if (!k || (t->hashTable.kind == HashString
+		   && obj_type(k) != TypeString)) {
+		fprintf(stderr, "%s wants a %skey.\n", name,
+			t->hashTable.kind == HashString ? "string " : "");
+		return 0;
+	}
+	return t;
+}
+
+struct Object *hash_table_ref(struct Machine *m, struct Object *args)
+{
+	/*
+	 * (hash-table-ref t key [thunk]); a missing key calls thunk, as
+	 * in SRFI 69, and is an error without one.
+	 */
+	struct Object *t = table_arg(args, "hash-table-ref", true);
+	if (!t)
+		return create_error_object(m);
+	struct HashEntry *e = hashtab_find(&t->hashTable, cadr(args));
+	if (e)
+		return e->value;
+	struct Object *rest = cdr(cdr(args));
+	if (obj_is_nil(rest)) {
+		fprintf(stderr, "hash-table-ref found no such key.\n");
+		return create_error_object(m);
+	}
+	/* args is rooted by whoever called, and rest with it. */
+	struct Object *applier = vm_applier(m, 0);
+	if (!applier)
+		return 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &applier);
+	struct Object *res = vm_apply(m, applier, car(rest), 0);
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *hash_table_ref_default(struct Machine *m, struct Object *args)
+{
+	/* (hash-table-ref/default t key default) */
+	struct Object *t = table_arg(args, "hash-table-ref/default", true);
+	if (!t)
+		return create_error_object(m);
+	struct Object *rest = cdr(cdr(args));
+	if (obj_is_nil(rest)) {
+		fprintf(stderr, "hash-table-ref/default wants a default.\n");
+		return create_error_object(m);
+	}
+	struct HashEntry *e = hashtab_find(&t->hashTable, cadr(args));
+	return e ? e->value : car(rest);
+}
+
+struct Object *hash_table_contains_p(struct Machine *m, struct Object *args)
+{
+	struct Object *t = table_arg(args, "hash-table-contains?", true);
+	if (!t)
+		return create_error_object(m);
+	return truth(m, hashtab_find(&t->hashTable, cadr(args)));
+}
+
+struct Object *hash_table_set(struct Machine *m, struct Object *args)
+{
+	struct Object *t = table_arg(args, "hash-table-set!", true);
+	if (!t)
+		return create_error_object(m);
+	struct Object *rest = cdr(cdr(args));
+	if (obj_is_nil(rest)) {
+		fprintf(stderr, "hash-table-set! wants a value.\n");
+		return create_error_object(m);
+	}
+	if (!hashtab_set(&t->hashTable, cadr(args), car(rest)))
+		return 0;
+	gc_write_barrier(m, t);
+	return create_pair_object(m, 0, 0);
+}
+
+struct Object *hash_table_delete(struct Machine *m, struct Object *args)
+{
+	struct Object *t = table_arg(args, "hash-table-delete!", true);
+	if (!t)
+		return create_error_object(m);
+	hashtab_delete(&t->hashTable, cadr(args));
+	return create_pair_object(m, 0, 0);
+}
+
+struct Object *hash_table_count(struct Machine *m, struct Object *args)
+{
+	struct Object *t = table_arg(args, "hash-table-count", false);
+	if (!t)
+		return create_error_object(m);
+	return create_integer_object(m, t->hashTable.count);
+}
+
+enum TableItems {
+	ItemKeys,
+	ItemValues,
+	ItemPairs
+};
+
+static struct Object *table_list(struct Machine *m, struct Object *args,
+				const char *name, enum TableItems what)
+{
+	/*
+	 * The keys, values or (key . value) pairs, in slot order.  The
+	 * table can't change while the list is built, since only Scheme
+	 * code changes it.
+	 */
+	struct Object *t = table_arg(args, name, false);
+	if (!t)
+		return create_error_object(m);
+	struct Object *res = create_pair_object(m, 0, 0);
+	struct Object *item = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &t);
+	gc_push_root(m, &res);
+	gc_push_root(m, &item);
+	struct HashTable *h = &t->hashTable;
+	for (size_t i = h->size; res && i; --i) {
+		struct HashEntry *e = &h->entries[i - 1];
+		if (!e->key)
+			continue;
+		if (what == ItemPairs)
+			item = create_pair_object(m, e->key, e->value);
+		else
+			item = what == ItemKeys ? e->key : e->value;
+		res = item ? create_pair_object(m, item, res) : 0;
+	}
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *hash_table_keys(struct Machine *m, struct Object *args)
+{
+	return table_list(m, args, "hash-table-keys", ItemKeys);
+}
+
+struct Object *hash_table_values(struct Machine *m, struct Object *args)
+{
+	return table_list(m, args, "hash-table-values", ItemValues);
+}
+
+struct Object *hash_table_to_alist(struct Machine *m, struct Object *args)
+{
+	return table_list(m, args, "hash-table->alist", ItemPairs);
+}
+
+static struct Object *table_each(struct Machine *m, struct Object *args,
+				const char *name, bool fold)
+{
+	/*
+	 * Call proc on each entry's key and value, in slot order, and
+	 * when folding on the value so far as well, which proc's result
+	 * replaces.  Nothing is listed up front.  proc may change the
+	 * table, so each entry is fetched by its slot afresh; the walk
+	 * never reads freed entries, but may then see one twice or miss
+	 * one.  An error from proc ends the walk and is its value.
+	 */
+	struct Object *t = table_arg(args, name, false);
+	if (!t)
+		return create_error_object(m);
+	if (form_arity(args) != (fold ? 3 : 2)) {
+		fprintf(stderr, "%s wants a hash table and a procedure%s.\n",
+			name, fold ? " and an initial value" : "");
+		return create_error_object(m);
+	}
+	struct Object *proc = cadr(args);
+	struct Object *items[3] = {0, 0, fold ? car(cdr(cdr(args))) : 0};
+	struct Object *applier = 0;
+	struct Object *res = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &t);
+	gc_push_root(m, &proc);
+	for (int i = 0; i != 3; ++i)
+		gc_push_root(m, &items[i]);
+	gc_push_root(m, &applier);
+	applier = vm_applier(m, fold ? 3 : 2);
+	for (size_t i = 0; applier && i < t->hashTable.size; ++i) {
+		struct HashEntry *e = &t->hashTable.entries[i];
+		if (!e->key)
+			continue;
+		items[0] = e->key;
+		items[1] = e->value;
+		res = vm_apply(m, applier, proc, items);
+		if (!res || obj_type(res) == TypeError)
+			break;
+		items[2] = res;
+	}
+	if (applier && res && obj_type(res) != TypeError)
+		res = fold ? items[2] : create_pair_object(m, 0, 0);
+	else if (!applier)
+		res = 0;
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *hash_table_walk(struct Machine *m, struct Object *args)
+{
+	/* (hash-table-walk t proc) calls (proc key value) for each entry. */
+	return table_each(m, args, "hash-table-walk", false);
+}
+
+struct Object *hash_table_fold(struct Machine *m, struct Object *args)
+{
+	/* (hash-table-fold t proc init) is init after (proc key value init). */
+	return table_each(m, args, "hash-table-fold", true);
+}
@@ -0,0 +1,67 @@
+#ifndef HASHTAB_H
+#define HASHTAB_H
+
+#include "scheme_forward.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* How a table compares keys, after eq?, eqv? and equal?. */
+enum HashKind {
+	HashEq,
+	HashEqv,
+	HashEqual,
+	HashString
+};
+
+/*
+ * Keys and values are stored inline, with each key's hash so that
+ * growing never rehashes.  A null key marks an empty slot.
+ */
+struct HashEntry {
+	struct Object *key;
+	struct Object *value;
+	uint64_t hash;
+};
+
+/*
+ * Open addressing with linear probing over a power-of-two number of
+ * slots, kept at most three quarters full.  Deletion shifts the rest
+ * of a run back instead of leaving tombstones, so a lookup stops at
+ * the first empty slot.
+ */
+struct HashTable {
+	struct HashEntry *entries;
+	size_t count;
+	size_t size;
+	enum HashKind kind;
+};
+
+bool obj_eqv(struct Object *a, struct Object *b);
+bool obj_equal(struct Object *a, struct Object *b);
+uint64_t obj_hash(struct Object *obj);
+bool hashtab_init(struct HashTable *t, enum HashKind kind);
+void hashtab_free(struct HashTable *t);
+struct HashEntry *hashtab_find(struct HashTable *t, struct Object *key);
+bool hashtab_set(struct HashTable *t, struct Object *key,
+		struct Object *value);
+bool hashtab_delete(struct HashTable *t, struct Object *key);
+
+struct Object *eq_p(struct Machine *m, struct Object *args);
+struct Object *eqv_p(struct Machine *m, struct Object *args);
+struct Object *equal_p(struct Machine *m, struct Object *args);
+struct Object *make_hash_table(struct Machine *m, struct Object *args);
+struct Object *hash_table_p(struct Machine *m, struct Object *args);
+struct Object *hash_table_ref(struct Machine *m, struct Object *args);
+struct Object *hash_table_ref_default(struct Machine *m, struct Object *args);
+struct Object *hash_table_contains_p(struct Machine *m, struct Object *args);
+struct Object *hash_table_set(struct Machine *m, struct Object *args);
+struct Object *hash_table_delete(struct Machine *m, struct Object *args);
+struct Object *hash_table_count(struct Machine *m, struct Object *args);
+struct Object *hash_table_keys(struct Machine *m, struct Object *args);
+struct Object *hash_table_values(struct Machine *m, struct Object *args);
+struct Object *hash_table_to_alist(struct Machine *m, struct Object *args);
+struct Object *hash_table_walk(struct Machine *m, struct Object *args);
+struct Object *hash_table_fold(struct Machine *m, struct Object *args);
+
+#endif
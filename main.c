@@ -1,26 +1,62 @@
 #include "eval.h"
-#include "print.h"
+#include "profile.h"
 #include "read.h"
 #include "scheme.h"
+#include "stats.h"
+#include <stdlib.h>
+#include <unistd.h>
+
+static int finish(struct Machine *machine, const char *profile, int status)
+{
+	/*
+	 * Write the profile if there is one.  With SCHEME_STATS set, the
+	 * runtime counters go to stderr.
+	 */
+	if (profile && profile_stop(machine, profile) == -1)
+		status = 1;
+	const char *stats = getenv("SCHEME_STATS");
+	if (stats && *stats)
+		stats_dump(machine, stderr);
+	return status;
+}
 
 int main(int argc, char *argv[])
 {
+	/* -p path profiles everything run and writes it to path. */
+	const char *profile = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "p:")) != -1) {
+		if (opt != 'p') {
+			fprintf(stderr, "Usage: %s [-p profile] [script ...]\n",
+				argv[0]);
+			return 2;
+		}
+		profile = optarg;
+	}
 	struct Machine *machine = create_machine();
+	if (!machine) {
+		fprintf(stderr, "Failed to create a machine.\n");
+		return 1;
+	}
+	if (profile && !profile_start(machine, PROFILE_HZ))
+		return 1;
+
+	/* With script paths, run them in order instead of a REPL. */
+	if (optind != argc) {
+		for (int i = optind; i != argc; ++i) {
+			if (!eval_file(machine, argv[i]))
+				return finish(machine, profile, 1);
+		}
+		return finish(machine, profile, 0);
+	}
+
 	//struct FileGetCharContext getcContext = {.stream = stdin};
 	struct ReadlineGetCharContext readlineContext;
 	readline_init(&readlineContext, "> ");
-
-	while (1) {
-		/* struct StringArray words = read_expression(file_getc, */
-		/* 					file_ungetc, */
-		/* 					&getcContext); */
-		struct StringArray words = read_expression(readline_getc,
-							readline_ungetc,
-							&readlineContext);
-		struct Object *obj = read_scheme(machine, &words);
-		struct Object *nobj = eval(machine, obj);
-		obj_print(machine, nobj);
-		printf("\n\n");
-	}
-	return 0;
+	struct Reader reader;
+	/* reader_init(&reader, file_getc, file_ungetc, &getcContext); */
+	reader_init(&reader, readline_getc, readline_ungetc, &readlineContext);
+	eval_print(machine, &reader, true);
+	reader_free(&reader);
+	return finish(machine, profile, 0);
 }
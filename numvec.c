@@ -0,0 +1,1082 @@
+#include "numvec.h"
+#include "bignum.h"
+#include "builtins.h"
+#include "gc.h"
+#include "scheme.h"
+#include <math.h>
+#include <stdio.h>
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * The portable kernels.  Their loops have the same shape as the vector
+ * ones, lane for lane, and the vector kernels finish their tails and
+ * combine their lanes with the same helpers, which is what keeps float
+ * results identical at every SimdLevel.
+ */
+
+static double f64_lanes_sum(double *acc)
+{
+	for (size_t w = NUMVEC_LANES / 2; w; w /= 2) {
+		for (size_t j = 0; j != w; ++j)
+			acc[j] += acc[j + w];
+	}
+	return acc[0];
+}
+
+static double f64_min2(double a, double b)
+{
+	/* As MINPD does it: b unless a is smaller, so NaNs in a are skipped. */
+	return a < b ? a : b;
+}
+
+static double f64_max2(double a, double b)
+{
+	return a > b ? a : b;
+}
+
+static double f64_lanes_min(double *acc)
+{
+	for (size_t w = NUMVEC_LANES / 2; w; w /= 2) {
+		for (size_t j = 0; j != w; ++j)
+			acc[j] = f64_min2(acc[j + w], acc[j]);
+	}
+	return acc[0];
+}
+
+static double f64_lanes_max(double *acc)
+{
+	for (size_t w = NUMVEC_LANES / 2; w; w /= 2) {
+		for (size_t j = 0; j != w; ++j)
+			acc[j] = f64_max2(acc[j + w], acc[j]);
+	}
+	return acc[0];
+}
+
+static double f64_sum_scalar(const double *x, size_t n)
+{
+	double acc[NUMVEC_LANES] = {0};
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+		for (size_t j = 0; j != NUMVEC_LANES; ++j)
+			acc[j] += x[i + j];
+	}
+	double s = f64_lanes_sum(acc);
+	for (; i != n; ++i)
+		s += x[i];
+	return s;
+}
+
+static double f64_dot_scalar(const double *x, const double *y, size_t n)
+{
+	double acc[NUMVEC_LANES] = {0};
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+		for (size_t j = 0; j != NUMVEC_LANES; ++j)
+			acc[j] += x[i + j] * y[i + j];
+	}
+	double s = f64_lanes_sum(acc);
+	for (; i != n; ++i)
+		s += x[i] * y[i];
+	return s;
+}
+
+static double f64_min_scalar(const double *x, size_t n)
+{
+	double acc[NUMVEC_LANES];
+	for (size_t j = 0; j != NUMVEC_LANES; ++j)
+		acc[j] = INFINITY;
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+		for (size_t j = 0; j != NUMVEC_LANES; ++j)
+			acc[j] = f64_min2(x[i + j], acc[j]);
+	}
+	double s = f64_lanes_min(acc);
+	for (; i != n; ++i)
+		s = f64_min2(x[i], s);
+	return s;
+}
+
+static double f64_max_scalar(const double *x, size_t n)
+{
+	double acc[NUMVEC_LANES];
+	for (size_t j = 0; j != NUMVEC_LANES; ++j)
+		acc[j] = -INFINITY;
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+		for (size_t j = 0; j != NUMVEC_LANES; ++j)
+			acc[j] = f64_max2(x[i + j], acc[j]);
+	}
+	double s = f64_lanes_max(acc);
+	for (; i != n; ++i)
+		s = f64_max2(x[i], s);
+	return s;
+}
+
+static void f64_scale_scalar(double *out, const double *x, double k, size_t n)
+{
+	for (size_t i = 0; i != n; ++i)
+		out[i] = x[i] * k;
+}
+
+static void f64_add_scalar(double *out, const double *x, const double *y,
+			size_t n)
+{
+	for (size_t i = 0; i != n; ++i)
+		out[i] = x[i] + y[i];
+}
+
+static void s64_sum_scalar(const int64_t *x, size_t n, struct S64Sum *sum)
+{
+	for (size_t i = 0; i != n; ++i) {
+		uint64_t u = x[i];
+		sum->high += u >> 32;
+		sum->low += u & 0xffffffff;
+		sum->negative += x[i] < 0;
+	}
+}
+
+static int64_t s64_min_scalar(const int64_t *x, size_t n)
+{
+	int64_t s = INT64_MAX;
+	for (size_t i = 0; i != n; ++i)
+		s = x[i] < s ? x[i] : s;
+	return s;
+}
+
+static int64_t s64_max_scalar(const int64_t *x, size_t n)
+{
+	int64_t s = INT64_MIN;
+	for (size_t i = 0; i != n; ++i)
+		s = x[i] > s ? x[i] : s;
+	return s;
+}
+
+static bool s64_add_scalar(int64_t *out, const int64_t *x, const int64_t *y,
+			size_t n)
+{
+	/* Overflow is collected in a sign bit rather than branched on. */
+	uint64_t over = 0;
+	for (size_t i = 0; i != n; ++i) {
+		uint64_t r = (uint64_t)x[i] + (uint64_t)y[i];
+		over |= (x[i] ^ r) & (y[i] ^ r);
+		out[i] = r;
+	}
+	return !(over >> 63);
+}
+
+static const struct NumvecKernels scalarKernels = {
+	.f64Sum = f64_sum_scalar,
+	.f64Dot = f64_dot_scalar,
+	.f64Min = f64_min_scalar,
+	.f64Max = f64_max_scalar,
+	.f64Scale = f64_scale_scalar,
+	.f64Add = f64_add_scalar,
+	.s64Sum = s64_sum_scalar,
+	.s64Min = s64_min_scalar,
+	.s64Max = s64_max_scalar,
+	.s64Add = s64_add_scalar
+};
+
+#if SIMD_X86
+
+/*
+ * SSE2 is part of x86-64, so these need no target attribute.  The
+ * loops over accumulators are unrolled by pragma, since otherwise GCC
+ * keeps the accumulators in memory rather than in registers.
+ */
+
+#define SSE2_REGS (NUMVEC_LANES / 2)
+
+static double f64_sum_sse2(const double *x, size_t n)
+{
+	__m128d v[SSE2_REGS];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		v[k] = _mm_setzero_pd();
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != SSE2_REGS; ++k)
+			v[k] = _mm_add_pd(v[k], _mm_loadu_pd(x + i + 2 * k));
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		_mm_storeu_pd(acc + 2 * k, v[k]);
+	double s = f64_lanes_sum(acc);
+	for (; i != n; ++i)
+		s += x[i];
+	return s;
+}
+
+static double f64_dot_sse2(const double *x, const double *y, size_t n)
+{
+	__m128d v[SSE2_REGS];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		v[k] = _mm_setzero_pd();
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != SSE2_REGS; ++k) {
+			__m128d p = _mm_mul_pd(_mm_loadu_pd(x + i + 2 * k),
+					_mm_loadu_pd(y + i + 2 * k));
+			v[k] = _mm_add_pd(v[k], p);
+		}
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		_mm_storeu_pd(acc + 2 * k, v[k]);
+	double s = f64_lanes_sum(acc);
+	for (; i != n; ++i)
+		s += x[i] * y[i];
+	return s;
+}
+
+static double f64_min_sse2(const double *x, size_t n)
+{
+	__m128d v[SSE2_REGS];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		v[k] = _mm_set1_pd(INFINITY);
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != SSE2_REGS; ++k)
+			v[k] = _mm_min_pd(_mm_loadu_pd(x + i + 2 * k), v[k]);
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		_mm_storeu_pd(acc + 2 * k, v[k]);
+	double s = f64_lanes_min(acc);
+	for (; i != n; ++i)
+		s = f64_min2(x[i], s);
+	return s;
+}
+
+static double f64_max_sse2(const double *x, size_t n)
+{
+	__m128d v[SSE2_REGS];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		v[k] = _mm_set1_pd(-INFINITY);
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != SSE2_REGS; ++k)
+			v[k] = _mm_max_pd(_mm_loadu_pd(x + i + 2 * k), v[k]);
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != SSE2_REGS; ++k)
+		_mm_storeu_pd(acc + 2 * k, v[k]);
+	double s = f64_lanes_max(acc);
+	for (; i != n; ++i)
+		s = f64_max2(x[i], s);
+	return s;
+}
+
+static void f64_scale_sse2(double *out, const double *x, double k, size_t n)
+{
+	__m128d vk = _mm_set1_pd(k);
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2)
+		_mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(x + i), vk));
+	for (; i != n; ++i)
+		out[i] = x[i] * k;
+}
+
+static void f64_add_sse2(double *out, const double *x, const double *y,
+			size_t n)
+{
+	size_t i = 0;
+	for (; i + 2 <= n; i += 2) {
+		_mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(x + i),
+						_mm_loadu_pd(y + i)));
+	}
+	for (; i != n; ++i)
+		out[i] = x[i] + y[i];
+}
+
+/* SSE2 has no 64-bit compare, so the s64 kernels stay portable. */
+static const struct NumvecKernels sse2Kernels = {
+	.f64Sum = f64_sum_sse2,
+	.f64Dot = f64_dot_sse2,
+	.f64Min = f64_min_sse2,
+	.f64Max = f64_max_sse2,
+	.f64Scale = f64_scale_sse2,
+	.f64Add = f64_add_sse2,
+	.s64Sum = s64_sum_scalar,
+	.s64Min = s64_min_scalar,
+	.s64Max = s64_max_scalar,
+	.s64Add = s64_add_scalar
+};
+
+/*
+ * AVX2 is only reached after simd_level() has checked for it.  FMA is
+ * left out of the target on purpose: fusing the dot product's multiply
+ * and add would round differently from the other levels.
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+#define AVX2_REGS (NUMVEC_LANES / 4)
+
+AVX2 static double f64_sum_avx2(const double *x, size_t n)
+{
+	__m256d v[AVX2_REGS];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		v[k] = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != AVX2_REGS; ++k) {
+			v[k] = _mm256_add_pd(v[k],
+					_mm256_loadu_pd(x + i + 4 * k));
+		}
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		_mm256_storeu_pd(acc + 4 * k, v[k]);
+	double s = f64_lanes_sum(acc);
+	for (; i != n; ++i)
+		s += x[i];
+	return s;
+}
+
+AVX2 static double f64_dot_avx2(const double *x, const double *y, size_t n)
+{
+	__m256d v[AVX2_REGS];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		v[k] = _mm256_setzero_pd();
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != AVX2_REGS; ++k) {
+			__m256d p = _mm256_mul_pd(
+				_mm256_loadu_pd(x + i + 4 * k),
+				_mm256_loadu_pd(y + i + 4 * k));
+			v[k] = _mm256_add_pd(v[k], p);
+		}
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		_mm256_storeu_pd(acc + 4 * k, v[k]);
+	double s = f64_lanes_sum(acc);
+	for (; i != n; ++i)
+		s += x[i] * y[i];
+	return s;
+}
+
+AVX2 static double f64_min_avx2(const double *x, size_t n)
+{
+	__m256d v[AVX2_REGS];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		v[k] = _mm256_set1_pd(INFINITY);
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != AVX2_REGS; ++k) {
+			v[k] = _mm256_min_pd(_mm256_loadu_pd(x + i + 4 * k),
+					v[k]);
+		}
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		_mm256_storeu_pd(acc + 4 * k, v[k]);
+	double s = f64_lanes_min(acc);
+	for (; i != n; ++i)
+		s = f64_min2(x[i], s);
+	return s;
+}
+
+AVX2 static double f64_max_avx2(const double *x, size_t n)
+{
+	__m256d v[AVX2_REGS];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		v[k] = _mm256_set1_pd(-INFINITY);
+	size_t i = 0;
+	for (; i + NUMVEC_LANES <= n; i += NUMVEC_LANES) {
+#pragma GCC unroll 8
+		for (size_t k = 0; k != AVX2_REGS; ++k) {
+			v[k] = _mm256_max_pd(_mm256_loadu_pd(x + i + 4 * k),
+					v[k]);
+		}
+	}
+	double acc[NUMVEC_LANES];
+	for (size_t k = 0; k != AVX2_REGS; ++k)
+		_mm256_storeu_pd(acc + 4 * k, v[k]);
+	double s = f64_lanes_max(acc);
+	for (; i != n; ++i)
+		s = f64_max2(x[i], s);
+	return s;
+}
+
+AVX2 static void f64_scale_avx2(double *out, const double *x, double k,
+				size_t n)
+{
+	__m256d vk = _mm256_set1_pd(k);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(out + i,
+				_mm256_mul_pd(_mm256_loadu_pd(x + i), vk));
+	}
+	for (; i != n; ++i)
+		out[i] = x[i] * k;
+}
+
+AVX2 static void f64_add_avx2(double *out, const double *x, const double *y,
+			size_t n)
+{
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		_mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(x + i),
+							_mm256_loadu_pd(y + i)));
+	}
+	for (; i != n; ++i)
+		out[i] = x[i] + y[i];
+}
+
+AVX2 static void s64_sum_avx2(const int64_t *x, size_t n, struct S64Sum *sum)
+{
+	__m256i high = _mm256_setzero_si256();
+	__m256i low = _mm256_setzero_si256();
+	__m256i negative = _mm256_setzero_si256();
+	__m256i mask = _mm256_set1_epi64x(0xffffffff);
+	__m256i zero = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(x + i));
+		high = _mm256_add_epi64(high, _mm256_srli_epi64(v, 32));
+		low = _mm256_add_epi64(low, _mm256_and_si256(v, mask));
+		/* Each negative lane compares as -1. */
+		negative = _mm256_sub_epi64(negative,
+					_mm256_cmpgt_epi64(zero, v));
+	}
+	uint64_t h[4], l[4], g[4];
+	_mm256_storeu_si256((__m256i *)h, high);
+	_mm256_storeu_si256((__m256i *)l, low);
+	_mm256_storeu_si256((__m256i *)g, negative);
+	for (size_t j = 0; j != 4; ++j) {
+		sum->high += h[j];
+		sum->low += l[j];
+		sum->negative += g[j];
+	}
+	s64_sum_scalar(x + i, n - i, sum);
+}
+
+AVX2 static int64_t s64_min_avx2(const int64_t *x, size_t n)
+{
+	__m256i v = _mm256_set1_epi64x(INT64_MAX);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i y = _mm256_loadu_si256((const __m256i *)(x + i));
+		v = _mm256_blendv_epi8(v, y, _mm256_cmpgt_epi64(v, y));
+	}
+	int64_t acc[4];
+	_mm256_storeu_si256((__m256i *)acc, v);
+	int64_t s = s64_min_scalar(acc, 4);
+	int64_t t = s64_min_scalar(x + i, n - i);
+	return t < s ? t : s;
+}
+
+AVX2 static int64_t s64_max_avx2(const int64_t *x, size_t n)
+{
+	__m256i v = _mm256_set1_epi64x(INT64_MIN);
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i y = _mm256_loadu_si256((const __m256i *)(x + i));
+		v = _mm256_blendv_epi8(v, y, _mm256_cmpgt_epi64(y, v));
+	}
+	int64_t acc[4];
+	_mm256_storeu_si256((__m256i *)acc, v);
+	int64_t s = s64_max_scalar(acc, 4);
+	int64_t t = s64_max_scalar(x + i, n - i);
+	return t > s ? t : s;
+}
+
+AVX2 static bool s64_add_avx2(int64_t *out, const int64_t *x, const int64_t *y,
+			size_t n)
+{
+	__m256i over = _mm256_setzero_si256();
+	size_t i = 0;
+	for (; i + 4 <= n; i += 4) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(x + i));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(y + i));
+		__m256i r = _mm256_add_epi64(a, b);
+		over = _mm256_or_si256(over, _mm256_and_si256(
+				_mm256_xor_si256(a, r), _mm256_xor_si256(b, r)));
+		_mm256_storeu_si256((__m256i *)(out + i), r);
+	}
+	if (_mm256_movemask_pd(_mm256_castsi256_pd(over)))
+		return false;
+	return s64_add_scalar(out + i, x + i, y + i, n - i);
+}
+
+static const struct NumvecKernels avx2Kernels = {
+	.f64Sum = f64_sum_avx2,
+	.f64Dot = f64_dot_avx2,
+	.f64Min = f64_min_avx2,
+	.f64Max = f64_max_avx2,
+	.f64Scale = f64_scale_avx2,
+	.f64Add = f64_add_avx2,
+	.s64Sum = s64_sum_avx2,
+	.s64Min = s64_min_avx2,
+	.s64Max = s64_max_avx2,
+	.s64Add = s64_add_avx2
+};
+
+#endif
+
+const struct NumvecKernels *numvec_kernels(enum SimdLevel level)
+{
+#if SIMD_X86
+	if (level >= SimdAvx2)
+		return &avx2Kernels;
+	if (level >= SimdSse2)
+		return &sse2Kernels;
+#endif
+	return &scalarKernels;
+}
+
+/*
+ * The builtins.  Each one is a thin wrapper naming its type, over a
+ * helper shared by f64vectors and s64vectors.
+ */
+
+static const char *numvec_name(enum Type type)
+{
+	return type == TypeF64Vector ? "f64vector" : "s64vector";
+}
+
+static struct Object *numvec_arg(struct Object *args, enum Type type,
+				const char *name)
+{
+	/* The head of args if it is a vector of the given type, or 0. */
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != type) {
+		fprintf(stderr, "%s wants an %s.\n", name, numvec_name(type));
+		return 0;
+	}
+	return arg0;
+}
+
+static bool numvec_pair(struct Object *args, enum Type type,
+			const char *name, struct Object **a, struct Object **b)
+{
+	*a = obj_is_nil(args) ? 0 : car(args);
+	*b = *a && !obj_is_nil(cdr(args)) ? cadr(args) : 0;
+	if (!*b || obj_type(*a) != type || obj_type(*b) != type
+	    || (*a)->numvec.count != (*b)->numvec.count) {
+		fprintf(stderr, "%s wants two %ss of the same length.\n",
+			name, numvec_name(type));
+		return false;
+	}
+	return true;
+}
+
+static bool f64_value(struct Object *obj, double *d)
+{
+	if (!obj)
+		return false;
+	switch (obj_type(obj)) {
+	case TypeInteger:
+		*d = obj_integer(obj);
+		return true;
+	case TypeBignum:
+		*d = integer_to_double(obj);
+		return true;
+	case TypeDouble:
+		*d = obj->dbl;
+		return true;
+	default:
+		return false;
+	}
+}
+
+static bool numvec_value_ok(struct Object *obj, enum Type type)
+{
+	/* f64vectors take any number, s64vectors only 64-bit integers. */
+	double d;
+	if (type == TypeF64Vector)
+		return f64_value(obj, &d);
+	return obj && obj_type(obj) == TypeInteger;
+}
+
+static void numvec_store(struct Object *vec, size_t i, struct Object *obj)
+{
+	/* obj has passed numvec_value_ok(). */
+	if (obj_type(vec) == TypeF64Vector)
+		f64_value(obj, &vec->numvec.f64[i]);
+	else
+		vec->numvec.s64[i] = obj_integer(obj);
+}
+
+static struct Object *numvec_item(struct Machine *m, struct Object *vec,
+				size_t i)
+{
+	if (obj_type(vec) == TypeF64Vector)
+		return create_double_object(m, vec->numvec.f64[i]);
+	return create_integer_object(m, vec->numvec.s64[i]);
+}
+
+static struct Object *numvec_make(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	/* (make-f64vector n [fill]); the fill defaults to 0. */
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeInteger || obj_integer(arg0) < 0) {
+		fprintf(stderr, "%s wants a non-negative integer.\n", name);
+		return create_error_object(m);
+	}
+	struct Object *fill = obj_is_nil(cdr(args)) ? 0 : cadr(args);
+	if (fill && !numvec_value_ok(fill, type)) {
+		fprintf(stderr, "%s can't hold that fill.\n", name);
+		return create_error_object(m);
+	}
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &fill);
+	struct Object *vec = create_numvec_object(m, type, obj_integer(arg0));
+	gc_roots_restore(m, roots);
+	if (!vec) {
+		fprintf(stderr, "%s: out of memory.\n", name);
+		return create_error_object(m);
+	}
+	if (fill) {
+		for (size_t i = 0; i != vec->numvec.count; ++i)
+			numvec_store(vec, i, fill);
+	}
+	return vec;
+}
+
+static struct Object *numvec_from_list(struct Machine *m, struct Object *list,
+				enum Type type, const char *name)
+{
+	/* Everything is checked before the vector is allocated. */
+	size_t count = 0;
+	struct Object *it = list;
+	for (; it && obj_type(it) == TypePair && !obj_is_nil(it);
+	     it = it->pair.cdr) {
+		if (!numvec_value_ok(it->pair.car, type)) {
+			fprintf(stderr, "%s can't hold that element.\n", name);
+			return create_error_object(m);
+		}
+		++count;
+	}
+	if (!it || obj_type(it) != TypePair) {
+		fprintf(stderr, "%s wants a list.\n", name);
+		return create_error_object(m);
+	}
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &list);
+	struct Object *vec = create_numvec_object(m, type, count);
+	gc_roots_restore(m, roots);
+	if (!vec) {
+		fprintf(stderr, "%s: out of memory.\n", name);
+		return create_error_object(m);
+	}
+	for (size_t i = 0; i != count; ++i, list = list->pair.cdr)
+		numvec_store(vec, i, list->pair.car);
+	return vec;
+}
+
+static struct Object *numvec_to_list(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	struct Object *vec = numvec_arg(args, type, name);
+	if (!vec)
+		return create_error_object(m);
+	struct Object *item = 0;
+	struct Object *res = create_pair_object(m, 0, 0);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &vec);
+	gc_push_root(m, &item);
+	gc_push_root(m, &res);
+	for (size_t i = vec->numvec.count; res && i; --i) {
+		item = numvec_item(m, vec, i - 1);
+		res = item ? create_pair_object(m, item, res) : 0;
+	}
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+static bool numvec_index(struct Object *args, enum Type type,
+			const char *name, struct Object **vec, size_t *index)
+{
+	*vec = numvec_arg(args, type, name);
+	if (!*vec)
+		return false;
+	struct Object *arg1 = obj_is_nil(cdr(args)) ? 0 : cadr(args);
+	if (!arg1 || obj_type(arg1) != TypeInteger || obj_integer(arg1) < 0
+	    || (uint64_t)obj_integer(arg1) >= (*vec)->numvec.count) {
+		fprintf(stderr, "%s index out of range.\n", name);
+		return false;
+	}
+	*index = obj_integer(arg1);
+	return true;
+}
+
+static struct Object *numvec_ref(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	struct Object *vec;
+	size_t i;
+	if (!numvec_index(args, type, name, &vec, &i))
+		return create_error_object(m);
+	return numvec_item(m, vec, i);
+}
+
+static struct Object *numvec_set(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	/* The elements are raw numbers, so no write barrier is needed. */
+	struct Object *vec;
+	size_t i;
+	if (!numvec_index(args, type, name, &vec, &i))
+		return create_error_object(m);
+	struct Object *rest = cdr(cdr(args));
+	if (obj_is_nil(rest) || !numvec_value_ok(car(rest), type)) {
+		fprintf(stderr, "%s can't hold that value.\n", name);
+		return create_error_object(m);
+	}
+	numvec_store(vec, i, car(rest));
+	return create_pair_object(m, 0, 0);
+}
+
+static struct Object *numvec_length(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	struct Object *vec = numvec_arg(args, type, name);
+	if (!vec)
+		return create_error_object(m);
+	return create_integer_object(m, vec->numvec.count);
+}
+
+static struct Object *s64_sum(struct Machine *m, const int64_t *x, size_t n)
+{
+	/*
+	 * The exact sum, however large.  Within a chunk, each element is
+	 * high * 2^32 + low - negative * 2^64, which makes the chunk's sum
+	 * (high - negative * 2^32) * 2^32 + low with both terms well
+	 * inside an int64_t.  Only a sum too big for one goes through
+	 * the bignum functions.
+	 */
+	struct Object *total = create_integer_object(m, 0);
+	struct Object *part = 0;
+	struct Object *tmp = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &total);
+	gc_push_root(m, &part);
+	gc_push_root(m, &tmp);
+	for (size_t done = 0; total && done != n;) {
+		size_t len = n - done < NUMVEC_S64_CHUNK ? n - done
+							: NUMVEC_S64_CHUNK;
+		struct S64Sum s = {0, 0, 0};
+		m->numvec->s64Sum(x + done, len, &s);
+		done += len;
+		int64_t high = (int64_t)s.high - (int64_t)(s.negative << 32);
+		int64_t low = s.low;
+		int64_t r;
+		if (obj_type(total) == TypeInteger
+		    && !int64_mul_overflow(high, (int64_t)1 << 32, &r)
+		    && !int64_add_overflow(r, low, &r)
+		    && !int64_add_overflow(r, obj_integer(total), &r)) {
+			total = create_integer_object(m, r);
+			continue;
+		}
+		part = create_integer_object(m, high);
+		tmp = part ? create_integer_object(m, (int64_t)1 << 32) : 0;
+		part = tmp ? integer_mul(m, part, tmp) : 0;
+		tmp = part ? create_integer_object(m, low) : 0;
+		part = tmp ? integer_add(m, part, tmp) : 0;
+		total = part ? integer_add(m, total, part) : 0;
+	}
+	gc_roots_restore(m, roots);
+	return total;
+}
+
+static struct Object *s64_dot(struct Machine *m, const int64_t *x,
+			const int64_t *y, size_t n)
+{
+	/* In an int64_t until it overflows, then exactly from there. */
+	int64_t acc = 0;
+	size_t i = 0;
+	for (; i != n; ++i) {
+		int64_t p;
+		if (int64_mul_overflow(x[i], y[i], &p)
+		    || int64_add_overflow(acc, p, &p))
+			break;
+		acc = p;
+	}
+	struct Object *total = create_integer_object(m, acc);
+	struct Object *a = 0;
+	struct Object *b = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &total);
+	gc_push_root(m, &a);
+	gc_push_root(m, &b);
+	for (; total && i != n; ++i) {
+		a = create_integer_object(m, x[i]);
+		b = a ? create_integer_object(m, y[i]) : 0;
+		a = b ? integer_mul(m, a, b) : 0;
+		total = a ? integer_add(m, total, a) : 0;
+	}
+	gc_roots_restore(m, roots);
+	return total;
+}
+
+static struct Object *numvec_sum(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	struct Object *vec = numvec_arg(args, type, name);
+	if (!vec)
+		return create_error_object(m);
+	if (type == TypeF64Vector) {
+		return create_double_object(m, m->numvec->f64Sum(
+						vec->numvec.f64,
+						vec->numvec.count));
+	}
+	return s64_sum(m, vec->numvec.s64, vec->numvec.count);
+}
+
+static struct Object *numvec_dot(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	struct Object *a, *b;
+	if (!numvec_pair(args, type, name, &a, &b))
+		return create_error_object(m);
+	if (type == TypeF64Vector) {
+		return create_double_object(m, m->numvec->f64Dot(
+						a->numvec.f64, b->numvec.f64,
+						a->numvec.count));
+	}
+	return s64_dot(m, a->numvec.s64, b->numvec.s64, a->numvec.count);
+}
+
+static struct Object *numvec_scale(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	/* A new vector of each element times k. */
+	struct Object *vec = numvec_arg(args, type, name);
+	struct Object *k = vec && !obj_is_nil(cdr(args)) ? cadr(args) : 0;
+	if (!k || !numvec_value_ok(k, type)) {
+		fprintf(stderr, "%s wants an %s and a factor.\n", name,
+			numvec_name(type));
+		return create_error_object(m);
+	}
+	double dk;
+	f64_value(k, &dk);
+	int64_t ik = type == TypeS64Vector ? obj_integer(k) : 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &vec);
+	struct Object *res = create_numvec_object(m, type, vec->numvec.count);
+	gc_roots_restore(m, roots);
+	if (!res) {
+		fprintf(stderr, "%s: out of memory.\n", name);
+		return create_error_object(m);
+	}
+	size_t n = vec->numvec.count;
+	if (type == TypeF64Vector) {
+		m->numvec->f64Scale(res->numvec.f64, vec->numvec.f64, dk, n);
+		return res;
+	}
+	for (size_t i = 0; i != n; ++i) {
+		if (int64_mul_overflow(vec->numvec.s64[i], ik,
+				&res->numvec.s64[i])) {
+			fprintf(stderr, "%s overflowed.\n", name);
+			return create_error_object(m);
+		}
+	}
+	return res;
+}
+
+static struct Object *numvec_add(struct Machine *m, struct Object *args,
+				enum Type type, const char *name)
+{
+	/* A new vector of the elementwise sums. */
+	struct Object *a, *b;
+	if (!numvec_pair(args, type, name, &a, &b))
+		return create_error_object(m);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &a);
+	gc_push_root(m, &b);
+	struct Object *res = create_numvec_object(m, type, a->numvec.count);
+	gc_roots_restore(m, roots);
+	if (!res) {
+		fprintf(stderr, "%s: out of memory.\n", name);
+		return create_error_object(m);
+	}
+	size_t n = a->numvec.count;
+	if (type == TypeF64Vector) {
+		m->numvec->f64Add(res->numvec.f64, a->numvec.f64,
+				b->numvec.f64, n);
+	} else if (!m->numvec->s64Add(res->numvec.s64, a->numvec.s64,
+					b->numvec.s64, n)) {
+		fprintf(stderr, "%s overflowed.\n", name);
+		return create_error_object(m);
+	}
+	return res;
+}
+
+static struct Object *numvec_extreme(struct Machine *m, struct Object *args,
+				enum Type type, const char *name, bool max)
+{
+	/* NaNs are skipped, so only a vector of them all gives infinity. */
+	struct Object *vec = numvec_arg(args, type, name);
+	if (!vec)
+		return create_error_object(m);
+	size_t n = vec->numvec.count;
+	if (!n) {
+		fprintf(stderr, "%s wants a non-empty %s.\n", name,
+			numvec_name(type));
+		return create_error_object(m);
+	}
+	const struct NumvecKernels *k = m->numvec;
+	if (type == TypeF64Vector) {
+		const double *x = vec->numvec.f64;
+		return create_double_object(m, max ? k->f64Max(x, n)
+						: k->f64Min(x, n));
+	}
+	const int64_t *x = vec->numvec.s64;
+	return create_integer_object(m, max ? k->s64Max(x, n)
+					: k->s64Min(x, n));
+}
+
+struct Object *make_f64vector(struct Machine *m, struct Object *args)
+{
+	return numvec_make(m, args, TypeF64Vector, "make-f64vector");
+}
+
+struct Object *f64vector(struct Machine *m, struct Object *args)
+{
+	return numvec_from_list(m, args, TypeF64Vector, "f64vector");
+}
+
+struct Object *list_to_f64vector(struct Machine *m, struct Object *args)
+{
+	return numvec_from_list(m, obj_is_nil(args) ? 0 : car(args),
+				TypeF64Vector, "list->f64vector");
+}
+
+struct Object *f64vector_to_list(struct Machine *m, struct Object *args)
+{
+	return numvec_to_list(m, args, TypeF64Vector, "f64vector->list");
+}
+
+struct Object *f64vector_p(struct Machine *m, struct Object *args)
+{
+	return truth(m, !obj_is_nil(args) && car(args)
+			&& obj_type(car(args)) == TypeF64Vector);
+}
+
+struct Object *f64vector_length(struct Machine *m, struct Object *args)
+{
+	return numvec_length(m, args, TypeF64Vector, "f64vector-length");
+}
+
+struct Object *f64vector_ref(struct Machine *m, struct Object *args)
+{
+	return numvec_ref(m, args, TypeF64Vector, "f64vector-ref");
+}
+
+struct Object *f64vector_set(struct Machine *m, struct Object *args)
+{
+	return numvec_set(m, args, TypeF64Vector, "f64vector-set!");
+}
+
+struct Object *f64vector_sum(struct Machine *m, struct Object *args)
+{
+	return numvec_sum(m, args, TypeF64Vector, "f64vector-sum");
+}
+
+struct Object *f64vector_dot(struct Machine *m, struct Object *args)
+{
+	return numvec_dot(m, args, TypeF64Vector, "f64vector-dot");
+}
+
+struct Object *f64vector_scale(struct Machine *m, struct Object *args)
+{
+	return numvec_scale(m, args, TypeF64Vector, "f64vector-scale");
+}
+
+struct Object *f64vector_add(struct Machine *m, struct Object *args)
+{
+	return numvec_add(m, args, TypeF64Vector, "f64vector-add");
+}
+
+struct Object *f64vector_min(struct Machine *m, struct Object *args)
+{
+	return numvec_extreme(m, args, TypeF64Vector, "f64vector-min", false);
+}
+
+struct Object *f64vector_max(struct Machine *m, struct Object *args)
+{
+	return numvec_extreme(m, args, TypeF64Vector, "f64vector-max", true);
+}
+
+struct Object *make_s64vector(struct Machine *m, struct Object *args)
+{
+	return numvec_make(m, args, TypeS64Vector, "make-s64vector");
+}
+
+struct Object *s64vector(struct Machine *m, struct Object *args)
+{
+	return numvec_from_list(m, args, TypeS64Vector, "s64vector");
+}
+
+struct Object *list_to_s64vector(struct Machine *m, struct Object *args)
+{
+	return numvec_from_list(m, obj_is_nil(args) ? 0 : car(args),
+				TypeS64Vector, "list->s64vector");
+}
+
+struct Object *s64vector_to_list(struct Machine *m, struct Object *args)
+{
+	return numvec_to_list(m, args, TypeS64Vector, "s64vector->list");
+}
+
+struct Object *s64vector_p(struct Machine *m, struct Object *args)
+{
+	return truth(m, !obj_is_nil(args) && car(args)
+			&& obj_type(car(args)) == TypeS64Vector);
+}
+
+struct Object *s64vector_length(struct Machine *m, struct Object *args)
+{
+	return numvec_length(m, args, TypeS64Vector, "s64vector-length");
+}
+
+struct Object *s64vector_ref(struct Machine *m, struct Object *args)
+{
+	return numvec_ref(m, args, TypeS64Vector, "s64vector-ref");
+}
+
+struct Object *s64vector_set(struct Machine *m, struct Object *args)
+{
+	return numvec_set(m, args, TypeS64Vector, "s64vector-set!");
+}
+
+struct Object *s64vector_sum(struct Machine *m, struct Object *args)
+{
+	return numvec_sum(m, args, TypeS64Vector, "s64vector-sum");
+}
+
+struct Object *s64vector_dot(struct Machine *m, struct Object *args)
+{
+	return numvec_dot(m, args, TypeS64Vector, "s64vector-dot");
+}
+
+struct Object *s64vector_scale(struct Machine *m, struct Object *args)
+{
+	return numvec_scale(m, args, TypeS64Vector, "s64vector-scale");
+}
+
+struct Object *s64vector_add(struct Machine *m, struct Object *args)
+{
+	return numvec_add(m, args, TypeS64Vector, "s64vector-add");
+}
+
+struct Object *s64vector_min(struct Machine *m, struct Object *args)
+{
+	return numvec_extreme(m, args, TypeS64Vector, "s64vector-min", false);
+}
+
+struct Object *s64vector_max(struct Machine *m, struct Object *args)
+{
+	return numvec_extreme(m, args, TypeS64Vector, "s64vector-max", true);
+}
@@ -0,0 +1,76 @@
+#ifndef NUMVEC_H
+#define NUMVEC_H
+
+#include "scheme_forward.h"
+#include "simd.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Column kernels over raw f64 and s64 arrays.  Each SimdLevel has a
+ * table of them, and the machine picks one when it is created.  Float
+ * sums are split across the same NUMVEC_LANES partial sums at every
+ * level and combined in the same order, so results don't depend on the
+ * CPU.  The s64 sum is returned in pieces, high halves, low halves and
+ * the count of negatives, which can't overflow for up to
+ * NUMVEC_S64_CHUNK elements; see s64_sum() in numvec.c.
+ */
+
+#define NUMVEC_LANES 16
+#define NUMVEC_S64_CHUNK ((size_t)1 << 30)
+
+struct S64Sum {
+	uint64_t high;
+	uint64_t low;
+	uint64_t negative;
+};
+
+struct NumvecKernels {
+	double (*f64Sum)(const double *x, size_t n);
+	double (*f64Dot)(const double *x, const double *y, size_t n);
+	double (*f64Min)(const double *x, size_t n);
+	double (*f64Max)(const double *x, size_t n);
+	void (*f64Scale)(double *out, const double *x, double k, size_t n);
+	void (*f64Add)(double *out, const double *x, const double *y,
+			size_t n);
+	void (*s64Sum)(const int64_t *x, size_t n, struct S64Sum *sum);
+	int64_t (*s64Min)(const int64_t *x, size_t n);
+	int64_t (*s64Max)(const int64_t *x, size_t n);
+	bool (*s64Add)(int64_t *out, const int64_t *x, const int64_t *y,
+			size_t n);
+};
+
+const struct NumvecKernels *numvec_kernels(enum SimdLevel level);
+
+struct Object *make_f64vector(struct Machine *m, struct Object *args);
+struct Object *f64vector(struct Machine *m, struct Object *args);
+struct Object *list_to_f64vector(struct Machine *m, struct Object *args);
+struct Object *f64vector_to_list(struct Machine *m, struct Object *args);
+struct Object *f64vector_p(struct Machine *m, struct Object *args);
+struct Object *f64vector_length(struct Machine *m, struct Object *args);
+struct Object *f64vector_ref(struct Machine *m, struct Object *args);
+struct Object *f64vector_set(struct Machine *m, struct Object *args);
+struct Object *f64vector_sum(struct Machine *m, struct Object *args);
+struct Object *f64vector_dot(struct Machine *m, struct Object *args);
+struct Object *f64vector_scale(struct Machine *m, struct Object *args);
+struct Object *f64vector_add(struct Machine *m, struct Object *args);
+struct Object *f64vector_min(struct Machine *m, struct Object *args);
+struct Object *f64vector_max(struct Machine *m, struct Object *args);
+
+struct Object *make_s64vector(struct Machine *m, struct Object *args);
+struct Object *s64vector(struct Machine *m, struct Object *args);
+struct Object *list_to_s64vector(struct Machine *m, struct Object *args);
+struct Object *s64vector_to_list(struct Machine *m, struct Object *args);
+struct Object *s64vector_p(struct Machine *m, struct Object *args);
+struct Object *s64vector_length(struct Machine *m, struct Object *args);
+struct Object *s64vector_ref(struct Machine *m, struct Object *args);
+struct Object *s64vector_set(struct Machine *m, struct Object *args);
+struct Object *s64vector_sum(struct Machine *m, struct Object *args);
+struct Object *s64vector_dot(struct Machine *m, struct Object *args);
+struct Object *s64vector_scale(struct Machine *m, struct Object *args);
+struct Object *s64vector_add(struct Machine *m, struct Object *args);
+struct Object *s64vector_min(struct Machine *m, struct Object *args);
+struct Object *s64vector_max(struct Machine *m, struct Object *args);
+
+#endif
@@ -0,0 +1,254 @@
+#include "eval.h"
+#include "print.h"
+#include "scheme.h"
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * Runs independent scripts on a pool of worker threads and prints what
+ * each printed, in the order the scripts were given, as if each had
+ * been run by a scheme of its own.  Workers take jobs from a lock-free
+ * queue until they take the stop job, and run each in a fresh Machine
+ * that the worker alone owns, so no two scripts see each other's
+ * globals.  What goes to stderr is not ordered.
+ *
+ * Usage: pool [-j threads] script ...
+ */
+
+/* Cells in the queue; a power of two. */
+#define QUEUE_SIZE 1024
+
+struct Job {
+	const char *path;
+	char *output;
+	size_t length;
+	bool ok;
+};
+
+/*
+ * A bounded queue that many threads may push to and pop from, after
+ * Dmitry Vyukov's.  Each cell's seq says which lap of the ring the
+ * cell is ready for: pos when the push at pos may fill it, and pos + 1
+ * once it has, when the pop at pos may empty it.  Pushers and poppers
+ * claim positions by advancing tail and head, which live on separate
+ * cache lines.  The queue itself never blocks; ready counts the jobs
+ * pushed and not yet taken, and room the free cells, so that idle
+ * workers and a producer facing a full queue sleep on them instead of
+ * spinning.
+ */
+struct Cell {
+	atomic_size_t seq;
+	struct Job *job;
+};
+
+struct Queue {
+	struct Cell cells[QUEUE_SIZE];
+	alignas(64) atomic_size_t tail;
+	alignas(64) atomic_size_t head;
+	sem_t ready;
+	sem_t room;
+};
+
+static bool queue_init(struct Queue *q)
+{
+	for (size_t i = 0; i != QUEUE_SIZE; ++i)
+		atomic_init(&q->cells[i].seq, i);
+	atomic_init(&q->tail, 0);
+	atomic_init(&q->head, 0);
+	if (sem_init(&q->ready, 0, 0) == -1)
+		return false;
+	if (sem_init(&q->room, 0, QUEUE_SIZE) == -1) {
+		sem_destroy(&q->ready);
+		return false;
+	}
+	return true;
+}
+
+static void queue_free(struct Queue *q)
+{
+	sem_destroy(&q->ready);
+	sem_destroy(&q->room);
+}
+
+static void sem_take(sem_t *s)
+{
+	while (sem_wait(s) == -1)
+		;
+}
+
+static bool queue_push(struct Queue *q, struct Job *job)
+{
+	/* False if the queue is full. */
+	size_t pos = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	struct Cell *cell;
+	while (1) {
+		cell = &q->cells[pos & (QUEUE_SIZE - 1)];
+		size_t seq = atomic_load_explicit(&cell->seq,
+						memory_order_acquire);
+		intptr_t lap = (intptr_t)seq - (intptr_t)pos;
+		if (!lap) {
+			if (atomic_compare_exchange_weak_explicit(&q->tail,
+					&pos, pos + 1, memory_order_relaxed,
+					memory_order_relaxed))
+				break;
+		} else if (lap < 0) {
+			return false;
+		} else {
+			pos = atomic_load_explicit(&q->tail,
+						memory_order_relaxed);
+		}
+	}
+	cell->job = job;
+	atomic_store_explicit(&cell->seq, pos + 1, memory_order_release);
+	return true;
+}
+
+static struct Job *queue_pop(struct Queue *q)
+{
+	/* Null if the queue is empty. */
+	size_t pos = atomic_load_explicit(&q->head, memory_order_relaxed);
+	struct Cell *cell;
+	while (1) {
+		cell = &q->cells[pos & (QUEUE_SIZE - 1)];
+		size_t seq = atomic_load_explicit(&cell->seq,
+						memory_order_acquire);
+		intptr_t lap = (intptr_t)seq - (intptr_t)(pos + 1);
+		if (!lap) {
+			if (atomic_compare_exchange_weak_explicit(&q->head,
+					&pos, pos + 1, memory_order_relaxed,
+					memory_order_relaxed))
+				break;
+		} else if (lap < 0) {
+			return 0;
+		} else {
+			pos = atomic_load_explicit(&q->head,
+						memory_order_relaxed);
+		}
+	}
+	struct Job *job = cell->job;
+	atomic_store_explicit(&cell->seq, pos + QUEUE_SIZE,
+			memory_order_release);
+	return job;
+}
+
+/* Popped once by each worker, after the last real job. */
+static struct Job stopJob;
+
+static void run_job(struct Job *job)
+{
+	/* Output is kept in memory and handed to the job when it ends. */
+	struct Machine *m = create_machine();
+	if (!m) {
+		fprintf(stderr, "%s: Failed to create a machine.\n", job->path);
+		return;
+	}
+	printer_init(&m->out, -1);
+	job->ok = eval_file(m, job->path);
+	job->output = m->out.buf;
+	job->length = m->out.count;
+	m->out.buf = 0;
+	destroy_machine(m);
+}
+
+static struct Job *take(struct Queue *q)
+{
+	/*
+	 * Sleep until a job has been pushed.  Jobs are posted only once
+	 * their cells are published, so the pop finds one; the loop is a
+	 * safeguard, as is push()'s.
+	 */
+	sem_take(&q->ready);
+	struct Job *job;
+	while (!(job = queue_pop(q)))
+		sched_yield();
+	sem_post(&q->room);
+	return job;
+}
+
+static void *worker(void *arg)
+{
+	struct Queue *q = arg;
+	while (1) {
+		struct Job *job = take(q);
+		if (job == &stopJob)
+			break;
+		run_job(job);
+	}
+	return 0;
+}
+
+static void push(struct Queue *q, struct Job *job)
+{
+	/* Sleep while the queue is full. */
+	sem_take(&q->room);
+	while (!queue_push(q, job))
+		sched_yield();
+	sem_post(&q->ready);
+}
+
+int main(int argc, char *argv[])
+{
+	long threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int opt;
+	while ((opt = getopt(argc, argv, "j:")) != -1) {
+		if (opt != 'j' || (threads = atol(optarg)) <= 0) {
+			fprintf(stderr, "Usage: %s [-j threads] script ...\n",
+				argv[0]);
+			return 2;
+		}
+	}
+	if (threads <= 0)
+		threads = 1;
+	size_t count = argc - optind;
+	struct Job *jobs = calloc(count ? count : 1, sizeof(*jobs));
+	pthread_t *ids = malloc(threads * sizeof(*ids));
+	struct Queue *q = malloc(sizeof(*q));
+	if (!jobs || !ids || !q) {
+		fprintf(stderr, "Out of memory.\n");
+		return 1;
+	}
+	if (!queue_init(q)) {
+		perror("sem_init");
+		return 1;
+	}
+
+	long started = 0;
+	for (; started != threads; ++started) {
+		if (pthread_create(&ids[started], 0, worker, q)) {
+			perror("pthread_create");
+			break;
+		}
+	}
+	if (!started)
+		return 1;
+	for (size_t i = 0; i != count; ++i) {
+		jobs[i].path = argv[optind + i];
+		push(q, &jobs[i]);
+	}
+	for (long i = 0; i != started; ++i)
+		push(q, &stopJob);
+	for (long i = 0; i != started; ++i)
+		pthread_join(ids[i], 0);
+
+	int status = 0;
+	for (size_t i = 0; i != count; ++i) {
+		if (jobs[i].length)
+			fwrite(jobs[i].output, 1, jobs[i].length, stdout);
+		free(jobs[i].output);
+		if (!jobs[i].ok)
+			status = 1;
+	}
+	queue_free(q);
+	free(jobs);
+	free(ids);
+	free(q);
+	return status;
+}
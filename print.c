@@ -1,127 +1,369 @@
 #include "print.h"
+#include "bignum.h"
 #include "scheme.h"
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-void obj_print_dotted(struct Machine *machine, struct Object *obj)
+#define PRINTER_BUFFER 65536
+
+void printer_init(struct Printer *p, int fd)
 {
-	if (!obj) {
-		printf("null");
-	} else {
-		switch (obj->type) {
-		case TypeSymbol:
-			printf("<%s>", machine->symbols.strs[obj->symbol].cstr);
-			return;
-		case TypeString:
-			printf("\"%s\"", obj->string.cstr);
-			return;
-		case TypeInteger:
-			printf("%i", obj->integer);
-			return;
-		case TypeDouble:
-			printf("%f", obj->dbl);
-			return;
-		case TypePair:
-			if (obj->pair.car && !obj->pair.cdr) {
-				printf("(");
-				if (!obj->pair.car)
-					printf("null");
-				else
-					obj_print_dotted(machine, obj->pair.car);
-				printf(". ");
-				if (!obj->pair.cdr)
-					printf("null");
-				else
-					obj_print_dotted(machine, obj->pair.cdr);
-				printf(") ");
-			}
-			return;
-		case TypeEnv:
-			printf("*ENV*");
-			return;
-		case TypeError:
-			printf("*ERROR*");
-			return;
-		case TypeBuiltinForm:
-			printf("*BUILTIN_FORM*");
-			return;
-		case TypeBuiltinFunc:
-			printf("*BUILTIN_FUNC*");
-			return;
-		case TypeClosure:
-			printf("*CLOSURE*");
-			return;
+	/* Nothing is allocated until something is printed. */
+	p->buf = 0;
+	p->count = 0;
+	p->size = 0;
+	p->fd = fd;
+	p->stack = 0;
+	p->stackCount = 0;
+	p->stackSize = 0;
+}
+
+void printer_free(struct Printer *p)
+{
+	free(p->buf);
+	free(p->stack);
+	printer_init(p, p->fd);
+}
+
+bool printer_flush(struct Printer *p)
+{
+	/* Output that can't be written is dropped. */
+	if (p->fd == -1)
+		return true;
+	size_t done = 0;
+	while (done != p->count) {
+		ssize_t n = write(p->fd, p->buf + done, p->count - done);
+		if (n == -1 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			p->count = 0;
+			return false;
 		}
+		done += n;
 	}
+	p->count = 0;
+	return true;
 }
 
-void obj_print_inner(struct Machine *machine, struct Object *obj);
+static char *printer_reserve(struct Printer *p, size_t n)
+{
+	/* Room for n more bytes at the end of buf, or 0. */
+	if (p->size - p->count >= n)
+		return p->buf + p->count;
+	if (p->fd != -1 && p->count) {
+		printer_flush(p);
+		if (p->size >= n)
+			return p->buf;
+	}
+	size_t nsize = p->size ? p->size : PRINTER_BUFFER;
+	while (nsize - p->count < n)
+		nsize *= 2;
+	char *nbuf = realloc(p->buf, nsize);
+	if (!nbuf)
+		return 0;
+	p->buf = nbuf;
+	p->size = nsize;
+	return p->buf + p->count;
+}
 
-void obj_print(struct Machine *machine, struct Object *obj)
+void printer_write(struct Printer *p, const char *s, size_t n)
 {
-	if (!obj) {
-		printf("null");
-	} else if (obj->type == TypePair) {
-		printf("(");
+	char *to = printer_reserve(p, n);
+	if (!to)
+		return;
+	memcpy(to, s, n);
+	p->count += n;
+}
+
+void printer_puts(struct Printer *p, const char *s)
+{
+	printer_write(p, s, strlen(s));
+}
+
+void printer_printf(struct Printer *p, const char *fmt, ...)
+{
+	/* Formats straight into buf, retrying once if it was too small. */
+	va_list ap;
+	va_start(ap, fmt);
+	int n = vsnprintf(p->buf + p->count, p->size - p->count, fmt, ap);
+	va_end(ap);
+	if (n < 0)
+		return;
+	if ((size_t)n >= p->size - p->count) {
+		if (!printer_reserve(p, n + 1))
+			return;
+		va_start(ap, fmt);
+		vsnprintf(p->buf + p->count, n + 1, fmt, ap);
+		va_end(ap);
 	}
-	return obj_print_inner(machine, obj);
+	p->count += n;
 }
 
-void obj_print_inner(struct Machine *machine, struct Object *obj)
+void printer_integer(struct Printer *p, long long n)
 {
-	if (!obj) {
-		printf("null");
+	/* Digits are produced two at a time, from the right. */
+	static const char pairs[] =
+		"00010203040506070809101112131415161718192021222324"
+		"25262728293031323334353637383940414243444546474849"
+		"50515253545556575859606162636465666768697071727374"
+		"75767778798081828384858687888990919293949596979899";
+	char digits[24];
+	char *end = digits + sizeof(digits);
+	char *d = end;
+	unsigned long long u = n < 0 ? -(unsigned long long)n : n;
+	while (u >= 100) {
+		unsigned i = (u % 100) * 2;
+		u /= 100;
+		*--d = pairs[i + 1];
+		*--d = pairs[i];
+	}
+	if (u >= 10) {
+		*--d = pairs[u * 2 + 1];
+		*--d = pairs[u * 2];
 	} else {
-		switch (obj->type) {
-		case TypeSymbol:
-			printf("<%s> ", machine->symbols.strs[obj->symbol].cstr);
-			return;
-		case TypeString:
-			printf("\"%s\" ", obj->string.cstr);
-			return;
-		case TypeInteger:
-			printf("%i ", obj->integer);
-			return;
-		case TypeDouble:
-			printf("%f ", obj->dbl);
-			return;
-		case TypePair:
-			/* Car and Cdr are null */
-			//if (!obj->pair.car && !obj->pair.cdr) {
-			if (obj_is_nil(obj)) {
-				printf(") ");
+		*--d = '0' + u;
+	}
+	if (n < 0)
+		*--d = '-';
+	printer_write(p, d, end - d);
+}
+
+void printer_double(struct Printer *p, double d)
+{
+	/*
+	 * The shortest of 15, 16 or 17 significant digits that reads back
+	 * as the same double.  Fifteen digits always survive the trip from
+	 * decimal to double and back, so a shorter exact form shows up
+	 * there with its trailing zeros removed.  Denormals have fewer
+	 * digits to begin with, so they try every precision.  A result
+	 * that would read back as an integer gets ".0".
+	 */
+	char digits[32];
+	int n = 0;
+	int prec = d != 0 && fabs(d) < DBL_MIN ? 1 : 15;
+	for (; prec <= 17; ++prec) {
+		n = snprintf(digits, sizeof(digits), "%.*g", prec, d);
+		if (strtod(digits, 0) == d || d != d)
+			break;
+	}
+	if (!strpbrk(digits, ".eEni"))
+		n += snprintf(digits + n, sizeof(digits) - n, ".0");
+	printer_write(p, digits, n);
+}
+
+static void print_atom(struct Machine *machine, struct Printer *p,
+		struct Object *obj)
+{
+	char *text;
+	size_t length;
+	if (!obj) {
+		printer_puts(p, "null");
+		return;
+	}
+	switch (obj_type(obj)) {
+	case TypeSymbol:
+		printer_puts(p, "<");
+		printer_puts(p, symbol_name(&machine->symbols, obj->symbol));
+		printer_puts(p, "> ");
+		return;
+	case TypeString:
+		printer_puts(p, "\"");
+		printer_write(p, string_slice_chars(obj->string),
+			obj->string.length);
+		printer_puts(p, "\" ");
+		return;
+	case TypeInteger:
+		printer_integer(p, obj_integer(obj));
+		printer_puts(p, " ");
+		return;
+	case TypeDouble:
+		printer_double(p, obj->dbl);
+		printer_puts(p, " ");
+		return;
+	case TypeBignum:
+		text = bignum_to_decimal(obj, &length);
+		if (text)
+			printer_write(p, text, length);
+		else
+			printer_puts(p, "*BIGNUM*");
+		free(text);
+		printer_puts(p, " ");
+		return;
+	case TypeVector:
+		/* Only nested vectors recurse; lists inside are iterative. */
+		printer_puts(p, "#(");
+		for (size_t i = 0; i != obj->vector.count; ++i)
+			print_object(machine, p, obj->vector.items[i]);
+		printer_puts(p, ") ");
+		return;
+	case TypeF64Vector:
+		printer_puts(p, "#f64(");
+		for (size_t i = 0; i != obj->numvec.count; ++i) {
+			printer_double(p, obj->numvec.f64[i]);
+			printer_puts(p, " ");
+		}
+		printer_puts(p, ") ");
+		return;
+	case TypeS64Vector:
+		printer_puts(p, "#s64(");
+		for (size_t i = 0; i != obj->numvec.count; ++i) {
+			printer_integer(p, obj->numvec.s64[i]);
+			printer_puts(p, " ");
+		}
+		printer_puts(p, ") ");
+		return;
+	case TypeStringBuilder:
+		printer_puts(p, "*STRING_BUILDER*");
+		return;
+	case TypeHashTable:
+		printer_puts(p, "*HASH_TABLE*");
+		return;
+	case TypeHamt:
+		printer_puts(p, "*HAMT*");
+		return;
+	case TypeHamtNode:
+		printer_puts(p, "*HAMT_NODE*");
+		return;
+	case TypeRecordType:
+		printer_puts(p, "*RECORD_TYPE*");
+		return;
+	case TypeRecord:
+		printer_puts(p, "*RECORD*");
+		return;
+	case TypeRecordProc:
+		printer_puts(p, "*RECORD_PROC*");
+		return;
+	case TypePair:
+		/* Only () gets here. */
+		printer_puts(p, "( ) ");
+		return;
+	case TypeError:
+		printer_puts(p, "*ERROR*");
+		return;
+	case TypeBuiltinForm:
+		printer_puts(p, "*BUILTIN_FORM*");
+		return;
+	case TypeBuiltinFunc:
+		printer_puts(p, "*BUILTIN_FUNC*");
+		return;
+	case TypeClosure:
+		printer_puts(p, "*CLOSURE*");
+		return;
+	case TypeFrame:
+		printer_puts(p, "*FRAME*");
+		return;
+	case TypeGlobalRef:
+		printer_puts(p, "*GLOBAL_REF*");
+		return;
+	case TypeCode:
+		printer_puts(p, "*CODE*");
+		return;
+	case TypeChunk:
+		printer_puts(p, "*CHUNK*");
+		return;
+	case TypeContinuation:
+		printer_puts(p, "*CONTINUATION*");
+		return;
+	}
+}
+
+static bool print_push(struct Printer *p, size_t depth, struct Object *obj)
+{
+	if (depth >= p->stackSize) {
+		size_t nsize = p->stackSize ? p->stackSize * 2 : 64;
+		struct Object **nstack = realloc(p->stack,
+						nsize * sizeof(*nstack));
+		if (!nstack)
+			return false;
+		p->stack = nstack;
+		p->stackSize = nsize;
+	}
+	p->stack[depth] = obj;
+	return true;
+}
+
+static void print_list(struct Machine *machine, struct Printer *p,
+		struct Object *obj)
+{
+	/*
+	 * The elements of the list obj, whose "(" has been printed, and
+	 * its ")".  A list in the car is entered after its cdr is pushed,
+	 * and the cdr is picked up again when the inner list ends.  An
+	 * improper tail is printed after a ".".  A vector's elements are
+	 * printed by a nested call, which starts above this one's stack.
+	 */
+	size_t base = p->stackCount;
+	size_t depth = base;
+	while (true) {
+		if (!obj || obj_type(obj) != TypePair) {
+			printer_puts(p, ". ");
+			p->stackCount = depth;
+			print_atom(machine, p, obj);
+			obj = 0;
+		}
+		if (!obj || obj_is_nil(obj)) {
+			printer_puts(p, ") ");
+			if (depth == base) {
+				p->stackCount = base;
 				return;
 			}
-			if (!obj->pair.car) {
-				/* Unexpected. Fallback to dotted. */
-				obj_print_dotted(machine, obj);
+			obj = p->stack[--depth];
+			continue;
+		}
+		struct Object *item = obj->pair.car;
+		if (item && obj_type(item) == TypePair) {
+			if (!print_push(p, depth, obj->pair.cdr)) {
+				printer_puts(p, "...) ");
+				p->stackCount = base;
 				return;
 			}
-			if (obj->pair.car && obj->pair.car->type == TypePair)
-				printf("( ");
-			obj_print_inner(machine, obj->pair.car);
-
-			// Cdr
-			if (obj_is_nil(obj->pair.cdr))
-				printf(") ");
-			else
-				obj_print_inner(machine, obj->pair.cdr);
-			return;
-		case TypeEnv:
-			printf("*ENV*");
-			return;
-		case TypeError:
-			printf("*ERROR*");
-			return;
-		case TypeBuiltinForm:
-			printf("*BUILTIN_FORM*");
-			return;
-		case TypeBuiltinFunc:
-			printf("*BUILTIN_FUNC*");
-			return;
-		case TypeClosure:
-			printf("*CLOSURE*");
-			return;
+			++depth;
+			printer_puts(p, "( ");
+			obj = item;
+			continue;
 		}
+		p->stackCount = depth;
+		print_atom(machine, p, item);
+		obj = obj->pair.cdr;
+	}
+}
+
+void print_object(struct Machine *machine, struct Printer *p,
+		struct Object *obj)
+{
+	if (obj && obj_type(obj) == TypePair && !obj_is_nil(obj)) {
+		printer_puts(p, "(");
+		print_list(machine, p, obj);
+	} else if (obj && obj_is_nil(obj)) {
+		printer_puts(p, "() ");
+	} else {
+		print_atom(machine, p, obj);
+	}
+}
+
+void obj_print_dotted(struct Machine *machine, struct Object *obj)
+{
+	/* A pair as (car . cdr), without looking further down the cdr. */
+	struct Printer *p = &machine->out;
+	if (!obj || obj_type(obj) != TypePair || obj_is_nil(obj)) {
+		print_object(machine, p, obj);
+		return;
 	}
+	printer_puts(p, "(");
+	print_object(machine, p, obj->pair.car);
+	printer_puts(p, ". ");
+	print_object(machine, p, obj->pair.cdr);
+	printer_puts(p, ") ");
 }
 
+void obj_print(struct Machine *machine, struct Object *obj)
+{
+	/* Into the machine's output, which the caller flushes. */
+	print_object(machine, &machine->out, obj);
+}
@@ -2,7 +2,39 @@
 #define PRINT_H
 
 #include "scheme_forward.h"
+#include <stdbool.h>
+#include <stddef.h>
 
+/*
+ * Output is collected in buf.  A printer with an fd writes buf out
+ * whenever it fills and on printer_flush().  One with fd -1 keeps
+ * everything in buf, which grows, so it builds a string in memory.
+ * stack holds the lists being printed, so nesting doesn't recurse;
+ * the first stackCount entries belong to lists still open around a
+ * vector being printed.  Once buf and stack have grown, printing
+ * allocates nothing.
+ */
+struct Printer {
+	char *buf;
+	size_t count;
+	size_t size;
+	int fd;
+	struct Object **stack;
+	size_t stackCount;
+	size_t stackSize;
+};
+
+void printer_init(struct Printer *p, int fd);
+void printer_free(struct Printer *p);
+bool printer_flush(struct Printer *p);
+void printer_write(struct Printer *p, const char *s, size_t n);
+void printer_puts(struct Printer *p, const char *s);
+void printer_printf(struct Printer *p, const char *fmt, ...);
+void printer_integer(struct Printer *p, long long n);
+void printer_double(struct Printer *p, double d);
+
+void print_object(struct Machine *machine, struct Printer *p,
+		struct Object *obj);
 void obj_print_dotted(struct Machine *machine, struct Object *obj);
 void obj_print(struct Machine *machine, struct Object *obj);
 
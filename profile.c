@@ -0,0 +1,331 @@
+#include "profile.h"
+#include "builtins.h"
+#include "scheme.h"
+#include "symbol.h"
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+/* Initial sizes of the shadow stack and of the samples, in names. */
+#define PROFILE_STACK_SIZE 64
+#define PROFILE_SAMPLE_SIZE (64 * 1024)
+
+/*
+ * The machine SIGPROF samples, and the handler it replaced.  These are
+ * the only state machines share: whichever claims profiled owns both
+ * until it stops.
+ */
+static _Atomic(struct Machine *) profiled;
+static struct sigaction oldAction;
+
+/*
+ * Set on the thread running the profiled machine.  SIGPROF may land on
+ * any thread, and only that one can safely read the shadow stack.
+ */
+static _Thread_local bool profiling;
+
+struct Profile make_profile(void)
+{
+	struct Profile p = {
+		.stack = 0, .stackSize = 0,
+		.samples = 0, .sampleCount = 0, .sampleSize = 0,
+		.dropped = 0
+	};
+	return p;
+}
+
+static void profile_tick(int sig)
+{
+	/*
+	 * Copy the shadow stack, or as much of its top as a sample keeps,
+	 * into the samples.  Whoever grows them has SIGPROF blocked, and
+	 * profile_enter() makes sure there is room, except in a builtin
+	 * that runs long enough to be sampled over and over; then
+	 * samples are dropped.
+	 */
+	struct Machine *m = profiled;
+	if (!m || !profiling)
+		return;
+	struct Profile *p = &m->profile;
+	size_t depth = m->callDepth;
+	if (depth >= p->stackSize)
+		depth = p->stackSize - 1;
+	size_t first = 0;
+	if (depth >= PROFILE_MAX_DEPTH)
+		first = depth + 1 - PROFILE_MAX_DEPTH;
+	size_t frames = depth + 1 - first + (first != 0);
+	if (p->sampleSize - p->sampleCount < frames + 1) {
+		++p->dropped;
+		return;
+	}
+	ptrdiff_t *s = p->samples + p->sampleCount;
+	*s++ = frames;
+	if (first)
+		*s++ = PROFILE_ELIDED;
+	for (size_t i = first; i <= depth; ++i)
+		*s++ = p->stack[i];
+	p->sampleCount += frames + 1;
+}
+
+static void profile_block(sigset_t *old)
+{
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGPROF);
+	pthread_sigmask(SIG_BLOCK, &set, old);
+}
+
+static void profile_unblock(sigset_t *old)
+{
+	pthread_sigmask(SIG_SETMASK, old, 0);
+}
+
+bool profile_reserve(struct Profile *p, size_t depth)
+{
+	/*
+	 * Grow the shadow stack past depth and give the samples their
+	 * reserve.  New stack entries are for frames not yet seen.
+	 */
+	sigset_t old;
+	bool ok = true;
+	profile_block(&old);
+	if (depth >= p->stackSize) {
+		size_t nsize = p->stackSize ? p->stackSize : PROFILE_STACK_SIZE;
+		while (nsize <= depth)
+			nsize *= 2;
+		ptrdiff_t *nstack = realloc(p->stack,
+					nsize * sizeof(*nstack));
+		if (nstack) {
+			for (size_t i = p->stackSize; i != nsize; ++i)
+				nstack[i] = PROFILE_UNKNOWN;
+			p->stack = nstack;
+			p->stackSize = nsize;
+		} else {
+			ok = false;
+		}
+	}
+	if (p->sampleSize - p->sampleCount < PROFILE_RESERVE) {
+		size_t nsize = p->sampleSize ? p->sampleSize * 2
+			: PROFILE_SAMPLE_SIZE;
+		ptrdiff_t *nsamples = realloc(p->samples,
+					nsize * sizeof(*nsamples));
+		if (nsamples) {
+			p->samples = nsamples;
+			p->sampleSize = nsize;
+		} else {
+			ok = false;
+		}
+	}
+	profile_unblock(&old);
+	return ok;
+}
+
+bool profile_start(struct Machine *m, int hz)
+{
+	/*
+	 * The frames already on the stack when profiling starts have no
+	 * names, apart from the top level under them.
+	 */
+	struct Profile *p = &m->profile;
+	struct Machine *none = 0;
+	if (!atomic_compare_exchange_strong(&profiled, &none, m)) {
+		fprintf(stderr, "A machine is already being profiled.\n");
+		return false;
+	}
+	if (!profile_reserve(p, m->callDepth + 1)) {
+		profiled = 0;
+		return false;
+	}
+	p->stack[0] = PROFILE_TOPLEVEL;
+	p->sampleCount = 0;
+	p->dropped = 0;
+	profiling = true;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = profile_tick;
+	sa.sa_flags = SA_RESTART;
+	sigemptyset(&sa.sa_mask);
+	long usec = 1000000 / hz;
+	struct itimerval timer = {
+		.it_interval = {.tv_sec = usec / 1000000,
+				.tv_usec = usec % 1000000},
+		.it_value = {.tv_sec = usec / 1000000,
+			     .tv_usec = usec % 1000000}
+	};
+	if (sigaction(SIGPROF, &sa, &oldAction) == -1) {
+		perror("sigaction");
+		profiling = false;
+		profiled = 0;
+		return false;
+	}
+	if (setitimer(ITIMER_PROF, &timer, 0) == -1) {
+		perror("setitimer");
+		sigaction(SIGPROF, &oldAction, 0);
+		profiling = false;
+		profiled = 0;
+		return false;
+	}
+	return true;
+}
+
+static const char *frame_name(struct Machine *m, ptrdiff_t name)
+{
+	switch (name) {
+	case PROFILE_LAMBDA:
+		return "lambda";
+	case PROFILE_TOPLEVEL:
+		return "toplevel";
+	case PROFILE_UNKNOWN:
+		return "?";
+	case PROFILE_ELIDED:
+		return "...";
+	}
+	return symbol_name(&m->symbols, name);
+}
+
+static int compare_lines(const void *a, const void *b)
+{
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static bool write_folded(struct Machine *m, FILE *out, size_t *count)
+{
+	/*
+	 * Spell each sample out as a line, then sort the lines so that
+	 * equal stacks are next to each other and can be counted.
+	 */
+	struct Profile *p = &m->profile;
+	size_t n = 0;
+	for (size_t i = 0; i != p->sampleCount; i += p->samples[i] + 1)
+		++n;
+	char **lines = malloc((n ? n : 1) * sizeof(*lines));
+	if (!lines)
+		return false;
+	bool ok = true;
+	size_t k = 0;
+	for (size_t i = 0; ok && i != p->sampleCount;
+	     i += p->samples[i] + 1) {
+		struct String line = make_string();
+		for (ptrdiff_t j = 0; ok && j != p->samples[i]; ++j) {
+			const char *name = frame_name(m, p->samples[i + 1 + j]);
+			if (j)
+				ok = string_append(&line, ';');
+			for (; ok && *name; ++name)
+				ok = string_append(&line, *name);
+		}
+		ok = ok && string_append(&line, '\0');
+		lines[k++] = line.cstr;
+	}
+	if (ok) {
+		qsort(lines, n, sizeof(*lines), compare_lines);
+		for (size_t i = 0; i != n;) {
+			size_t j = i + 1;
+			while (j != n && !strcmp(lines[i], lines[j]))
+				++j;
+			fprintf(out, "%s %zu\n", lines[i], j - i);
+			i = j;
+		}
+	}
+	for (size_t i = 0; i != k; ++i)
+		free(lines[i]);
+	free(lines);
+	*count = n;
+	return ok;
+}
+
+static void profile_disarm(void)
+{
+	struct itimerval off;
+	memset(&off, 0, sizeof(off));
+	setitimer(ITIMER_PROF, &off, 0);
+	sigaction(SIGPROF, &oldAction, 0);
+	profiling = false;
+	profiled = 0;
+}
+
+void profile_cancel(struct Machine *m)
+{
+	/* Stop sampling m, if it is being sampled, and drop the samples. */
+	if (profiled == m)
+		profile_disarm();
+	free(m->profile.stack);
+	free(m->profile.samples);
+	m->profile = make_profile();
+}
+
+long profile_stop(struct Machine *m, const char *path)
+{
+	/*
+	 * Stop sampling and write the samples to path.  Returns how many
+	 * there were, or -1 if they could not be written.
+	 */
+	struct Profile *p = &m->profile;
+	if (profiled != m) {
+		fprintf(stderr, "The profiler isn't running.\n");
+		return -1;
+	}
+	profile_disarm();
+
+	size_t count = 0;
+	FILE *out = fopen(path, "w");
+	bool ok = out != 0;
+	if (!out)
+		perror(path);
+	else if (!write_folded(m, out, &count)) {
+		fprintf(stderr, "Out of memory writing the profile.\n");
+		ok = false;
+	}
+	if (out && fclose(out) == EOF) {
+		perror(path);
+		ok = false;
+	}
+	if (p->dropped)
+		fprintf(stderr, "The profiler dropped %zu samples.\n",
+			p->dropped);
+	profile_cancel(m);
+	return ok ? (long)count : -1;
+}
+
+struct Object *mprofile_start(struct Machine *m, struct Object *args)
+{
+	/* (profile-start [hz]) */
+	int hz = PROFILE_HZ;
+	if (!obj_is_nil(args)) {
+		struct Object *arg0 = car(args);
+		if (obj_type(arg0) != TypeInteger || obj_integer(arg0) <= 0
+		    || obj_integer(arg0) > 1000000) {
+			fprintf(stderr, "profile-start wants a rate in samples"
+				" per second.\n");
+			return create_error_object(m);
+		}
+		hz = obj_integer(arg0);
+	}
+	if (!profile_start(m, hz))
+		return create_error_object(m);
+	return truth(m, true);
+}
+
+struct Object *mprofile_stop(struct Machine *m, struct Object *args)
+{
+	/* (profile-stop path) writes folded stacks and returns the count. */
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeString) {
+		fprintf(stderr, "profile-stop wants a path.\n");
+		return create_error_object(m);
+	}
+	struct StringSlice s = arg0->string;
+	char *path = malloc(s.length + 1);
+	if (!path)
+		return 0;
+	memcpy(path, string_slice_chars(s), s.length);
+	path[s.length] = '\0';
+	long count = profile_stop(m, path);
+	free(path);
+	if (count == -1)
+		return create_error_object(m);
+	return create_integer_object(m, count);
+}
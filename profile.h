@@ -0,0 +1,74 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "scheme_forward.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A sampling profiler for Scheme code.  While it runs, the VM keeps a
+ * shadow stack holding the name of the closure active at each call
+ * depth, and a SIGPROF handler copies the stack into samples.  Names
+ * are symbol ids or one of the negative values below.  profile_stop()
+ * writes the samples as folded stacks, an "outer;...;inner count" line
+ * for each distinct stack, which is what flame graph tools read.
+ * SIGPROF goes to the whole process, so only one machine at a time
+ * can be profiled, and only the samples that land on the thread that
+ * started the profiler are kept.  Resuming a continuation can leave
+ * the names of the frames it restores stale until they return.
+ */
+
+#define PROFILE_LAMBDA (-1)	/* a closure no define named */
+#define PROFILE_TOPLEVEL (-2)	/* top-level code */
+#define PROFILE_UNKNOWN (-3)	/* entered before profiling started */
+#define PROFILE_ELIDED (-4)	/* stands for frames left out */
+
+/* A sample keeps at most this many of the innermost frames. */
+#define PROFILE_MAX_DEPTH 256
+
+/* Samples per second of CPU time unless asked otherwise. */
+#define PROFILE_HZ 1000
+
+/*
+ * samples holds, for each sample, its frame count followed by that
+ * many names, outermost first.  Both arrays only change size with
+ * SIGPROF blocked; stack is null when the profiler is off.
+ */
+struct Profile {
+	ptrdiff_t *stack;
+	size_t stackSize;
+	ptrdiff_t *samples;
+	size_t sampleCount;
+	size_t sampleSize;
+	size_t dropped;
+};
+
+struct Profile make_profile(void);
+bool profile_start(struct Machine *m, int hz);
+long profile_stop(struct Machine *m, const char *path);
+void profile_cancel(struct Machine *m);
+bool profile_reserve(struct Profile *p, size_t depth);
+struct Object *mprofile_start(struct Machine *m, struct Object *args);
+struct Object *mprofile_stop(struct Machine *m, struct Object *args);
+
+/* Samples must have this much room after any call; see profile_enter(). */
+#define PROFILE_RESERVE (4 * (PROFILE_MAX_DEPTH + 2))
+
+static inline void profile_enter(struct Profile *p, size_t depth,
+				ptrdiff_t name)
+{
+	/*
+	 * Name the activation at depth, before it becomes the top of the
+	 * stack.  The fence keeps the compiler from moving the store past
+	 * the VM's update of callDepth, which the handler reads.
+	 */
+	if ((depth >= p->stackSize
+	     || p->sampleSize - p->sampleCount < PROFILE_RESERVE)
+	    && !profile_reserve(p, depth))
+		return;
+	p->stack[depth] = name;
+	atomic_signal_fence(memory_order_seq_cst);
+}
+
+#endif
@@ -1,4 +1,6 @@
 #include "base.h"
+#include "bignum.h"
+#include "gc.h"
 #include "read.h"
 #include "scheme.h"
 #include <assert.h>
@@ -53,18 +55,6 @@ bool is_quote_end(char c)
 	return c == '"';
 }
 
-bool is_list_start(struct String word)
-{
-	/* NOTE: '\0' included in count. */
-	return word.count == 2 && word.cstr[0] == '(';
-}
-
-bool is_list_end(struct String word)
-{
-	/* NOTE: '\0' included in count. */
-	return word.count == 2 && word.cstr[0] == ')';
-}
-
 int file_getc(void *context)
 {
 	struct FileGetCharContext *ctx = (struct FileGetCharContext*)context;
@@ -97,14 +87,17 @@ int readline_getc(void *context)
 		return ctx->unget;
 	}
 	while (ctx->line == 0 || ctx->pos >= ctx->len) {
-		if (ctx->line)
-			free(ctx->line);
+		free(ctx->line);
+		ctx->line = 0;
 		ctx->len = 0;
 		ctx->pos = 0;
 		char *nline = readline(ctx->prompt);
 		if (!nline)
 			return EOF;
 		ctx->line = strdup2(nline, "\n");
+		free(nline);
+		if (!ctx->line)
+			return EOF;
 		add_history(ctx->line);
 		ctx->len = strlen(ctx->line);
 	}
@@ -124,186 +117,407 @@ int readline_ungetc(int c, void *context)
 	}
 }
 
-struct String read_word(getcFunc getcFunc, ungetcFunc ungetcFunc, void *context)
+void reader_init(struct Reader *reader, getcFunc getcFunc,
+		ungetcFunc ungetcFunc, void *context)
+{
+	reader->getcFunc = getcFunc;
+	reader->ungetcFunc = ungetcFunc;
+	reader->context = context;
+	reader->pos = reader->end = 0;
+	reader->token = make_string();
+	reader->eof = false;
+}
+
+void reader_init_buffer(struct Reader *reader, const char *buf, size_t len)
+{
+	/* buf must outlive the reader; nothing read keeps pointers into it. */
+	reader_init(reader, 0, 0, 0);
+	reader->pos = buf;
+	reader->end = buf + len;
+}
+
+void reader_free(struct Reader *reader)
+{
+	free(reader->token.cstr);
+	reader->token = make_string();
+}
+
+static inline int reader_getc(struct Reader *r)
+{
+	/* A stream reader's buffer is always empty. */
+	if (r->pos != r->end)
+		return (unsigned char)*r->pos++;
+	if (!r->getcFunc)
+		return EOF;
+	return r->getcFunc(r->context);
+}
+
+static inline void reader_ungetc(struct Reader *r, int c)
+{
+	if (r->getcFunc)
+		r->ungetcFunc(c, r->context);
+	else
+		--r->pos;
+}
+
+enum Token {
+	TokenAtom,
+	TokenOpen,
+	TokenVector,
+	TokenClose,
+	TokenEnd,
+	TokenError
+};
+
+static enum Token read_token(struct Reader *r)
 {
+	/*
+	 * Reads the next token.  An atom's text is left NUL-terminated in
+	 * r->token, which is reused from one token to the next, with any
+	 * escapes in a string already resolved.
+	 */
 	enum { normal, quote, quoteEscape } mode = normal;
+	struct String *tok = &r->token;
+	int c;
 
-	struct String str = make_string();
-	while (1) {
-		int c = getcFunc(context);
-		if (c == EOF)
-			goto out_str;
+	tok->count = 0;
+	do {
+		c = reader_getc(r);
+	} while (c != EOF && is_filler(c));
+	if (c == EOF) {
+		r->eof = true;
+		return TokenEnd;
+	}
+	if (c == '(')
+		return TokenOpen;
+	if (c == ')')
+		return TokenClose;
+	if (c == '#') {
+		/* "#(" opens a vector; any other '#' starts an atom. */
+		int next = reader_getc(r);
+		if (next == '(')
+			return TokenVector;
+		if (next != EOF)
+			reader_ungetc(r, next);
+	}
+	if (is_self_delimited(c))
+		goto out_char;
+	for (; c != EOF; c = reader_getc(r)) {
 		switch (mode) {
 		case normal:
-			// Skip space at the beginning
-			if (!str.count && is_filler(c))
-				continue;
-			// Ensure '(' and ')' form their own words.
+			// Ensure '(' and ')' form their own tokens.
 			if (is_self_delimited(c)) {
-				if (str.count)
-					if (ungetcFunc(c, context) == EOF)
-						goto out_no_str;
-					else
-						goto out_str;
-				else {
-					string_append(&str, c);
-					goto out_str;
-				}
+				reader_ungetc(r, c);
+				goto out;
 			}
 			if (is_delimiter(c))
-				goto out_str;
-			string_append(&str, c);;
+				goto out;
+			if (!string_append(tok, c))
+				return TokenError;
 			if (is_quote_start(c))
 				mode = quote;
-			else if (is_delimiter(c))
-				goto out_str;
 			break;
 		case quote:
 			if ((char)c == '\\') {
 				mode = quoteEscape;
 			} else {
-				string_append(&str, c);
+				if (!string_append(tok, c))
+					return TokenError;
 				if (is_quote_end(c))
 					mode = normal;
 			}
 			break;
 		case quoteEscape:
-			string_append(&str, quote_escape(c));
+			if (!string_append(tok, quote_escape(c)))
+				return TokenError;
 			mode = quote;
 			break;
 		default:
 			assert(0);
 		}
 	}
-out_str:
-	string_append(&str, '\0');
-out_no_str:
-	return str;
+	r->eof = true;
+	goto out;
+out_char:
+	if (!string_append(tok, c))
+		return TokenError;
+out:
+	return string_append(tok, '\0') ? TokenAtom : TokenError;
 }
 
+static struct Object *read_datum(struct Machine *machine, struct Reader *r,
+				enum Token token);
 
-struct StringArray read_expression(getcFunc getcFunc, ungetcFunc ungetcFunc,
-				void *context)
+static struct Object *read_list(struct Machine *machine, struct Reader *r)
 {
-	/*
-	 * Reads text of a complete expression.
-	 * Complete here means balanced parentheses.
-	 */
-
-	int countOpen = 0;
-	int countClose = 0;
-	struct StringArray words = make_string_array();
-
+	/* The rest of a list whose '(' has been read. */
+	struct Object *first = create_pair_object(machine, 0, 0);
+	if (!first)
+		return first;
+	size_t roots = gc_roots_save(machine);
+	gc_push_root(machine, &first);
+	struct Object *into = first;
 	while (true) {
-		if (words.count && countOpen == countClose)
-			return words;
-		struct String nextWord = read_word(getcFunc,
-						ungetcFunc, context);
-		if (!nextWord.cstr)
-			return make_string_array();
-		if (is_list_start(nextWord))
-			++countOpen;
-		else if (is_list_end(nextWord))
-			++countClose;
-		if (!string_array_append(&words, nextWord))
-			return make_string_array();
+		enum Token token = read_token(r);
+		if (token == TokenClose)
+			break;
+		if (token == TokenEnd || token == TokenError) {
+			first = 0;
+			break;
+		}
+		into->pair.car = read_datum(machine, r, token);
+		if (!into->pair.car) {
+			first = 0;
+			break;
+		}
+		gc_write_barrier(machine, into);
+		into->pair.cdr = create_pair_object(machine, 0, 0);
+		if (!into->pair.cdr) {
+			first = 0;
+			break;
+		}
+		gc_write_barrier(machine, into);
+		into = into->pair.cdr;
 	}
+	gc_roots_restore(machine, roots);
+	return first;
 }
 
-struct Object *read_list(struct Machine *machine, struct StringArray *words,
-			ptrdiff_t *pos);
+static bool is_digit(char c)
+{
+	return c >= '0' && c <= '9';
+}
 
-struct Object *read_non_list(struct Machine *machine, struct String word);
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
 
-struct Object *read_scheme(struct Machine *machine, struct StringArray *words)
+static double decimal_slow(const char *s, const char *end)
 {
 	/*
-	 * Create a scheme object from a list of word strings.
-	 * Takes ownership of the words and clears the array.
+	 * strtod() rounds correctly, but the decimal point it wants
+	 * depends on the locale.  So it gets the digits without the point
+	 * and an exponent adjusted to match.  s has already been checked
+	 * to be a decimal number.
 	 */
-
-	if (!words->count) {
-		free_string_array_shallow(words);
+	char local[128];
+	size_t size = (end - s) + 32;
+	char *buf = size <= sizeof(local) ? local : malloc(size);
+	if (!buf)
 		return 0;
+	char *q = buf;
+	long exp = 0;
+	bool frac = false;
+	const char *p = s;
+	for (; p != end && *p != 'e' && *p != 'E'; ++p) {
+		if (*p == '.') {
+			frac = true;
+			continue;
+		}
+		*q++ = *p;
+		if (frac)
+			--exp;
 	}
-	struct String word = words->strs[0];
-	if (is_list_start(word)) {
-		free(word.cstr);
-		ptrdiff_t pos = 1;
-		struct Object *obj = read_list(machine, words, &pos);
-		free_string_array_shallow(words);
-		return obj;
-	}
-	else {
-		free_string_array_shallow(words);
-		return read_non_list(machine, word);
+	if (p != end) {
+		bool neg = *++p == '-';
+		if (*p == '-' || *p == '+')
+			++p;
+		long e = 0;
+		for (; p != end; ++p) {
+			if (e < 100000000)
+				e = e * 10 + (*p - '0');
+		}
+		exp += neg ? -e : e;
 	}
+	snprintf(q, buf + size - q, "e%ld", exp);
+	double d = strtod(buf, 0);
+	if (buf != local)
+		free(buf);
+	return d;
 }
 
-struct Object *read_list(struct Machine *machine, struct StringArray *words,
-			ptrdiff_t *pos)
+static enum Type read_number(const char *s, const char *end, int64_t *ip,
+			double *dp)
 {
-	struct Object *first = create_pair_object(machine, 0, 0);
-	if (!first)
-		return first;
-	struct Object *into = first;
-	while (*pos < words->count) {
-		struct String word = words->strs[*pos];
-		++*pos;
-		if (is_list_end(word)) {
-			free(word.cstr);
-			return first;
-		} else if (is_list_start(word)) {
-			free(word.cstr);
-			into->pair.car = read_list(machine, words, pos);
-		} else {
-			into->pair.car = read_non_list(machine, word);
+	/*
+	 * Classifies and converts a token in one pass.  Numbers are an
+	 * optional sign and then either 0x and hex digits, or decimal
+	 * digits with an optional fraction and exponent.  Those with a
+	 * fraction or exponent are doubles.  Integers too big for 64 bits
+	 * are TypeBignum, left for integer_parse().  Anything else is a
+	 * symbol.
+	 *
+	 * Up to 19 significant digits are kept in an integer.  When those
+	 * are all the digits, and both they and the power of ten are exact
+	 * as doubles, one multiplication or division rounds correctly.
+	 * Other doubles go through decimal_slow().
+	 */
+	static const double powers[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+		1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20,
+		1e21, 1e22
+	};
+	const char *p = s;
+	bool neg = false;
+	if (p != end && (*p == '+' || *p == '-'))
+		neg = *p++ == '-';
+
+	if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		uint64_t mant = 0;
+		bool big = false;
+		for (p += 2; p != end; ++p) {
+			int v = hex_digit(*p);
+			if (v < 0)
+				return TypeSymbol;
+			if (mant >> 60)
+				big = true;
+			mant = mant << 4 | v;
 		}
-		into->pair.cdr = create_pair_object(machine, 0, 0);
-		if (!into->pair.cdr)
-			return 0;
-		into = into->pair.cdr;
+		if (!big && mant <= (uint64_t)INT64_MAX + neg) {
+			*ip = neg ? (int64_t)(0 - mant) : (int64_t)mant;
+			return TypeInteger;
+		}
+		return TypeBignum;
 	}
-	assert(0);
-	return 0;
-}
 
-enum Type deduce_type(struct String word)
-{
-	if (word.cstr[0] == '\"') {
-		return TypeString;
+	uint64_t mant = 0;
+	int digits = 0;
+	int exp = 0;
+	bool inexact = false;
+	bool isDouble = false;
+	bool any = false;
+	for (; p != end && is_digit(*p); ++p) {
+		any = true;
+		if (digits < 19) {
+			mant = mant * 10 + (*p - '0');
+			digits += mant != 0;
+		} else {
+			++exp;
+			inexact = true;
+		}
+	}
+	if (p != end && *p == '.') {
+		isDouble = true;
+		for (++p; p != end && is_digit(*p); ++p) {
+			any = true;
+			if (digits < 19) {
+				mant = mant * 10 + (*p - '0');
+				digits += mant != 0;
+				--exp;
+			} else if (*p != '0') {
+				inexact = true;
+			}
+		}
 	}
-	else if (strchr("0123456789+-.", word.cstr[0])) {
-		if (!strpbrk(word.cstr, "01234567890")) {
-			/* "+", "-" should be symbols */
+	if (!any)
+		return TypeSymbol;
+	if (p != end && (*p == 'e' || *p == 'E')) {
+		isDouble = true;
+		bool eneg = false;
+		++p;
+		if (p != end && (*p == '+' || *p == '-'))
+			eneg = *p++ == '-';
+		if (p == end)
 			return TypeSymbol;
-		} else if (strpbrk(word.cstr, ".eE")) {
-			return TypeDouble;
-		} else {
-			return TypeInteger;
+		int e = 0;
+		for (; p != end && is_digit(*p); ++p) {
+			if (e < 100000)
+				e = e * 10 + (*p - '0');
 		}
+		exp += eneg ? -e : e;
 	}
-	return TypeSymbol;
+	if (p != end)
+		return TypeSymbol;
+
+	if (!isDouble) {
+		if (inexact || mant > (uint64_t)INT64_MAX + neg)
+			return TypeBignum;
+		*ip = neg ? (int64_t)(0 - mant) : (int64_t)mant;
+		return TypeInteger;
+	}
+	if (!inexact && mant <= (1ULL << 53) && exp >= -22 && exp <= 22) {
+		double d = mant;
+		d = exp < 0 ? d / powers[-exp] : d * powers[exp];
+		*dp = neg ? -d : d;
+	} else {
+		*dp = decimal_slow(s, end);
+	}
+	return TypeDouble;
 }
 
-struct Object *read_non_list(struct Machine *machine, struct String word)
+static struct Object *read_atom(struct Machine *machine, struct String *word)
 {
-	size_t n;
-	switch (deduce_type(word)) {
+	/* word is NUL-terminated, and its count includes the NUL. */
+	size_t n = word->count - 1;
+	int64_t integer;
+	double dbl;
+	enum Type type = TypeSymbol;
+	char c = word->cstr[0];
+	if (c == '\"')
+		type = TypeString;
+	else if (is_digit(c) || c == '+' || c == '-' || c == '.')
+		type = read_number(word->cstr, word->cstr + n, &integer, &dbl);
+	switch (type) {
 	case TypeSymbol:
-		return create_symbol_object(machine, word);
+		return create_symbol_object_n(machine, word->cstr, n);
 	case TypeString:
-		// Get rid of parentheses.
-		n = strlen(word.cstr);
-		memmove(word.cstr, word.cstr + 1, n - 2);
-		word.cstr[n - 2] = '\0';
-		return create_string_object(machine, word);
+		// Get rid of the quotes.
+		n = n >= 2 ? n - 2 : 0;
+		return create_string_object(machine, word->cstr + 1, n);
 	case TypeInteger:
-		return create_integer_object(machine, atoi(word.cstr));
+		return create_integer_object(machine, integer);
 	case TypeDouble:
-		return create_double_object(machine, atof(word.cstr));
+		return create_double_object(machine, dbl);
+	case TypeBignum:
+		return integer_parse(machine, word->cstr, word->cstr + n);
 	default:
 		assert(0);
 	}
 	return 0;
 }
+
+static struct Object *read_datum(struct Machine *machine, struct Reader *r,
+				enum Token token)
+{
+	struct Object *list, *vec;
+	size_t roots;
+	switch (token) {
+	case TokenAtom:
+		return read_atom(machine, &r->token);
+	case TokenOpen:
+		return read_list(machine, r);
+	case TokenVector:
+		list = read_list(machine, r);
+		if (!list)
+			return 0;
+		roots = gc_roots_save(machine);
+		gc_push_root(machine, &list);
+		vec = create_vector_from_list(machine, list);
+		gc_roots_restore(machine, roots);
+		return vec;
+	default:
+		return 0;
+	}
+}
+
+struct Object *read_scheme(struct Machine *machine, struct Reader *reader)
+{
+	/*
+	 * Reads one expression, building its objects as its tokens are
+	 * read.  Returns 0 at the end of input, and reader->eof is then set,
+	 * or on failure.
+	 */
+	enum Token token = read_token(reader);
+	while (token == TokenClose) {
+		fprintf(stderr, "Unbalanced ).\n");
+		token = read_token(reader);
+	}
+	return read_datum(machine, reader, token);
+}
@@ -34,10 +34,27 @@ int readline_ungetc(int c, void *context);  // Use FileGetcContext
 
 
 
-struct StringArray read_expression(getcFunc getcFunc, ungetcFunc ungetcFunc,
-				void *context);
-struct Object *read_scheme(struct Machine *machine,
-			struct StringArray *words);
+/*
+ * Reads expressions in one pass, building objects as it goes.  The
+ * characters come either from getcFunc or, with no getcFunc, straight
+ * from the buffer between pos and end.  token is reused for the text
+ * of every token.
+ */
+struct Reader {
+	getcFunc getcFunc;
+	ungetcFunc ungetcFunc;
+	void *context;
+	const char *pos;
+	const char *end;
+	struct String token;
+	bool eof;
+};
+
+void reader_init(struct Reader *reader, getcFunc getcFunc,
+		ungetcFunc ungetcFunc, void *context);
+void reader_init_buffer(struct Reader *reader, const char *buf, size_t len);
+void reader_free(struct Reader *reader);
+struct Object *read_scheme(struct Machine *machine, struct Reader *reader);
 
 
 #endif
@@ -0,0 +1,195 @@
+#include "record.h"
+#include "builtins.h"
+#include "env.h"
+#include "gc.h"
+#include "scheme.h"
+#include "symbol.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Records keep their fields in a slot array, inline for small ones, so
+ * a record is one allocation and reading a field is one load.  The
+ * procedures define-record-type makes are RecordProc objects, which
+ * the VM applies to the arguments on its stack as it does builtins,
+ * but without first making them into a list.
+ */
+
+static const char *proc_name(struct Machine *m, struct Object *proc)
+{
+	return symbol_name(&m->symbols, proc->recordProc.name->symbol);
+}
+
+static bool record_of(struct Object *obj, struct Object *type)
+{
+	return obj && obj_type(obj) == TypeRecord && obj->record.type == type;
+}
+
+static struct Object *record_make(struct Machine *m, struct Object *proc,
+				struct Object **args, int n)
+{
+	/* Fields the constructor does not take start as (). */
+	struct RecordProc *p = &proc->recordProc;
+	if ((size_t)n != p->count) {
+		fprintf(stderr, "%s takes %zu arguments.\n", proc_name(m, proc),
+			p->count);
+		return create_error_object(m);
+	}
+	struct Object *fill = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &fill);
+	if (p->count != p->type->recordType.count)
+		fill = create_pair_object(m, 0, 0);
+	struct Object *rec = 0;
+	if (fill || p->count == p->type->recordType.count)
+		rec = create_record_object(m, p->type, fill);
+	gc_roots_restore(m, roots);
+	if (!rec)
+		return 0;
+	for (size_t i = 0; i != p->count; ++i)
+		rec->record.slots[p->order[i]] = args[i];
+	return rec;
+}
+
+struct Object *record_apply(struct Machine *m, struct Object *proc,
+			struct Object **args, int n)
+{
+	/* args are on the VM stack, so they are rooted. */
+	struct RecordProc *p = &proc->recordProc;
+	const char *typeName;
+	switch (p->op) {
+	case RecordMake:
+		return record_make(m, proc, args, n);
+	case RecordTest:
+		if (n != 1) {
+			fprintf(stderr, "%s takes one argument.\n",
+				proc_name(m, proc));
+			return create_error_object(m);
+		}
+		return truth(m, record_of(args[0], p->type));
+	case RecordGet:
+		if (n == 1 && record_of(args[0], p->type))
+			return args[0]->record.slots[p->index];
+		break;
+	case RecordSet:
+		if (n == 2 && record_of(args[0], p->type)) {
+			args[0]->record.slots[p->index] = args[1];
+			gc_write_barrier(m, args[0]);
+			return create_pair_object(m, 0, 0);
+		}
+		break;
+	}
+	typeName = symbol_name(&m->symbols,
+			p->type->recordType.name->symbol);
+	fprintf(stderr, "%s wants a %s%s.\n", proc_name(m, proc), typeName,
+		p->op == RecordSet ? " and a value" : "");
+	return create_error_object(m);
+}
+
+static bool symbol_p(struct Object *obj)
+{
+	return obj && obj_type(obj) == TypeSymbol;
+}
+
+static bool symbol_list(struct Object *list, size_t min, size_t max)
+{
+	/* A proper list of between min and max symbols. */
+	size_t n = 0;
+	for (; obj_type(list) == TypePair && !obj_is_nil(list);
+	     list = cdr(list)) {
+		if (!symbol_p(car(list)) || ++n > max)
+			return false;
+	}
+	return obj_is_nil(list) && n >= min;
+}
+
+static size_t field_index(struct Object *specs, struct Object *end,
+			ptrdiff_t sym)
+{
+	/* The index of the field sym among specs up to end, or SIZE_MAX. */
+	size_t i = 0;
+	for (; specs != end && !obj_is_nil(specs); specs = cdr(specs), ++i) {
+		if (car(car(specs))->symbol == sym)
+			return i;
+	}
+	return SIZE_MAX;
+}
+
+static struct Object *define_proc(struct Machine *m, enum RecordOp op,
+				struct Object *type, struct Object *name,
+				size_t index)
+{
+	/* type is rooted by the caller; once defined, so is the result. */
+	struct Object *proc = create_record_proc_object(m, op, type, name,
+							index);
+	return proc && global_define(m, name->symbol, proc) ? proc : 0;
+}
+
+struct Object *define_record_type(struct Machine *m, struct Object *args)
+{
+	/*
+	 * (define-record-type name (constructor field ...) predicate
+	 *  (field accessor [modifier]) ...) binds name to the new type
+	 * and the other names to its procedures.  Fields get slots in the
+	 * order they are listed.
+	 */
+	struct Object *it = args;
+	size_t n = 0;
+	for (; obj_type(it) == TypePair && !obj_is_nil(it); it = cdr(it))
+		++n;
+	if (!obj_is_nil(it) || n < 3 || !symbol_p(car(args))
+	    || !symbol_list(cadr(args), 1, SIZE_MAX)
+	    || !symbol_p(car(cdr(cdr(args))))) {
+		fprintf(stderr, "define-record-type wants a name, a constructor"
+			" with its fields and a predicate.\n");
+		return create_error_object(m);
+	}
+	struct Object *specs = cdr(cdr(cdr(args)));
+	size_t count = 0;
+	for (it = specs; !obj_is_nil(it); it = cdr(it), ++count) {
+		if (!symbol_list(car(it), 2, 3)
+		    || field_index(specs, it, car(car(it))->symbol)
+			!= SIZE_MAX) {
+			fprintf(stderr, "define-record-type wants distinct"
+				" (field accessor [modifier]) lists.\n");
+			return create_error_object(m);
+		}
+	}
+	struct Object *ctor = cadr(args);
+	for (it = cdr(ctor); !obj_is_nil(it); it = cdr(it)) {
+		if (field_index(specs, 0, car(it)->symbol) == SIZE_MAX
+		    || names_search(cdr(it), car(it)->symbol) != -1) {
+			fprintf(stderr, "define-record-type's constructor"
+				" wants distinct fields of the type.\n");
+			return create_error_object(m);
+		}
+	}
+
+	struct Object *type = 0;
+	struct Object *proc = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &args);
+	gc_push_root(m, &type);
+	bool ok = (type = create_record_type_object(m, car(args), count))
+		&& global_define(m, car(args)->symbol, type)
+		&& (proc = define_proc(m, RecordMake, type, car(ctor), 0))
+		&& define_proc(m, RecordTest, type, car(cdr(cdr(args))), 0);
+	if (ok) {
+		struct RecordProc *p = &proc->recordProc;
+		p->order = malloc((count ? count : 1) * sizeof(*p->order));
+		ok = p->order != 0;
+		for (it = cdr(ctor); ok && !obj_is_nil(it); it = cdr(it))
+			p->order[p->count++] = field_index(specs, 0,
+							car(it)->symbol);
+	}
+	size_t i = 0;
+	for (it = specs; ok && !obj_is_nil(it); it = cdr(it), ++i) {
+		struct Object *spec = cdr(car(it));
+		ok = define_proc(m, RecordGet, type, car(spec), i)
+			&& (obj_is_nil(cdr(spec))
+			    || define_proc(m, RecordSet, type, cadr(spec), i));
+	}
+	gc_roots_restore(m, roots);
+	return ok ? create_pair_object(m, 0, 0) : 0;
+}
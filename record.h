@@ -0,0 +1,46 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "scheme_forward.h"
+#include <stddef.h>
+
+/* What define-record-type made: a name and how many fields. */
+struct RecordType {
+	struct Object *name;
+	size_t count;
+};
+
+/* An instance of type, with one slot per field in definition order. */
+struct Record {
+	struct Object *type;
+	size_t count;
+	struct Object **slots;
+};
+
+enum RecordOp {
+	RecordMake,
+	RecordTest,
+	RecordGet,
+	RecordSet
+};
+
+/*
+ * A constructor, predicate, accessor or modifier of type, called by
+ * the VM with its arguments straight off the stack.  An accessor or
+ * modifier works on slot index.  A constructor takes count arguments
+ * and puts the i-th in slot order[i].
+ */
+struct RecordProc {
+	enum RecordOp op;
+	struct Object *type;
+	struct Object *name;
+	size_t index;
+	size_t count;
+	size_t *order;
+};
+
+struct Object *record_apply(struct Machine *m, struct Object *proc,
+			struct Object **args, int n);
+struct Object *define_record_type(struct Machine *m, struct Object *args);
+
+#endif
@@ -2,75 +2,252 @@
 #include "builtins.h"
 #include "env.h"
 #include "eval.h"
+#include "gc.h"
+#include "numvec.h"
 #include "read.h"
 #include "scheme.h"
+#include "slab.h"
+#include "strops.h"
+#include "symbol.h"
+#include "vm.h"
 #include <assert.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
-struct Object *alloc_object(struct Machine *machine)
+size_t object_size(enum Type type)
+{
+	/* Just the header plus the union member the type uses. */
+	size_t head = offsetof(struct Object, pair);
+	switch (type) {
+	case TypeSymbol:
+		return head + sizeof(ptrdiff_t);
+	case TypeString:
+	case TypeStringBuilder:
+		return head + sizeof(struct StringSlice);
+	case TypeInteger:
+		return head + sizeof(int64_t);
+	case TypeDouble:
+		return head + sizeof(double);
+	case TypePair:
+		return head + sizeof(struct Pair);
+	case TypeBuiltinForm:
+		return head + sizeof(struct BuiltinForm);
+	case TypeBuiltinFunc:
+		return head + sizeof(struct BuiltinFunc);
+	case TypeError:
+		return head + sizeof(struct Object *); /* Room for nextFree. */
+	case TypeClosure:
+		return head + sizeof(struct Closure);
+	case TypeFrame:
+		return head + sizeof(struct Frame); /* Not counting slots. */
+	case TypeGlobalRef:
+		return head + sizeof(struct GlobalRef);
+	case TypeCode:
+		return head + sizeof(struct Code);
+	case TypeChunk:
+		return head + sizeof(struct Chunk);
+	case TypeContinuation:
+		return head + sizeof(struct Continuation);
+	case TypeBignum:
+		return head + sizeof(struct Bignum);
+	case TypeVector:
+		return head + sizeof(struct Vector);
+	case TypeF64Vector:
+	case TypeS64Vector:
+		return head + sizeof(struct NumVector);
+	case TypeHashTable:
+		return head + sizeof(struct HashTable);
+	case TypeHamt:
+		return head + sizeof(struct Hamt);
+	case TypeHamtNode:
+		return head + sizeof(struct HamtNode); /* Not counting slots. */
+	case TypeRecordType:
+		return head + sizeof(struct RecordType);
+	case TypeRecord:
+		return head + sizeof(struct Record); /* Not counting slots. */
+	case TypeRecordProc:
+		return head + sizeof(struct RecordProc);
+	}
+	assert(0);
+	return 0;
+}
+
+const char *type_name(enum Type type)
+{
+	switch (type) {
+	case TypeSymbol:
+		return "symbol";
+	case TypeString:
+		return "string";
+	case TypeInteger:
+		return "integer";
+	case TypeDouble:
+		return "double";
+	case TypePair:
+		return "pair";
+	case TypeBuiltinForm:
+		return "builtin-form";
+	case TypeBuiltinFunc:
+		return "builtin-func";
+	case TypeError:
+		return "error";
+	case TypeClosure:
+		return "closure";
+	case TypeFrame:
+		return "frame";
+	case TypeGlobalRef:
+		return "global-ref";
+	case TypeCode:
+		return "code";
+	case TypeChunk:
+		return "chunk";
+	case TypeContinuation:
+		return "continuation";
+	case TypeBignum:
+		return "bignum";
+	case TypeVector:
+		return "vector";
+	case TypeF64Vector:
+		return "f64vector";
+	case TypeS64Vector:
+		return "s64vector";
+	case TypeStringBuilder:
+		return "string-builder";
+	case TypeHashTable:
+		return "hash-table";
+	case TypeHamt:
+		return "hamt";
+	case TypeHamtNode:
+		return "hamt-node";
+	case TypeRecordType:
+		return "record-type";
+	case TypeRecord:
+		return "record";
+	case TypeRecordProc:
+		return "record-procedure";
+	}
+	assert(0);
+	return 0;
+}
+
+enum Type slab_class_type(size_t cls)
 {
 	/*
-	 * Centralize this so that later we can keep track of them and
-	 * add garbage collection.
+	 * The type of the objects in a slab class.  The classes past the
+	 * per-type ones hold frames, HAMT nodes and records with their
+	 * slots inline, in that order.
 	 */
-	return malloc(sizeof(struct Object));
+	if (cls < TYPE_COUNT)
+		return cls;
+	cls -= TYPE_COUNT;
+	if (cls < FRAME_INLINE_SLOTS)
+		return TypeFrame;
+	cls -= FRAME_INLINE_SLOTS;
+	return cls < HAMT_INLINE_SLOTS / 2 ? TypeHamtNode : TypeRecord;
+}
+
+struct Object *alloc_object(struct Machine *machine, enum Type type)
+{
+	/*
+	 * Every object comes from here so that the collector knows
+	 * about it.  This may run a collection step.  Each type has its
+	 * own slab class, so the class index is just the type.
+	 */
+	struct Object *obj = gc_alloc(machine, type);
+	if (obj)
+		obj->type = type;
+	return obj;
 }
 
 struct Object *create_symbol_object(struct Machine *machine, struct String str)
 {
-	struct Object *obj = alloc_object(machine);
-	if (obj) {
+	/* Takes ownership of str. */
+	size_t length = str.count;
+	if (length && !str.cstr[length - 1])
+		--length; /* Drop the NUL. */
+	struct Object *obj = create_symbol_object_n(machine, str.cstr, length);
+	free_string(&str);
+	return obj;
+}
+
+struct Object *create_symbol_object_n(struct Machine *machine,
+				const char *name, size_t length)
+{
+	/*
+	 * Symbols are interned, so there is one permanent object per name
+	 * and reading a known symbol allocates nothing.
+	 */
+	ptrdiff_t sym = symbol_intern(&machine->symbols, name, length);
+	if (sym == -1)
+		return 0;
+	struct SymbolEntry *ent = &machine->symbols.entries[sym];
+	if (!ent->object) {
+		struct Object *obj = gc_alloc_permanent(machine, TypeSymbol);
+		if (!obj)
+			return 0;
 		obj->type = TypeSymbol;
-		obj->symbol = string_array_search(machine->symbols, str);
-		if (obj->symbol == -1) {
-			obj->symbol = machine->symbols.count;
-			if (!string_array_append(&machine->symbols, str)) {
-				free(obj);
-				return 0;
-			}
-		}
+		obj->symbol = sym;
+		ent->object = obj;
 	}
-	return obj;
+	return ent->object;
 }
 
-struct Object *create_string_object(struct Machine *machine, struct String str)
+struct Object *create_string_object(struct Machine *machine,
+				const char *chars, size_t length)
 {
-	struct Object *obj = alloc_object(machine);
-	if (obj) {
-		obj->type = TypeString;
-		obj->string = str;
+	/* A string holding a copy of chars. */
+	struct StringSlice slice;
+	if (!string_slice_init(&slice, chars, length))
+		return 0;
+	return create_string_from_slice(machine, TypeString, slice);
+}
+
+struct Object *create_string_from_slice(struct Machine *machine,
+					enum Type type,
+					struct StringSlice slice)
+{
+	/*
+	 * A string or string builder over slice, taking over the buffer
+	 * ref it holds.  Since that ref keeps the bytes alive, slice may
+	 * come from objects that aren't rooted.
+	 */
+	struct Object *obj = alloc_object(machine, type);
+	if (!obj) {
+		string_buffer_release(slice.buffer);
+		return 0;
 	}
+	obj->string = slice;
 	return obj;
 }
 
-struct Object *create_integer_object(struct Machine *machine, int integer)
+struct Object *create_integer_object(struct Machine *machine,
+				int64_t integer)
 {
-	struct Object *obj = alloc_object(machine);
-	if (obj) {
-		obj->type = TypeInteger;
+	if (integer >= FIXNUM_MIN && integer <= FIXNUM_MAX)
+		return make_fixnum(integer);
+	struct Object *obj = alloc_object(machine, TypeInteger);
+	if (obj)
 		obj->integer = integer;
-	}
 	return obj;
 }
 
 struct Object *create_double_object(struct Machine *machine, double dbl)
 {
-	struct Object *obj = alloc_object(machine);
-	if (obj) {
-		obj->type = TypeDouble;
+	struct Object *obj = alloc_object(machine, TypeDouble);
+	if (obj)
 		obj->dbl = dbl;
-	}
 	return obj;
 }
 
 struct Object *create_pair_object(struct Machine *machine, struct Object *car,
 				struct Object *cdr)
 {
-	struct Object *obj = alloc_object(machine);
+	struct Object *obj = alloc_object(machine, TypePair);
 	if (obj) {
-		obj->type = TypePair;
 		obj->pair.car = car;
 		obj->pair.cdr = cdr;
 	}
@@ -79,78 +256,381 @@ struct Object *create_pair_object(struct Machine *machine, struct Object *car,
 
 struct Object *create_error_object(struct Machine *machine)
 {
-	struct Object *obj = alloc_object(machine);
+	return alloc_object(machine, TypeError);
+}
+
+struct Object *create_closure_object(struct Machine *machine,
+				struct Object *args,
+				struct Object *code,
+				struct Object *env)
+{
+	struct Object *obj = alloc_object(machine, TypeClosure);
+	if (obj) {
+		obj->closure.args = args;
+		obj->closure.code = code;
+		obj->closure.env = env;
+	}
+	return obj;
+}
+
+struct Object *create_frame_object(struct Machine *machine,
+				struct Object *parent,
+				struct Object *names,
+				size_t count)
+{
+	/*
+	 * Small frames come from the slab class sized for their slot
+	 * count and keep the slots inline, right after struct Frame.
+	 * Larger ones keep them in a separate array.
+	 */
+	bool inlineSlots = count && count <= FRAME_INLINE_SLOTS;
+	size_t cls = inlineSlots ? TYPE_COUNT + count - 1 : TypeFrame;
+	struct Object *obj = gc_alloc(machine, cls);
+	if (!obj)
+		return 0;
+	obj->type = TypeFrame;
+	obj->frame.parent = parent;
+	obj->frame.names = names;
+	obj->frame.count = count;
+	if (inlineSlots) {
+		obj->frame.slots = (struct Object **)((char *)obj
+						+ object_size(TypeFrame));
+	} else {
+		obj->frame.slots = malloc(count * sizeof(struct Object *));
+		if (count && !obj->frame.slots) {
+			/* Leave it as a frame with no slots for the collector. */
+			obj->frame.count = 0;
+			return 0;
+		}
+	}
+	for (size_t i = 0; i != count; ++i)
+		obj->frame.slots[i] = 0;
+	return obj;
+}
+
+struct Object *create_global_ref_object(struct Machine *machine,
+					struct GlobalCell *cell)
+{
+	/*
+	 * Each cell has one reference object, shared by all compiled
+	 * code.  It points at no object, so it can be permanent.
+	 */
+	if (!cell->ref) {
+		struct Object *obj = gc_alloc_permanent(machine, TypeGlobalRef);
+		if (!obj)
+			return 0;
+		obj->type = TypeGlobalRef;
+		obj->globalRef.cell = cell;
+		cell->ref = obj;
+	}
+	return cell->ref;
+}
+
+struct Object *create_code_object(struct Machine *machine,
+				struct Object *params)
+{
+	/* Empty; the compiler appends instructions and constants. */
+	struct Object *obj = alloc_object(machine, TypeCode);
+	if (obj) {
+		struct Code code = {
+			.ops = 0, .count = 0, .size = 0,
+			.consts = 0, .constCount = 0, .constSize = 0,
+			.params = params, .arity = 0, .maxStack = 0,
+			.name = -1
+		};
+		for (; params && !obj_is_nil(params); params = cdr(params))
+			++code.arity;
+		obj->code = code;
+	}
+	return obj;
+}
+
+struct Object *create_chunk_object(struct Machine *machine,
+				struct Object *parent, size_t parentTop,
+				size_t size)
+{
+	struct Object *obj = alloc_object(machine, TypeChunk);
+	if (!obj)
+		return 0;
+	struct Chunk chunk = {
+		.parent = parent, .parentTop = parentTop,
+		.count = 0, .size = size,
+		.sealed = false, .dirty = true,
+		.slots = malloc(size * sizeof(struct Object *))
+	};
+	if (!chunk.slots)
+		chunk.size = 0;
+	obj->chunk = chunk;
+	return chunk.slots ? obj : 0;
+}
+
+struct Object *create_continuation_object(struct Machine *machine,
+					struct Continuation k)
+{
+	struct Object *obj = alloc_object(machine, TypeContinuation);
 	if (obj)
-		obj->type = TypeError;
+		obj->continuation = k;
 	return obj;
 }
 
-struct Object *create_env_object(struct Machine *machine)
+struct Object *create_bignum_object(struct Machine *machine,
+				uint32_t *digits, size_t count, bool negative)
 {
-	struct Object *obj = alloc_object(machine);
+	/*
+	 * Takes ownership of digits once it succeeds.  Use the functions
+	 * in bignum.h, which only make bignums of values that need them.
+	 */
+	struct Object *obj = alloc_object(machine, TypeBignum);
 	if (obj) {
-		obj->type = TypeEnv;
-		obj->env = make_env();
+		struct Bignum big = {
+			.digits = digits, .count = count, .negative = negative
+		};
+		obj->bignum = big;
 	}
 	return obj;
 }
 
-struct Object *create_closure_object(struct Machine *machine,
-				struct Object *args,
-				struct Object *body,
-				struct Object *env)
+struct Object *create_vector_object(struct Machine *machine, size_t count,
+				struct Object *fill)
+{
+	/* Every item starts as fill, which the caller keeps rooted. */
+	struct Object *obj = alloc_object(machine, TypeVector);
+	if (!obj)
+		return 0;
+	struct Vector vec = {
+		.items = malloc((count ? count : 1) * sizeof(struct Object *)),
+		.count = count
+	};
+	if (!vec.items)
+		vec.count = 0;
+	for (size_t i = 0; i != vec.count; ++i)
+		vec.items[i] = fill;
+	obj->vector = vec;
+	return vec.items ? obj : 0;
+}
+
+struct Object *create_vector_from_list(struct Machine *machine,
+				struct Object *list)
 {
-	struct Object *obj = alloc_object(machine);
-	obj->type = TypeClosure;
-	obj->closure.args = args;
-	obj->closure.body = body;
-	obj->closure.env = env;
+	/* list must be proper and rooted by the caller. */
+	size_t count = 0;
+	for (struct Object *it = list; !obj_is_nil(it); it = it->pair.cdr)
+		++count;
+	struct Object *obj = create_vector_object(machine, count, 0);
+	if (!obj)
+		return 0;
+	struct Object **item = obj->vector.items;
+	for (struct Object *it = list; !obj_is_nil(it); it = it->pair.cdr)
+		*item++ = it->pair.car;
+	gc_write_barrier(machine, obj);
+	return obj;
+}
+
+struct Object *create_numvec_object(struct Machine *machine, enum Type type,
+				size_t count)
+{
+	/* The elements start as zeros. */
+	struct Object *obj = alloc_object(machine, type);
+	if (!obj)
+		return 0;
+	obj->numvec.f64 = calloc(count ? count : 1, sizeof(double));
+	obj->numvec.count = obj->numvec.f64 ? count : 0;
+	return obj->numvec.f64 ? obj : 0;
+}
+
+struct Object *create_hash_table_object(struct Machine *machine,
+					enum HashKind kind)
+{
+	/* Slots are allocated by the first insertion. */
+	struct Object *obj = alloc_object(machine, TypeHashTable);
+	if (obj)
+		hashtab_init(&obj->hashTable, kind);
+	return obj;
+}
+
+struct Object *create_hamt_object(struct Machine *machine, struct Object *root,
+				size_t count, uint64_t edit)
+{
+	struct Object *obj = alloc_object(machine, TypeHamt);
+	if (obj) {
+		struct Hamt map = {.root = root, .count = count, .edit = edit};
+		obj->hamt = map;
+	}
+	return obj;
+}
+
+struct Object *create_hamt_node_object(struct Machine *machine,
+				size_t capacity, uint64_t edit)
+{
+	/*
+	 * An empty node with room for capacity slots.  As with frames,
+	 * small nodes keep their slots inline, here in the class for the
+	 * next even count, which is then the capacity.
+	 */
+	bool inlineSlots = capacity <= HAMT_INLINE_SLOTS;
+	if (inlineSlots)
+		capacity = capacity < 2 ? 2 : (capacity + 1) & ~(size_t)1;
+	size_t cls = inlineSlots
+		? TYPE_COUNT + FRAME_INLINE_SLOTS + capacity / 2 - 1
+		: TypeHamtNode;
+	struct Object *obj = gc_alloc(machine, cls);
+	if (!obj)
+		return 0;
+	obj->type = TypeHamtNode;
+	struct HamtNode node = {
+		.bitmap = 0, .count = 0, .capacity = capacity, .edit = edit
+	};
+	if (inlineSlots)
+		node.slots = (struct Object **)((char *)obj
+					+ object_size(TypeHamtNode));
+	else
+		node.slots = malloc(capacity * sizeof(struct Object *));
+	if (!node.slots)
+		node.capacity = 0;
+	obj->hamtNode = node;
+	return node.slots ? obj : 0;
+}
+
+struct Object *create_record_type_object(struct Machine *machine,
+					struct Object *name, size_t count)
+{
+	struct Object *obj = alloc_object(machine, TypeRecordType);
+	if (obj) {
+		struct RecordType type = {.name = name, .count = count};
+		obj->recordType = type;
+	}
+	return obj;
+}
+
+struct Object *create_record_object(struct Machine *machine,
+				struct Object *type, struct Object *fill)
+{
+	/*
+	 * A record of type with every slot fill.  As with frames, small
+	 * records keep their slots inline, in the class for their count.
+	 */
+	size_t count = type->recordType.count;
+	bool inlineSlots = count && count <= RECORD_INLINE_SLOTS;
+	size_t cls = inlineSlots ? TYPE_COUNT + FRAME_INLINE_SLOTS
+		+ HAMT_INLINE_SLOTS / 2 + count - 1 : TypeRecord;
+	struct Object *obj = gc_alloc(machine, cls);
+	if (!obj)
+		return 0;
+	obj->type = TypeRecord;
+	struct Record rec = {.type = type, .count = count};
+	if (inlineSlots) {
+		rec.slots = (struct Object **)((char *)obj
+					+ object_size(TypeRecord));
+	} else {
+		rec.slots = malloc((count ? count : 1)
+				* sizeof(struct Object *));
+		if (!rec.slots)
+			rec.count = 0;
+	}
+	for (size_t i = 0; i != rec.count; ++i)
+		rec.slots[i] = fill;
+	obj->record = rec;
+	return rec.slots ? obj : 0;
+}
+
+struct Object *create_record_proc_object(struct Machine *machine,
+					enum RecordOp op, struct Object *type,
+					struct Object *name, size_t index)
+{
+	/* A constructor's caller fills in its count and order. */
+	struct Object *obj = alloc_object(machine, TypeRecordProc);
+	if (obj) {
+		struct RecordProc proc = {
+			.op = op, .type = type, .name = name, .index = index,
+			.count = 0, .order = 0
+		};
+		obj->recordProc = proc;
+	}
 	return obj;
 }
 
 struct Object *create_builtin_form_object(struct Machine *machine,
 					struct BuiltinForm f)
 {
-	struct Object *obj = alloc_object(machine);
-	if (obj) {
-		obj->type = TypeBuiltinForm;
+	struct Object *obj = alloc_object(machine, TypeBuiltinForm);
+	if (obj)
 		obj->builtinForm = f;
-	}
 	return obj;
 }
 
 struct Object *create_builtin_func_object(struct Machine *machine,
 					struct BuiltinFunc f)
 {
-	struct Object *obj = alloc_object(machine);
-	if (obj) {
-		obj->type = TypeBuiltinFunc;
+	struct Object *obj = alloc_object(machine, TypeBuiltinFunc);
+	if (obj)
 		obj->builtinFunc = f;
-	}
 	return obj;
 }
 
 void destroy_object(struct Machine *machine, struct Object *obj)
 {
 	/* NOTE: we want to free things that are owned by the object.
-	 * That does not include other objects referenced by the given object.
-	 * That will eventually be handled by garbage collection.
+	 * That does not include other objects referenced by the given object,
+	 * nor the object's own slot, which the collector hands back to
+	 * its slab.  Only the collector should call this.
 	 */
 	switch (obj->type) {
 	case TypeString:
-		free(obj->string.cstr);
-		free(obj);
+	case TypeStringBuilder:
+		string_buffer_release(obj->string.buffer);
+		return;
+	case TypeFrame:
+		if (obj->frame.slots != (struct Object **)((char *)obj
+							+ object_size(TypeFrame)))
+			free(obj->frame.slots);
+		return;
+	case TypeCode:
+		free(obj->code.ops);
+		free(obj->code.consts);
+		return;
+	case TypeChunk:
+		free(obj->chunk.slots);
+		return;
+	case TypeBignum:
+		free(obj->bignum.digits);
+		return;
+	case TypeVector:
+		free(obj->vector.items);
+		return;
+	case TypeF64Vector:
+		free(obj->numvec.f64);
+		return;
+	case TypeS64Vector:
+		free(obj->numvec.s64);
+		return;
+	case TypeHashTable:
+		hashtab_free(&obj->hashTable);
+		return;
+	case TypeHamtNode:
+		if (obj->hamtNode.slots != (struct Object **)((char *)obj
+						+ object_size(TypeHamtNode)))
+			free(obj->hamtNode.slots);
+		return;
+	case TypeRecord:
+		if (obj->record.slots != (struct Object **)((char *)obj
+						+ object_size(TypeRecord)))
+			free(obj->record.slots);
+		return;
+	case TypeRecordProc:
+		free(obj->recordProc.order);
 		return;
 	case TypeSymbol:
 	case TypeInteger:
 	case TypeDouble:
 	case TypePair:
-	case TypeEnv:
 	case TypeError:
 	case TypeBuiltinForm:
 	case TypeBuiltinFunc:
 	case TypeClosure:
-		free(obj);
+	case TypeGlobalRef:
+	case TypeContinuation:
+	case TypeHamt:
+	case TypeRecordType:
 		return;
 	}
 	assert(0);
@@ -173,60 +653,312 @@ struct Object *cadr(struct Object *obj)
 
 struct Object *reverse_list(struct Machine *machine, struct Object *inList)
 {
-	if (inList->type != TypePair)
+	if (obj_type(inList) != TypePair)
 		return inList;
+	size_t roots = gc_roots_save(machine);
+	gc_push_root(machine, &inList);
 	struct Object *outList = create_pair_object(machine, 0, 0);
-	while (inList->type == TypePair) {
+	gc_push_root(machine, &outList);
+	while (obj_type(inList) == TypePair && !obj_is_nil(inList)) {
 		outList = create_pair_object(machine, car(inList), outList);
 		inList = inList->pair.cdr;
 	}
+	gc_roots_restore(machine, roots);
 	return outList;
 }
 
 bool obj_is_nil(struct Object * obj)
 {
-	return obj && obj->type == TypePair && !obj->pair.car && !obj->pair.cdr;
+	return obj && obj_type(obj) == TypePair
+		&& !obj->pair.car && !obj->pair.cdr;
 }
 
 bool machine_register_builtin_form(struct Machine *m, char *cname, builtinForm f)
 {
-	struct String name = string_from_cstring(cname);
-	struct Object *symbol = create_symbol_object(m, name);
+	ptrdiff_t sym = symbol_intern(&m->symbols, cname, strlen(cname));
+	if (sym == -1)
+		return false;
 	struct BuiltinForm func = {.f = f};
 	struct Object *funcObj = create_builtin_form_object(m, func);
-	return env_update(&m->rootEnv->env, symbol->symbol, funcObj);
+	return funcObj && global_define(m, sym, funcObj);
 }
 
 bool machine_register_builtin_func(struct Machine *m, char *cname, builtinFunc f)
 {
-	struct String name = string_from_cstring(cname);
-	struct Object *symbol = create_symbol_object(m, name);
+	ptrdiff_t sym = symbol_intern(&m->symbols, cname, strlen(cname));
+	if (sym == -1)
+		return false;
 	struct BuiltinFunc func = {.f = f};
 	struct Object *funcObj = create_builtin_func_object(m, func);
-	return env_update(&m->rootEnv->env, symbol->symbol, funcObj);
+	return funcObj && global_define(m, sym, funcObj);
+}
+
+void destroy_machine(struct Machine *m)
+{
+	/*
+	 * Free m and everything it owns.  Every object, reachable or not,
+	 * sits in a slab page, so walking the pages finds them all.
+	 * Output not yet flushed is lost.
+	 */
+	profile_cancel(m);
+	for (size_t i = 0; i != m->slabs.count; ++i) {
+		struct SlabClass *c = &m->slabs.classes[i];
+		for (size_t j = 0; j != c->count; ++j) {
+			struct SlabPage *page = c->pages[j];
+			for (size_t k = 0; k != page->bump; ++k) {
+				struct Object *obj = slab_object_at(page, k);
+				if (obj->live)
+					destroy_object(m, obj);
+			}
+		}
+	}
+	free_slabs(&m->slabs);
+	free_heap(&m->heap);
+	free_globals(&m->globals);
+	free_symbol_table(&m->symbols);
+	printer_free(&m->out);
+	free(m);
 }
 
 struct Machine *create_machine()
 {
 	struct Machine *m = malloc(sizeof(*m));
 	if (m) {
-		m->symbols = make_string_array();
-		m->rootEnv = create_env_object(m);
-		m->env = m->rootEnv;
+		m->symbols = make_symbol_table();
+		m->globals = make_globals();
+		m->heap = make_heap();
+		m->slabs = make_slabs();
+		m->stats = make_stats();
+		m->profile = make_profile();
+		printer_init(&m->out, STDOUT_FILENO);
+		for (enum Type t = 0; t != TYPE_COUNT; ++t) {
+			if (!slabs_add_class(&m->slabs, object_size(t))) {
+				destroy_machine(m);
+				return 0;
+			}
+		}
+		for (size_t n = 1; n <= FRAME_INLINE_SLOTS; ++n) {
+			size_t size = object_size(TypeFrame)
+				+ n * sizeof(struct Object *);
+			if (!slabs_add_class(&m->slabs, size)) {
+				destroy_machine(m);
+				return 0;
+			}
+		}
+		for (size_t n = 2; n <= HAMT_INLINE_SLOTS; n += 2) {
+			size_t size = object_size(TypeHamtNode)
+				+ n * sizeof(struct Object *);
+			if (!slabs_add_class(&m->slabs, size)) {
+				destroy_machine(m);
+				return 0;
+			}
+		}
+		for (size_t n = 1; n <= RECORD_INLINE_SLOTS; ++n) {
+			size_t size = object_size(TypeRecord)
+				+ n * sizeof(struct Object *);
+			if (!slabs_add_class(&m->slabs, size)) {
+				destroy_machine(m);
+				return 0;
+			}
+		}
+		m->simd = simd_level();
+		m->numvec = numvec_kernels(m->simd);
+		m->strops = str_kernels(m->simd);
+		m->lastEdit = 0;
+		m->chunk = 0;
+		m->code = 0;
+		m->pc = 0;
+		m->base = 0;
+		m->callDepth = 0;
+		m->maxCallDepth = 0;
+		m->runDepth = 0;
+		m->run = 0;
+		m->runCount = 0;
+		m->env = 0;
+		m->chunk = create_chunk_object(m, 0, 0, VM_CHUNK_SLOTS);
+		if (!m->chunk) {
+			destroy_machine(m);
+			return 0;
+		}
+
+		/* t is the canonical true value, and evaluates to itself. */
+		m->trueObj = create_symbol_object(m, string_from_cstring("t"));
+		if (!m->trueObj || !global_define(m, m->trueObj->symbol,
+						m->trueObj)) {
+			destroy_machine(m);
+			return 0;
+		}
 
 		machine_register_builtin_form(m, "define", define);
 		machine_register_builtin_form(m, "quote", quote);
 		machine_register_builtin_form(m, "lambda", lambda);
+		machine_register_builtin_form(m, "if", mif);
+		machine_register_builtin_form(m, "define-record-type",
+					define_record_type);
 
 		machine_register_builtin_func(m, "eval", meval);
 		machine_register_builtin_func(m, "car", mcar);
 		machine_register_builtin_func(m, "cdr", mcdr);
 		machine_register_builtin_func(m, "cadr", mcadr);
 		machine_register_builtin_func(m, "cons", cons);
+		machine_register_builtin_func(m, "reverse", reverse);
 		machine_register_builtin_func(m, "+", sum);
 		machine_register_builtin_func(m, "*", prod);
 		machine_register_builtin_func(m, "-", subtract);
 		machine_register_builtin_func(m, "/", divide);
+		machine_register_builtin_func(m, "=", num_eq);
+		machine_register_builtin_func(m, "<", num_lt);
+		machine_register_builtin_func(m, ">", num_gt);
+		machine_register_builtin_func(m, "null?", null_p);
+		machine_register_builtin_func(m, "make-vector", make_vector);
+		machine_register_builtin_func(m, "vector-ref", vector_ref);
+		machine_register_builtin_func(m, "vector-set!", vector_set);
+		machine_register_builtin_func(m, "vector-length",
+					vector_length);
+		machine_register_builtin_func(m, "vector-fill!", vector_fill);
+		machine_register_builtin_func(m, "list->vector",
+					list_to_vector);
+		machine_register_builtin_func(m, "vector->list",
+					vector_to_list);
+		machine_register_builtin_func(m, "vector?", vector_p);
+		machine_register_builtin_func(m, "make-f64vector",
+					make_f64vector);
+		machine_register_builtin_func(m, "f64vector", f64vector);
+		machine_register_builtin_func(m, "list->f64vector",
+					list_to_f64vector);
+		machine_register_builtin_func(m, "f64vector->list",
+					f64vector_to_list);
+		machine_register_builtin_func(m, "f64vector?", f64vector_p);
+		machine_register_builtin_func(m, "f64vector-length",
+					f64vector_length);
+		machine_register_builtin_func(m, "f64vector-ref",
+					f64vector_ref);
+		machine_register_builtin_func(m, "f64vector-set!",
+					f64vector_set);
+		machine_register_builtin_func(m, "f64vector-sum",
+					f64vector_sum);
+		machine_register_builtin_func(m, "f64vector-dot",
+					f64vector_dot);
+		machine_register_builtin_func(m, "f64vector-scale",
+					f64vector_scale);
+		machine_register_builtin_func(m, "f64vector-add",
+					f64vector_add);
+		machine_register_builtin_func(m, "f64vector-min",
+					f64vector_min);
+		machine_register_builtin_func(m, "f64vector-max",
+					f64vector_max);
+		machine_register_builtin_func(m, "make-s64vector",
+					make_s64vector);
+		machine_register_builtin_func(m, "s64vector", s64vector);
+		machine_register_builtin_func(m, "list->s64vector",
+					list_to_s64vector);
+		machine_register_builtin_func(m, "s64vector->list",
+					s64vector_to_list);
+		machine_register_builtin_func(m, "s64vector?", s64vector_p);
+		machine_register_builtin_func(m, "s64vector-length",
+					s64vector_length);
+		machine_register_builtin_func(m, "s64vector-ref",
+					s64vector_ref);
+		machine_register_builtin_func(m, "s64vector-set!",
+					s64vector_set);
+		machine_register_builtin_func(m, "s64vector-sum",
+					s64vector_sum);
+		machine_register_builtin_func(m, "s64vector-dot",
+					s64vector_dot);
+		machine_register_builtin_func(m, "s64vector-scale",
+					s64vector_scale);
+		machine_register_builtin_func(m, "s64vector-add",
+					s64vector_add);
+		machine_register_builtin_func(m, "s64vector-min",
+					s64vector_min);
+		machine_register_builtin_func(m, "s64vector-max",
+					s64vector_max);
+		machine_register_builtin_func(m, "eq?", eq_p);
+		machine_register_builtin_func(m, "eqv?", eqv_p);
+		machine_register_builtin_func(m, "equal?", equal_p);
+		machine_register_builtin_func(m, "make-hash-table",
+					make_hash_table);
+		machine_register_builtin_func(m, "hash-table?", hash_table_p);
+		machine_register_builtin_func(m, "hash-table-ref",
+					hash_table_ref);
+		machine_register_builtin_func(m, "hash-table-ref/default",
+					hash_table_ref_default);
+		machine_register_builtin_func(m, "hash-table-contains?",
+					hash_table_contains_p);
+		machine_register_builtin_func(m, "hash-table-set!",
+					hash_table_set);
+		machine_register_builtin_func(m, "hash-table-delete!",
+					hash_table_delete);
+		machine_register_builtin_func(m, "hash-table-count",
+					hash_table_count);
+		machine_register_builtin_func(m, "hash-table-keys",
+					hash_table_keys);
+		machine_register_builtin_func(m, "hash-table-values",
+					hash_table_values);
+		machine_register_builtin_func(m, "hash-table->alist",
+					hash_table_to_alist);
+		machine_register_builtin_func(m, "hash-table-walk",
+					hash_table_walk);
+		machine_register_builtin_func(m, "hash-table-fold",
+					hash_table_fold);
+		machine_register_builtin_func(m, "hamt", hamt);
+		machine_register_builtin_func(m, "hamt?", hamt_p);
+		machine_register_builtin_func(m, "hamt-ref", hamt_ref);
+		machine_register_builtin_func(m, "hamt-contains?",
+					hamt_contains_p);
+		machine_register_builtin_func(m, "hamt-set", hamt_set);
+		machine_register_builtin_func(m, "hamt-delete", hamt_delete);
+		machine_register_builtin_func(m, "hamt-count", hamt_count);
+		machine_register_builtin_func(m, "hamt->alist", hamt_to_alist);
+		machine_register_builtin_func(m, "alist->hamt", alist_to_hamt);
+		machine_register_builtin_func(m, "hamt-transient",
+					hamt_transient);
+		machine_register_builtin_func(m, "hamt-set!", transient_set);
+		machine_register_builtin_func(m, "hamt-delete!",
+					transient_delete);
+		machine_register_builtin_func(m, "hamt-persistent!",
+					hamt_persistent);
+		machine_register_builtin_func(m, "simd-level", msimd_level);
+		machine_register_builtin_func(m, "string?", string_p);
+		machine_register_builtin_func(m, "string-length",
+					string_length);
+		machine_register_builtin_func(m, "substring", substring);
+		machine_register_builtin_func(m, "string-append",
+					mstring_append);
+		machine_register_builtin_func(m, "string-index", string_index);
+		machine_register_builtin_func(m, "string-search",
+					string_search);
+		machine_register_builtin_func(m, "string-split", string_split);
+		machine_register_builtin_func(m, "string=?", string_eq);
+		machine_register_builtin_func(m, "string-prefix?",
+					string_prefix_p);
+		machine_register_builtin_func(m, "string-suffix?",
+					string_suffix_p);
+		machine_register_builtin_func(m, "make-string-builder",
+					make_string_builder);
+		machine_register_builtin_func(m, "string-builder-append!",
+					string_builder_append);
+		machine_register_builtin_func(m, "string-builder->string",
+					string_builder_to_string);
+		machine_register_builtin_func(m, "string-builder-length",
+					string_builder_length);
+		machine_register_builtin_func(m, "call/cc", callcc);
+		machine_register_builtin_func(m,
+					"call-with-current-continuation",
+					callcc);
+		machine_register_builtin_func(m, "gc", mgc);
+		machine_register_builtin_func(m, "gc-pause-target",
+					mgc_pause_target);
+		machine_register_builtin_func(m, "slab-stats", slab_stats);
+		machine_register_builtin_func(m, "runtime-stats",
+					runtime_stats);
+		machine_register_builtin_func(m, "profile-start",
+					mprofile_start);
+		machine_register_builtin_func(m, "profile-stop",
+					mprofile_stop);
+		machine_register_builtin_func(m, "disassemble", mdisassemble);
+		machine_register_builtin_func(m, "max-call-depth",
+					max_call_depth);
 	}
 	return m;
 }
@@ -3,7 +3,19 @@
 
 #include "base.h"
 #include "env.h"
+#include "gc.h"
+#include "hamt.h"
+#include "hashtab.h"
+#include "print.h"
+#include "profile.h"
+#include "record.h"
 #include "scheme_forward.h"
+#include "simd.h"
+#include "slab.h"
+#include "stats.h"
+#include "symbol.h"
+#include <stdbool.h>
+#include <stdint.h>
 
 enum Type {
 	TypeSymbol,
@@ -11,13 +23,46 @@ enum Type {
 	TypeInteger,
 	TypeDouble,
 	TypePair,
-	TypeEnv,
 	TypeBuiltinForm,
 	TypeBuiltinFunc,
 	TypeError,
-	TypeClosure
+	TypeClosure,
+	TypeFrame,
+	TypeGlobalRef,
+	TypeCode,
+	TypeChunk,
+	TypeContinuation,
+	TypeBignum,
+	TypeVector,
+	TypeF64Vector,
+	TypeS64Vector,
+	TypeStringBuilder,
+	TypeHashTable,
+	TypeHamt,
+	TypeHamtNode,
+	TypeRecordType,
+	TypeRecord,
+	TypeRecordProc
 };
 
+/* Keep in step with the last entry of enum Type. */
+#define TYPE_COUNT (TypeRecordProc + 1)
+
+/*
+ * Frames with up to this many slots keep them inline, in a slab
+ * class of their own that follows the per-type classes.
+ */
+#define FRAME_INLINE_SLOTS 6
+
+/*
+ * Likewise HAMT nodes with up to this many slots, with a class for
+ * each even count after the frames' classes.
+ */
+#define HAMT_INLINE_SLOTS 16
+
+/* And records with up to this many fields, after the HAMT nodes. */
+#define RECORD_INLINE_SLOTS 8
+
 struct Pair {
 	struct Object *car;
 	struct Object *cdr;
@@ -32,51 +77,282 @@ struct BuiltinFunc {
 };
 
 struct Closure {
-	struct Object *body;
+	struct Object *code;
 	struct Object *args;
 	struct Object *env;
 };
 
+/*
+ * The activation record of a closure call.  There is one slot per
+ * parameter, in the order of names, the closure's parameter list.
+ */
+struct Frame {
+	struct Object *parent;
+	struct Object *names;
+	size_t count;
+	struct Object **slots;
+};
+
+/* A compiled reference to a global cell, kept among a Code's constants. */
+struct GlobalRef {
+	struct GlobalCell *cell;
+};
+
+/*
+ * Compiled code for a lambda body or a top-level expression: the
+ * instructions (see vm.h) and the constants they refer to by index.
+ * arity is the number of params; maxStack is the most operand stack
+ * entries the code can use.  name is the symbol a lambda was the
+ * value of a define for, or -1.
+ */
+struct Code {
+	int *ops;
+	size_t count;
+	size_t size;
+	struct Object **consts;
+	size_t constCount;
+	size_t constSize;
+	struct Object *params;
+	int arity;
+	int maxStack;
+	ptrdiff_t name;
+};
+
+/*
+ * A segment of the VM stack; see vm.c.  parentTop is how much of
+ * parent was in use when this chunk was stacked on it.  A sealed chunk
+ * is shared with continuations and is never written again.  dirty
+ * chunks may have been written since the last collection.
+ */
+struct Chunk {
+	struct Object *parent;
+	size_t parentTop;
+	size_t count;
+	size_t size;
+	bool sealed;
+	bool dirty;
+	struct Object **slots;
+};
+
+/*
+ * What call/cc captures: the activation with its record at base in a
+ * sealed chunk, using it up to top, and the registers to resume it
+ * with.  run is the vm_run() invocation it belongs to, or 0 for the
+ * top level.
+ */
+struct Continuation {
+	struct Object *chunk;
+	struct Object *code;
+	struct Object *frame;
+	size_t pc;
+	size_t base;
+	size_t top;
+	size_t depth;
+	size_t run;
+};
+
+/*
+ * An integer too big for an int64_t: count 32-bit digits, least
+ * significant first, with no leading zeros, and a separate sign.
+ * See bignum.c.
+ */
+struct Bignum {
+	uint32_t *digits;
+	size_t count;
+	bool negative;
+};
+
+/* A fixed-length array of objects, indexed from 0. */
+struct Vector {
+	struct Object **items;
+	size_t count;
+};
+
+/*
+ * The unboxed elements of an f64vector or s64vector, contiguous so
+ * that the kernels in numvec.c can stream through them.
+ */
+struct NumVector {
+	union {
+		double *f64;
+		int64_t *s64;
+	};
+	size_t count;
+};
+
+/*
+ * Objects only get as many bytes as their type's union member needs;
+ * see object_size().  Never copy a whole struct Object.
+ */
 struct Object {
 	enum Type type;
+	unsigned char live;
+	unsigned char marked;
+	unsigned char generation;
+	unsigned char remembered;
 	union {
+		struct Object *nextFree;
 		ptrdiff_t symbol;
-		struct String string;
-		int integer;
+		/* A string builder's is what it holds so far. */
+		struct StringSlice string;
+		int64_t integer;
 		double dbl;
 		struct Pair pair;
-		struct Env env;
 		struct BuiltinForm builtinForm;
 		struct BuiltinFunc builtinFunc;
 		struct Closure closure;
+		struct Frame frame;
+		struct GlobalRef globalRef;
+		struct Code code;
+		struct Chunk chunk;
+		struct Continuation continuation;
+		struct Bignum bignum;
+		struct Vector vector;
+		struct NumVector numvec;
+		struct HashTable hashTable;
+		struct Hamt hamt;
+		struct HamtNode hamtNode;
+		struct RecordType recordType;
+		struct Record record;
+		struct RecordProc recordProc;
 	};
 };
 
+/*
+ * Small integers are not heap objects at all.  They live in the
+ * struct Object * word itself, shifted left one bit with the low bit
+ * set.  Slab objects are at least 8-byte aligned, so a real pointer
+ * never has that bit.  Use obj_type() and obj_integer() rather than
+ * ->type and ->integer on anything that could be an integer.
+ */
+#define FIXNUM_MIN (INTPTR_MIN >> 1)
+#define FIXNUM_MAX (INTPTR_MAX >> 1)
+
+static inline bool obj_is_fixnum(struct Object *obj)
+{
+	return (uintptr_t)obj & 1;
+}
+
+static inline struct Object *make_fixnum(intptr_t n)
+{
+	return (struct Object *)(((uintptr_t)n << 1) | 1);
+}
+
+static inline intptr_t fixnum_value(struct Object *obj)
+{
+	return (intptr_t)obj >> 1;
+}
+
+static inline enum Type obj_type(struct Object *obj)
+{
+	return obj_is_fixnum(obj) ? TypeInteger : obj->type;
+}
+
+static inline int64_t obj_integer(struct Object *obj)
+{
+	return obj_is_fixnum(obj) ? fixnum_value(obj) : obj->integer;
+}
+
+/*
+ * Everything an interpreter changes lives in its Machine: objects,
+ * symbols, globals, the VM's stack and its output.  Machines share no
+ * mutable state, so each may run on a thread of its own, as long as
+ * only one thread uses a given machine at a time.  The one exception
+ * is the profiler, which only one machine can hold; see profile.h.
+ * The REPL's readline input is process-wide too, but only main.c
+ * reads from it.
+ */
 struct Machine {
-	struct StringArray symbols;
-	struct Object *rootEnv;
+	struct SymbolTable symbols;
+	/* The innermost frame of the running code, or 0 at the top level. */
 	struct Object *env;
+	struct Globals globals;
+	struct Heap heap;
+	struct Slabs slabs;
+	struct Stats stats;
+	struct Profile profile;
+	struct Object *trueObj;
+	struct Printer out;
+	enum SimdLevel simd;
+	const struct NumvecKernels *numvec;
+	const struct StrKernels *strops;
+	/* The last edit given to a transient map; see hamt.h. */
+	uint64_t lastEdit;
+
+	/* VM registers, saved here whenever the VM calls out; see vm.c. */
+	struct Object *chunk;
+	struct Object *code;
+	size_t pc;
+	size_t base;
+	size_t callDepth;
+	size_t maxCallDepth;
+	size_t runDepth;
+	size_t run;
+	size_t runCount;
 };
 
 
 struct Object *create_pair_object(struct Machine *machine, struct Object *car,
 				struct Object *cdr);
 struct Object *create_symbol_object(struct Machine *machine, struct String str);
-struct Object *create_string_object(struct Machine *machine, struct String str);
-struct Object *create_integer_object(struct Machine *machine, int integer);
+struct Object *create_symbol_object_n(struct Machine *machine,
+				const char *name, size_t length);
+struct Object *create_string_object(struct Machine *machine,
+				const char *chars, size_t length);
+struct Object *create_string_from_slice(struct Machine *machine,
+					enum Type type,
+					struct StringSlice slice);
+struct Object *create_integer_object(struct Machine *machine,
+				int64_t integer);
 struct Object *create_double_object(struct Machine *machine, double dbl);
 struct Object *create_pair_object(struct Machine *machine, struct Object *car,
 				struct Object *cdr);
 struct Object *create_error_object(struct Machine *machine);
-struct Object *create_env_object(struct Machine *machine);
 struct Object *create_closure_object(struct Machine *machine,
 				struct Object *args,
-				struct Object *body,
+				struct Object *code,
 				struct Object *env);
+struct Object *create_frame_object(struct Machine *machine,
+				struct Object *parent,
+				struct Object *names,
+				size_t count);
+struct Object *create_global_ref_object(struct Machine *machine,
+					struct GlobalCell *cell);
+struct Object *create_code_object(struct Machine *machine,
+				struct Object *params);
+struct Object *create_chunk_object(struct Machine *machine,
+				struct Object *parent, size_t parentTop,
+				size_t size);
+struct Object *create_continuation_object(struct Machine *machine,
+					struct Continuation k);
+struct Object *create_bignum_object(struct Machine *machine,
+				uint32_t *digits, size_t count, bool negative);
+struct Object *create_vector_object(struct Machine *machine, size_t count,
+				struct Object *fill);
+struct Object *create_vector_from_list(struct Machine *machine,
+				struct Object *list);
+struct Object *create_numvec_object(struct Machine *machine, enum Type type,
+				size_t count);
+struct Object *create_hash_table_object(struct Machine *machine,
+					enum HashKind kind);
+struct Object *create_hamt_object(struct Machine *machine, struct Object *root,
+				size_t count, uint64_t edit);
+struct Object *create_hamt_node_object(struct Machine *machine,
+				size_t capacity, uint64_t edit);
+struct Object *create_record_type_object(struct Machine *machine,
+					struct Object *name, size_t count);
+struct Object *create_record_object(struct Machine *machine,
+				struct Object *type, struct Object *fill);
+struct Object *create_record_proc_object(struct Machine *machine,
+					enum RecordOp op, struct Object *type,
+					struct Object *name, size_t index);
 struct Object *create_builtin_form_object(struct Machine *machine,
 					struct BuiltinForm f);
 struct Object *create_builtin_func_object(struct Machine *machine,
 					struct BuiltinFunc f);
+size_t object_size(enum Type type);
+const char *type_name(enum Type type);
+enum Type slab_class_type(size_t cls);
 void destroy_object(struct Machine *machine, struct Object *obj);
 struct Object *car(struct Object *obj);
 struct Object *cdr(struct Object *obj);
@@ -84,5 +360,6 @@ struct Object *cadr(struct Object *obj);
 struct Object *reverse_list(struct Machine *machine, struct Object *inList);
 bool obj_is_nil(struct Object * obj);
 struct Machine *create_machine();
+void destroy_machine(struct Machine *m);
 
 #endif
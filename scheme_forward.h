@@ -3,8 +3,8 @@
 
 typedef struct Object Object;
 typedef struct Pair Pair;
-typedef struct Env Env;
 typedef struct Machine Machine;
+typedef struct GlobalCell GlobalCell;
 typedef struct Object *(*builtinForm)(struct Machine *m, struct Object *args);
 typedef struct Object *(*builtinFunc)(struct Machine *m, struct Object *args);
 
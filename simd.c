@@ -0,0 +1,33 @@
+#include "simd.h"
+#include <stdlib.h>
+#include <string.h>
+
+static const char *const levelNames[] = {"scalar", "sse2", "sse4.2", "avx2"};
+
+const char *simd_level_name(enum SimdLevel level)
+{
+	return levelNames[level];
+}
+
+enum SimdLevel simd_level(void)
+{
+	/*
+	 * What this CPU supports, capped by SCHEME_SIMD when it names a
+	 * lower level, so the kernels can be compared against each other.
+	 */
+	enum SimdLevel level = SimdScalar;
+#if SIMD_X86
+	level = SimdSse2;
+	if (__builtin_cpu_supports("sse4.2")) {
+		level = SimdSse42;
+		if (__builtin_cpu_supports("avx2"))
+			level = SimdAvx2;
+	}
+#endif
+	const char *cap = getenv("SCHEME_SIMD");
+	for (enum SimdLevel l = SimdScalar; cap && l < level; ++l) {
+		if (!strcmp(cap, levelNames[l]))
+			level = l;
+	}
+	return level;
+}
@@ -0,0 +1,25 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/*
+ * The widest vector instructions the kernels may use, ordered so that
+ * each level implies the ones below it.  Only x86-64 has anything past
+ * SimdScalar; elsewhere the portable kernels are always used.
+ */
+enum SimdLevel {
+	SimdScalar,
+	SimdSse2,
+	SimdSse42,
+	SimdAvx2
+};
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SIMD_X86 1
+#else
+#define SIMD_X86 0
+#endif
+
+enum SimdLevel simd_level(void);
+const char *simd_level_name(enum SimdLevel level);
+
+#endif
@@ -0,0 +1,167 @@
+#include "slab.h"
+#include "scheme.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+#define SLAB_HEADER_SIZE ((sizeof(struct SlabPage) + 15) & ~(size_t)15)
+
+struct Slabs make_slabs(void)
+{
+	struct Slabs s = {.classes = 0, .count = 0};
+	return s;
+}
+
+void free_slabs(struct Slabs *slabs)
+{
+	/* Every page goes, whatever is still in it. */
+	for (size_t i = 0; i != slabs->count; ++i) {
+		struct SlabClass *c = &slabs->classes[i];
+		for (size_t j = 0; j != c->count; ++j)
+			free(c->pages[j]);
+		free(c->pages);
+	}
+	free(slabs->classes);
+	*slabs = make_slabs();
+}
+
+bool slabs_add_class(struct Slabs *slabs, size_t objectSize)
+{
+	size_t nbytes = (slabs->count + 1) * sizeof(struct SlabClass);
+	struct SlabClass *nclasses = realloc(slabs->classes, nbytes);
+	if (!nclasses)
+		return false;
+	slabs->classes = nclasses;
+	struct SlabClass c = {
+		.objectSize = (objectSize + 7) & ~(size_t)7,
+		.live = 0, .allocated = 0, .pages = 0, .count = 0, .size = 0,
+		.current = 0, .partial = 0
+	};
+	slabs->classes[slabs->count++] = c;
+	return true;
+}
+
+struct SlabPage *slab_page_of(struct Object *obj)
+{
+	uintptr_t mask = ~(uintptr_t)(SLAB_PAGE_SIZE - 1);
+	return (struct SlabPage *)((uintptr_t)obj & mask);
+}
+
+struct Object *slab_object_at(struct SlabPage *page, size_t slot)
+{
+	char *base = (char *)page + SLAB_HEADER_SIZE;
+	return (struct Object *)(base + slot * page->objectSize);
+}
+
+size_t slab_slot_of(struct SlabPage *page, struct Object *obj)
+{
+	char *base = (char *)page + SLAB_HEADER_SIZE;
+	return ((char *)obj - base) / page->objectSize;
+}
+
+static struct SlabPage *slab_new_page(struct SlabClass *c, size_t cls)
+{
+	if (c->count >= c->size) {
+		size_t nsize = c->size ? c->size * 2 : 8;
+		size_t nbytes = nsize * sizeof(struct SlabPage *);
+		struct SlabPage **npages = realloc(c->pages, nbytes);
+		if (!npages)
+			return 0;
+		c->pages = npages;
+		c->size = nsize;
+	}
+	struct SlabPage *page = aligned_alloc(SLAB_PAGE_SIZE, SLAB_PAGE_SIZE);
+	if (!page)
+		return 0;
+	page->nextPartial = 0;
+	page->onPartial = false;
+	page->cls = cls;
+	page->index = c->count;
+	page->objectSize = c->objectSize;
+	page->live = 0;
+	page->capacity = (SLAB_PAGE_SIZE - SLAB_HEADER_SIZE) / c->objectSize;
+	page->bump = 0;
+	page->freeList = 0;
+	c->pages[c->count++] = page;
+	return page;
+}
+
+struct Object *slab_alloc(struct Slabs *slabs, size_t cls)
+{
+	struct SlabClass *c = &slabs->classes[cls];
+	struct SlabPage *page = c->current;
+	struct Object *obj;
+	while (1) {
+		if (page && page->freeList) {
+			obj = page->freeList;
+			page->freeList = obj->nextFree;
+			break;
+		}
+		if (page && page->bump < page->capacity) {
+			/* Fresh slots are handed out in address order. */
+			obj = slab_object_at(page, page->bump++);
+			break;
+		}
+		if (c->partial) {
+			page = c->partial;
+			c->partial = page->nextPartial;
+			page->onPartial = false;
+		} else {
+			page = slab_new_page(c, cls);
+			if (!page)
+				return 0;
+		}
+		c->current = page;
+	}
+	++page->live;
+	++c->live;
+	++c->allocated;
+	obj->live = 1;
+	return obj;
+}
+
+void slab_free(struct Slabs *slabs, struct Object *obj)
+{
+	struct SlabPage *page = slab_page_of(obj);
+	struct SlabClass *c = &slabs->classes[page->cls];
+	obj->live = 0;
+	obj->nextFree = page->freeList;
+	page->freeList = obj;
+	--page->live;
+	--c->live;
+	if (!page->onPartial && page != c->current) {
+		page->onPartial = true;
+		page->nextPartial = c->partial;
+		c->partial = page;
+	}
+}
+
+void slabs_release_empty(struct Slabs *slabs)
+{
+	/*
+	 * Give pages with nothing live in them back to the system, then
+	 * rebuild each class's page array and partial list.  Must not
+	 * run while a sweep is walking the page arrays.
+	 */
+	for (size_t i = 0; i != slabs->count; ++i) {
+		struct SlabClass *c = &slabs->classes[i];
+		size_t kept = 0;
+		c->current = 0;
+		c->partial = 0;
+		for (size_t j = 0; j != c->count; ++j) {
+			struct SlabPage *page = c->pages[j];
+			if (!page->live) {
+				free(page);
+				continue;
+			}
+			page->index = kept;
+			page->onPartial = false;
+			c->pages[kept++] = page;
+			if (page->freeList || page->bump < page->capacity) {
+				page->onPartial = true;
+				page->nextPartial = c->partial;
+				c->partial = page;
+			}
+		}
+		c->count = kept;
+	}
+}
@@ -0,0 +1,55 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "scheme_forward.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Objects are carved out of large aligned pages.  Each page belongs
+ * to one size class and holds objects of that size only, so
+ * consecutive allocations of one type sit next to each other.  The
+ * page header can be found from any object by masking its address.
+ */
+
+#define SLAB_PAGE_SIZE ((size_t)64 * 1024)
+
+struct SlabPage {
+	struct SlabPage *nextPartial;
+	bool onPartial;
+	size_t cls;
+	size_t index;
+	size_t objectSize;
+	size_t live;
+	size_t capacity;
+	size_t bump;
+	struct Object *freeList;
+};
+
+struct SlabClass {
+	size_t objectSize;
+	size_t live;
+	size_t allocated;
+	struct SlabPage **pages;
+	size_t count;
+	size_t size;
+	struct SlabPage *current;
+	struct SlabPage *partial;
+};
+
+struct Slabs {
+	struct SlabClass *classes;
+	size_t count;
+};
+
+struct Slabs make_slabs(void);
+void free_slabs(struct Slabs *slabs);
+bool slabs_add_class(struct Slabs *slabs, size_t objectSize);
+struct Object *slab_alloc(struct Slabs *slabs, size_t cls);
+void slab_free(struct Slabs *slabs, struct Object *obj);
+struct SlabPage *slab_page_of(struct Object *obj);
+struct Object *slab_object_at(struct SlabPage *page, size_t slot);
+size_t slab_slot_of(struct SlabPage *page, struct Object *obj);
+void slabs_release_empty(struct Slabs *slabs);
+
+#endif
@@ -0,0 +1,113 @@
+#include "stats.h"
+#include "gc.h"
+#include "scheme.h"
+#include <stdio.h>
+
+struct Stats make_stats(void)
+{
+	struct Stats s = {
+		.evals = 0, .closureCalls = 0, .builtinCalls = 0,
+		.lookups = 0, .scopesWalked = 0, .namesCompared = 0
+	};
+	return s;
+}
+
+struct Counter {
+	const char *name;
+	size_t value;
+};
+
+/* Counters other than allocations, which are reported per type. */
+#define COUNTER_COUNT 11
+
+static void collect(struct Machine *m, struct Counter *counters,
+		size_t *allocated)
+{
+	struct Counter c[COUNTER_COUNT] = {
+		{"evals", m->stats.evals},
+		{"closure-calls", m->stats.closureCalls},
+		{"builtin-calls", m->stats.builtinCalls},
+		{"lookups", m->stats.lookups},
+		{"scopes-walked", m->stats.scopesWalked},
+		{"names-compared", m->stats.namesCompared},
+		{"symbol-lookups", m->symbols.lookups},
+		{"symbols", m->symbols.count},
+		{"minor-collections", m->heap.minorCollections},
+		{"major-collections", m->heap.majorCollections},
+		{"max-pause-ns", m->heap.maxPauseNs}
+	};
+	for (size_t i = 0; i != COUNTER_COUNT; ++i)
+		counters[i] = c[i];
+	for (size_t i = 0; i != TYPE_COUNT; ++i)
+		allocated[i] = 0;
+	for (size_t i = 0; i != m->slabs.count; ++i)
+		allocated[slab_class_type(i)] += m->slabs.classes[i].allocated;
+}
+
+static struct Object *counter_row(struct Machine *m, const char *name,
+				size_t value)
+{
+	/* (name value) */
+	struct Object *row = create_pair_object(m, 0, 0);
+	struct Object *item = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &row);
+	gc_push_root(m, &item);
+	item = create_integer_object(m, value);
+	row = create_pair_object(m, item, row);
+	item = create_symbol_object(m, string_from_cstring((char *)name));
+	row = create_pair_object(m, item, row);
+	gc_roots_restore(m, roots);
+	return row;
+}
+
+struct Object *runtime_stats(struct Machine *m, struct Object *args)
+{
+	/*
+	 * An association list of (counter value), ending with
+	 * (allocated (type count) ...) for every type.
+	 */
+	struct Counter counters[COUNTER_COUNT];
+	size_t allocated[TYPE_COUNT];
+	collect(m, counters, allocated);
+	struct Object *res = create_pair_object(m, 0, 0);
+	struct Object *row = 0;
+	struct Object *item = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &res);
+	gc_push_root(m, &row);
+	gc_push_root(m, &item);
+	row = create_pair_object(m, 0, 0);
+	for (size_t i = TYPE_COUNT; i; --i) {
+		item = counter_row(m, type_name(i - 1), allocated[i - 1]);
+		row = create_pair_object(m, item, row);
+	}
+	item = create_symbol_object(m, string_from_cstring("allocated"));
+	row = create_pair_object(m, item, row);
+	res = create_pair_object(m, row, res);
+	for (size_t i = COUNTER_COUNT; i; --i) {
+		item = counter_row(m, counters[i - 1].name,
+				counters[i - 1].value);
+		res = create_pair_object(m, item, res);
+	}
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+void stats_dump(struct Machine *m, FILE *out)
+{
+	/*
+	 * A "name value" line per counter, and "allocated type count"
+	 * for each type that was allocated at all.
+	 */
+	struct Counter counters[COUNTER_COUNT];
+	size_t allocated[TYPE_COUNT];
+	collect(m, counters, allocated);
+	for (size_t i = 0; i != COUNTER_COUNT; ++i)
+		fprintf(out, "%s %zu\n", counters[i].name, counters[i].value);
+	for (size_t i = 0; i != TYPE_COUNT; ++i) {
+		if (allocated[i])
+			fprintf(out, "allocated %s %zu\n", type_name(i),
+				allocated[i]);
+	}
+}
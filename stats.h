@@ -0,0 +1,29 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include "scheme_forward.h"
+#include <stddef.h>
+#include <stdio.h>
+
+/*
+ * Counters bumped on the hot paths, always compiled in.  Each machine
+ * has its own.  Allocations are counted per slab class, in struct
+ * SlabClass, and symbol lookups in struct SymbolTable, where the
+ * increments already have the right cache line at hand.  Variables
+ * are resolved when code is compiled, so lookups, scopes walked and
+ * names compared are counted by the compiler, not as the code runs.
+ */
+struct Stats {
+	size_t evals;
+	size_t closureCalls;
+	size_t builtinCalls;
+	size_t lookups;
+	size_t scopesWalked;
+	size_t namesCompared;
+};
+
+struct Stats make_stats(void);
+struct Object *runtime_stats(struct Machine *m, struct Object *args);
+void stats_dump(struct Machine *m, FILE *out);
+
+#endif
@@ -0,0 +1,432 @@
+#include "strops.h"
+#include "builtins.h"
+#include "gc.h"
+#include "scheme.h"
+#include <stdio.h>
+#include <string.h>
+#if SIMD_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * The portable kernels lean on the C library, whose memchr and memcmp
+ * are usually vectorized already.
+ */
+
+static size_t find_byte_scalar(const char *s, size_t n, char c)
+{
+	const char *p = memchr(s, c, n);
+	return p ? (size_t)(p - s) : n;
+}
+
+static size_t find_any_scalar(const char *s, size_t n, const char *set,
+			size_t setLength)
+{
+	bool in[256] = {false};
+	for (size_t i = 0; i != setLength; ++i)
+		in[(unsigned char)set[i]] = true;
+	for (size_t i = 0; i != n; ++i) {
+		if (in[(unsigned char)s[i]])
+			return i;
+	}
+	return n;
+}
+
+static size_t find_scalar(const char *s, size_t n, const char *needle,
+			size_t needleLength)
+{
+	if (!needleLength)
+		return 0;
+	if (needleLength > n)
+		return n;
+	size_t last = n - needleLength;
+	for (size_t i = 0; i <= last; ++i) {
+		const char *p = memchr(s + i, needle[0], last - i + 1);
+		if (!p)
+			return n;
+		i = p - s;
+		if (!memcmp(p + 1, needle + 1, needleLength - 1))
+			return i;
+	}
+	return n;
+}
+
+static bool equal_scalar(const char *a, const char *b, size_t n)
+{
+	return !memcmp(a, b, n);
+}
+
+static const struct StrKernels scalarKernels = {
+	.findByte = find_byte_scalar,
+	.findAny = find_any_scalar,
+	.find = find_scalar,
+	.equal = equal_scalar
+};
+
+#if SIMD_X86
+
+/*
+ * Substring search compares a block of positions at once against the
+ * needle's first and last bytes, and only where both match does it
+ * compare the bytes in between.  Few positions survive that on real
+ * text, so it runs at close to the speed of a byte search.
+ */
+
+static size_t find_byte_sse2(const char *s, size_t n, char c)
+{
+	__m128i vc = _mm_set1_epi8(c);
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, vc));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	for (; i != n; ++i) {
+		if (s[i] == c)
+			return i;
+	}
+	return n;
+}
+
+static size_t find_sse2(const char *s, size_t n, const char *needle,
+			size_t needleLength)
+{
+	size_t m = needleLength;
+	if (!m)
+		return 0;
+	if (m > n)
+		return n;
+	if (m == 1)
+		return find_byte_sse2(s, n, needle[0]);
+	__m128i first = _mm_set1_epi8(needle[0]);
+	__m128i last = _mm_set1_epi8(needle[m - 1]);
+	size_t i = 0;
+	for (; i + m - 1 + 16 <= n; i += 16) {
+		__m128i bf = _mm_loadu_si128((const __m128i *)(s + i));
+		__m128i bl = _mm_loadu_si128((const __m128i *)(s + i + m - 1));
+		unsigned mask = _mm_movemask_epi8(_mm_and_si128(
+				_mm_cmpeq_epi8(first, bf),
+				_mm_cmpeq_epi8(last, bl)));
+		for (; mask; mask &= mask - 1) {
+			size_t at = i + __builtin_ctz(mask);
+			if (!memcmp(s + at + 1, needle + 1, m - 2))
+				return at;
+		}
+	}
+	size_t rest = find_scalar(s + i, n - i, needle, m);
+	return rest == n - i ? n : i + rest;
+}
+
+static bool equal_sse2(const char *a, const char *b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb)) != 0xffff)
+			return false;
+	}
+	return !memcmp(a + i, b + i, n - i);
+}
+
+static const struct StrKernels sse2Kernels = {
+	.findByte = find_byte_sse2,
+	.findAny = find_any_scalar,
+	.find = find_sse2,
+	.equal = equal_sse2
+};
+
+#define SSE42 __attribute__((target("sse4.2")))
+#define FIND_ANY_MODE (_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY \
+			| _SIDD_LEAST_SIGNIFICANT)
+
+SSE42 static size_t find_any_sse42(const char *s, size_t n, const char *set,
+				size_t setLength)
+{
+	/* PCMPESTRI matches 16 bytes against a set of up to 16 at once. */
+	if (setLength > 16)
+		return find_any_scalar(s, n, set, setLength);
+	char buf[16] = {0};
+	memcpy(buf, set, setLength);
+	__m128i vs = _mm_loadu_si128((const __m128i *)buf);
+	int k = setLength;
+	size_t i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+		int at = _mm_cmpestri(vs, k, v, 16, FIND_ANY_MODE);
+		if (at != 16)
+			return i + at;
+	}
+	if (i == n)
+		return n;
+	memcpy(buf, s + i, n - i);
+	int tail = n - i;
+	int at = _mm_cmpestri(vs, k, _mm_loadu_si128((const __m128i *)buf),
+			tail, FIND_ANY_MODE);
+	return at < tail ? i + at : n;
+}
+
+static const struct StrKernels sse42Kernels = {
+	.findByte = find_byte_sse2,
+	.findAny = find_any_sse42,
+	.find = find_sse2,
+	.equal = equal_sse2
+};
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static size_t find_byte_avx2(const char *s, size_t n, char c)
+{
+	__m256i vc = _mm256_set1_epi8(c);
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+		unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, vc));
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+	size_t rest = find_byte_sse2(s + i, n - i, c);
+	return i + rest;
+}
+
+AVX2 static size_t find_avx2(const char *s, size_t n, const char *needle,
+			size_t needleLength)
+{
+	size_t m = needleLength;
+	if (!m)
+		return 0;
+	if (m > n)
+		return n;
+	if (m == 1)
+		return find_byte_avx2(s, n, needle[0]);
+	__m256i first = _mm256_set1_epi8(needle[0]);
+	__m256i last = _mm256_set1_epi8(needle[m - 1]);
+	size_t i = 0;
+	for (; i + m - 1 + 32 <= n; i += 32) {
+		__m256i bf = _mm256_loadu_si256((const __m256i *)(s + i));
+		__m256i bl = _mm256_loadu_si256(
+			(const __m256i *)(s + i + m - 1));
+		unsigned mask = _mm256_movemask_epi8(_mm256_and_si256(
+				_mm256_cmpeq_epi8(first, bf),
+				_mm256_cmpeq_epi8(last, bl)));
+		for (; mask; mask &= mask - 1) {
+			size_t at = i + __builtin_ctz(mask);
+			if (!memcmp(s + at + 1, needle + 1, m - 2))
+				return at;
+		}
+	}
+	size_t rest = find_sse2(s + i, n - i, needle, m);
+	return rest == n - i ? n : i + rest;
+}
+
+AVX2 static bool equal_avx2(const char *a, const char *b, size_t n)
+{
+	size_t i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)) != -1)
+			return false;
+	}
+	return equal_sse2(a + i, b + i, n - i);
+}
+
+/* simd_level() only reports AVX2 on a CPU that has SSE4.2 as well. */
+static const struct StrKernels avx2Kernels = {
+	.findByte = find_byte_avx2,
+	.findAny = find_any_sse42,
+	.find = find_avx2,
+	.equal = equal_avx2
+};
+
+#endif
+
+const struct StrKernels *str_kernels(enum SimdLevel level)
+{
+#if SIMD_X86
+	if (level >= SimdAvx2)
+		return &avx2Kernels;
+	if (level >= SimdSse42)
+		return &sse42Kernels;
+	if (level >= SimdSse2)
+		return &sse2Kernels;
+#endif
+	return &scalarKernels;
+}
+
+static struct Object *str_arg(struct Object *args, const char *name)
+{
+	struct Object *arg0 = obj_is_nil(args) ? 0 : car(args);
+	if (!arg0 || obj_type(arg0) != TypeString) {
+		fprintf(stderr, "%s wants a string.\n", name);
+		return 0;
+	}
+	return arg0;
+}
+
+static bool str_scan_args(struct Object *args, const char *name,
+			struct Object **s, struct Object **what, size_t *start)
+{
+	/* (name s what [start]), both strings, with start within s. */
+	*s = str_arg(args, name);
+	if (!*s)
+		return false;
+	*what = str_arg(cdr(args), name);
+	if (!*what)
+		return false;
+	*start = 0;
+	struct Object *rest = cdr(cdr(args));
+	if (obj_is_nil(rest))
+		return true;
+	struct Object *arg = car(rest);
+	if (!arg || obj_type(arg) != TypeInteger || obj_integer(arg) < 0
+	    || (uint64_t)obj_integer(arg) > (*s)->string.length) {
+		fprintf(stderr, "%s start out of range.\n", name);
+		return false;
+	}
+	*start = obj_integer(arg);
+	return true;
+}
+
+static size_t str_find_any(struct Machine *m, const char *s, size_t n,
+			const char *set, size_t setLength)
+{
+	if (setLength == 1)
+		return m->strops->findByte(s, n, set[0]);
+	return m->strops->findAny(s, n, set, setLength);
+}
+
+struct Object *string_index(struct Machine *m, struct Object *args)
+{
+	/*
+	 * (string-index s chars [start]) is the index of the first of
+	 * chars in s, or () if there is none.
+	 */
+	struct Object *s, *chars;
+	size_t start;
+	if (!str_scan_args(args, "string-index", &s, &chars, &start))
+		return create_error_object(m);
+	size_t n = s->string.length - start;
+	size_t at = str_find_any(m, string_slice_chars(s->string) + start, n,
+				string_slice_chars(chars->string),
+				chars->string.length);
+	if (at == n)
+		return create_pair_object(m, 0, 0);
+	return create_integer_object(m, start + at);
+}
+
+struct Object *string_search(struct Machine *m, struct Object *args)
+{
+	/* (string-search s needle [start]), or () if it isn't there. */
+	struct Object *s, *needle;
+	size_t start;
+	if (!str_scan_args(args, "string-search", &s, &needle, &start))
+		return create_error_object(m);
+	size_t n = s->string.length - start;
+	size_t at = m->strops->find(string_slice_chars(s->string) + start, n,
+				string_slice_chars(needle->string),
+				needle->string.length);
+	if (at == n && needle->string.length)
+		return create_pair_object(m, 0, 0);
+	return create_integer_object(m, start + at);
+}
+
+struct Object *string_split(struct Machine *m, struct Object *args)
+{
+	/*
+	 * (string-split s delims) is the list of pieces of s between any
+	 * of the characters in delims, empty ones included.  The pieces
+	 * share s's bytes.
+	 */
+	struct Object *s, *delims;
+	size_t start;
+	if (!str_scan_args(args, "string-split", &s, &delims, &start))
+		return create_error_object(m);
+	if (!delims->string.length) {
+		fprintf(stderr, "string-split wants delimiters.\n");
+		return create_error_object(m);
+	}
+	struct Object *first = create_pair_object(m, 0, 0);
+	struct Object *piece = 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &s);
+	gc_push_root(m, &delims);
+	gc_push_root(m, &first);
+	gc_push_root(m, &piece);
+	struct Object *into = first;
+	size_t n = s->string.length;
+	while (into) {
+		const char *chars = string_slice_chars(s->string);
+		size_t at = start + str_find_any(m, chars + start, n - start,
+					string_slice_chars(delims->string),
+					delims->string.length);
+		struct StringSlice slice = s->string;
+		slice.offset += start;
+		slice.length = at - start;
+		++slice.buffer->refs;
+		piece = create_string_from_slice(m, TypeString, slice);
+		if (!piece) {
+			first = 0;
+			break;
+		}
+		into->pair.car = piece;
+		gc_write_barrier(m, into);
+		into->pair.cdr = create_pair_object(m, 0, 0);
+		gc_write_barrier(m, into);
+		into = into->pair.cdr;
+		if (!into)
+			first = 0;
+		if (at == n)
+			break;
+		start = at + 1;
+	}
+	gc_roots_restore(m, roots);
+	return first;
+}
+
+struct Object *string_eq(struct Machine *m, struct Object *args)
+{
+	/* (string=? a b ...) */
+	struct Object *a = str_arg(args, "string=?");
+	if (!a)
+		return create_error_object(m);
+	bool eq = true;
+	for (args = cdr(args); !obj_is_nil(args); args = cdr(args)) {
+		struct Object *b = str_arg(args, "string=?");
+		if (!b)
+			return create_error_object(m);
+		size_t n = a->string.length;
+		eq = eq && n == b->string.length
+			&& m->strops->equal(string_slice_chars(a->string),
+					string_slice_chars(b->string), n);
+	}
+	return truth(m, eq);
+}
+
+static struct Object *string_affix_p(struct Machine *m, struct Object *args,
+				const char *name, bool suffix)
+{
+	struct Object *affix = str_arg(args, name);
+	struct Object *s = affix ? str_arg(cdr(args), name) : 0;
+	if (!s)
+		return create_error_object(m);
+	size_t n = affix->string.length;
+	if (n > s->string.length)
+		return truth(m, false);
+	size_t at = suffix ? s->string.length - n : 0;
+	return truth(m, m->strops->equal(string_slice_chars(affix->string),
+					string_slice_chars(s->string) + at, n));
+}
+
+struct Object *string_prefix_p(struct Machine *m, struct Object *args)
+{
+	/* (string-prefix? prefix s) */
+	return string_affix_p(m, args, "string-prefix?", false);
+}
+
+struct Object *string_suffix_p(struct Machine *m, struct Object *args)
+{
+	/* (string-suffix? suffix s) */
+	return string_affix_p(m, args, "string-suffix?", true);
+}
@@ -0,0 +1,32 @@
+#ifndef STROPS_H
+#define STROPS_H
+
+#include "scheme_forward.h"
+#include "simd.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Byte-scanning kernels for the string builtins, one table per
+ * SimdLevel as for numvec.h.  The find functions return the index of
+ * the first match in s, or n when there is none.
+ */
+struct StrKernels {
+	size_t (*findByte)(const char *s, size_t n, char c);
+	size_t (*findAny)(const char *s, size_t n, const char *set,
+			size_t setLength);
+	size_t (*find)(const char *s, size_t n, const char *needle,
+			size_t needleLength);
+	bool (*equal)(const char *a, const char *b, size_t n);
+};
+
+const struct StrKernels *str_kernels(enum SimdLevel level);
+
+struct Object *string_index(struct Machine *m, struct Object *args);
+struct Object *string_search(struct Machine *m, struct Object *args);
+struct Object *string_split(struct Machine *m, struct Object *args);
+struct Object *string_eq(struct Machine *m, struct Object *args);
+struct Object *string_prefix_p(struct Machine *m, struct Object *args);
+struct Object *string_suffix_p(struct Machine *m, struct Object *args);
+
+#endif
@@ -0,0 +1,128 @@
+#include "symbol.h"
+#include <stdlib.h>
+#include <string.h>
+
+static size_t symbol_hash(const char *name, size_t length)
+{
+	/* FNV-1a */
+	size_t h = (size_t)14695981039346656037ULL;
+	for (size_t i = 0; i != length; ++i) {
+		h ^= (unsigned char)name[i];
+		h *= (size_t)1099511628211ULL;
+	}
+	return h;
+}
+
+struct SymbolTable make_symbol_table(void)
+{
+	struct SymbolTable t = {
+		.pool = 0, .poolCount = 0, .poolSize = 0,
+		.entries = 0, .count = 0, .size = 0,
+		.index = 0, .indexSize = 0, .lookups = 0
+	};
+	return t;
+}
+
+void free_symbol_table(struct SymbolTable *table)
+{
+	free(table->pool);
+	free(table->entries);
+	free(table->index);
+	*table = make_symbol_table();
+}
+
+static ptrdiff_t *symbol_slot(struct SymbolTable *table, const char *name,
+			size_t length, size_t hash)
+{
+	/* indexSize is a power of two and never more than half full. */
+	size_t mask = table->indexSize - 1;
+	for (size_t i = hash & mask;; i = (i + 1) & mask) {
+		ptrdiff_t *slot = &table->index[i];
+		if (*slot == -1)
+			return slot;
+		struct SymbolEntry *ent = &table->entries[*slot];
+		if (ent->hash == hash && ent->length == length
+		    && !memcmp(table->pool + ent->offset, name, length))
+			return slot;
+	}
+}
+
+static bool symbol_grow_index(struct SymbolTable *table)
+{
+	size_t nsize = table->indexSize ? table->indexSize * 2 : 256;
+	ptrdiff_t *nindex = malloc(nsize * sizeof(*nindex));
+	if (!nindex)
+		return false;
+	for (size_t i = 0; i != nsize; ++i)
+		nindex[i] = -1;
+	free(table->index);
+	table->index = nindex;
+	table->indexSize = nsize;
+	/* Stored hashes mean rehashing never touches the names. */
+	size_t mask = nsize - 1;
+	for (size_t id = 0; id != table->count; ++id) {
+		size_t i = table->entries[id].hash & mask;
+		while (nindex[i] != -1)
+			i = (i + 1) & mask;
+		nindex[i] = id;
+	}
+	return true;
+}
+
+static bool symbol_reserve(struct SymbolTable *table, size_t length)
+{
+	if (table->count >= table->size) {
+		size_t nsize = table->size ? table->size * 2 : 256;
+		size_t nbytes = nsize * sizeof(struct SymbolEntry);
+		struct SymbolEntry *nentries = realloc(table->entries, nbytes);
+		if (!nentries)
+			return false;
+		table->entries = nentries;
+		table->size = nsize;
+	}
+	if (table->poolCount + length + 1 > table->poolSize) {
+		size_t nsize = table->poolSize ? table->poolSize * 2 : 4096;
+		while (nsize < table->poolCount + length + 1)
+			nsize *= 2;
+		char *npool = realloc(table->pool, nsize);
+		if (!npool)
+			return false;
+		table->pool = npool;
+		table->poolSize = nsize;
+	}
+	if ((table->count + 1) * 2 > table->indexSize)
+		return symbol_grow_index(table);
+	return true;
+}
+
+ptrdiff_t symbol_intern(struct SymbolTable *table, const char *name,
+			size_t length)
+{
+	/* Returns the id for name, adding it if needed, or -1 on failure. */
+	size_t hash = symbol_hash(name, length);
+	++table->lookups;
+	if (table->indexSize) {
+		ptrdiff_t *slot = symbol_slot(table, name, length, hash);
+		if (*slot != -1)
+			return *slot;
+	}
+	if (!symbol_reserve(table, length))
+		return -1;
+	struct SymbolEntry ent = {
+		.offset = table->poolCount, .length = length,
+		.hash = hash, .object = 0
+	};
+	memcpy(table->pool + table->poolCount, name, length);
+	table->pool[table->poolCount + length] = '\0';
+	table->poolCount += length + 1;
+	ptrdiff_t id = table->count++;
+	table->entries[id] = ent;
+	*symbol_slot(table, name, length, hash) = id;
+	return id;
+}
+
+const char *symbol_name(struct SymbolTable *table, ptrdiff_t sym)
+{
+	/* Only good until the next symbol is interned. */
+	return table->pool + table->entries[sym].offset;
+}
@@ -0,0 +1,40 @@
+#ifndef SYMBOL_H
+#define SYMBOL_H
+
+#include "scheme_forward.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Interned symbol names.  A symbol's id is its index in entries.
+ * Every name lives NUL-terminated in one pool, and entries record
+ * offsets into it, since the pool moves when it grows.  index is an
+ * open-addressing hash table of ids, with -1 marking an empty slot.
+ */
+
+struct SymbolEntry {
+	size_t offset;
+	size_t length;
+	size_t hash;
+	struct Object *object;
+};
+
+struct SymbolTable {
+	char *pool;
+	size_t poolCount;
+	size_t poolSize;
+	struct SymbolEntry *entries;
+	size_t count;
+	size_t size;
+	ptrdiff_t *index;
+	size_t indexSize;
+	size_t lookups;
+};
+
+struct SymbolTable make_symbol_table(void);
+void free_symbol_table(struct SymbolTable *table);
+ptrdiff_t symbol_intern(struct SymbolTable *table, const char *name,
+			size_t length);
+const char *symbol_name(struct SymbolTable *table, ptrdiff_t sym);
+
+#endif
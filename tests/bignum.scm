@@ -0,0 +1,37 @@
+4611686018427387903
+(+ 4611686018427387903 1)
+(- -4611686018427387904 1)
+9223372036854775807
+(+ 9223372036854775807 1)
+(* 9223372036854775807 9223372036854775807)
+123456789012345678901234567890
+(- 123456789012345678901234567890 123456789012345678901234567890)
+(= (+ 9223372036854775807 1) 9223372036854775808)
+(define pow (lambda (b n acc) (if (= n 0) acc (pow b (- n 1) (* acc b)))))
+(pow 2 100 1)
+(pow -3 41 1)
+(define a (pow 3 3000 1))
+(= (* a a) (pow 3 6000 1))
+(= (* a (- 0 a)) (- 0 (pow 3 6000 1)))
+(define b (pow 7 1500 1))
+(= (* a b) (* b a))
+(= (* (* a b) (* a b)) (* (* a a) (* b b)))
+(< a (* a 3))
+(- (+ a 1) a)
+(* (pow 2 64 1) (pow 2 64 1))
+(+ (pow 2 64 1) 0.5)
+(/ 1 0)
+(/ a 0)
+(/ (* a 7) a)
+(- (pow 2 63 1))
+(- -9223372036854775808)
+(/ -9223372036854775808 -1)
+(+ 1 (quote a))
+(+ a "s")
+(* 2 (quote x))
+(- (quote x))
+(- 1 (cons 1 2))
+(/ 6 (quote y))
+(+)
+(*)
+(+ 1 2)
@@ -0,0 +1,20 @@
+(= 1 1)
+(= 1 2)
+(= 1 1.0)
+(= 2 2 2)
+(= 2 2 3)
+(< 1 2 3)
+(< 1 3 2)
+(> 3 2 1)
+(> 1 2)
+(< 1.5 2)
+(< 1 99999999999999999999999)
+(> -99999999999999999999999 -1)
+(= 99999999999999999999999 99999999999999999999999)
+(=)
+(< 1)
+(= 1 (quote a))
+(< (quote a) 1)
+(> 1 2 "x")
+(= (cons 1 2) 1)
+(< 1 2)
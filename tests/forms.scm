@@ -0,0 +1,35 @@
+(lambda)
+(lambda (x))
+((lambda (x)) 1)
+(lambda (x) 1 2)
+(lambda (1) 1)
+(quote)
+(quote 1 2)
+(define)
+(define x)
+(define 1 2)
+(if)
+(if 1)
+(if 1 2 3 4)
+(define x 3)
+x
+(quote (x y))
+((lambda (x y) (+ x y)) 1 2)
+(if (quote ()) 1 2)
+(if 0 1 2)
+(if (quote ()) 1)
+(define make-adder (lambda (n) (lambda (x) (+ x n))))
+((make-adder 10) 5)
+(define count (lambda (n acc) (if (= n 0) acc (count (- n 1) (+ acc 1)))))
+(count 1000000 0)
+(define deep (lambda (n) (if (= n 0) 0 (+ 1 (deep (- n 1))))))
+(deep 100000)
+(call/cc (lambda (k) (+ 1 (k 42))))
+(+ 1 (call/cc (lambda (k) 2)))
+(define saved (quote ()))
+(define fact (lambda (n) (if (< n 2) 1 (* n (fact (- n 1))))))
+(fact 20)
+(eval (quote (+ 1 2)))
+undefined-variable
+(())
+(1 2)
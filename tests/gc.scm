@@ -0,0 +1,37 @@
+(gc-pause-target 1)
+(define build (lambda (n acc) (if (= n 0) acc (build (- n 1) (cons n acc)))))
+(define len (lambda (l n) (if (null? l) n (len (cdr l) (+ n 1)))))
+(define sum (lambda (l acc) (if (null? l) acc (sum (cdr l) (+ acc (car l))))))
+(define l (build 200000 (quote ())))
+(len l 0)
+(sum l 0)
+(define v (make-vector 100000 0))
+(define setall (lambda (i) (if (= i 100000) (vector-length v) (setall2 (vector-set! v i (cons i i)) i))))
+(define setall2 (lambda (x i) (setall (+ i 1))))
+(setall 0)
+(define vsum (lambda (i acc) (if (= i 100000) acc (vsum (+ i 1) (+ acc (cdr (vector-ref v i)))))))
+(vsum 0 0)
+(define h (make-hash-table))
+(define hfill (lambda (i) (if (= i 50000) h (hf2 (hash-table-set! h (cons i 1) (list->vector (cons i (quote ())))) i))))
+(define hf2 (lambda (x i) (hfill (+ i 1))))
+(hfill 0)
+(hash-table-count h)
+(hash-table-fold h (lambda (k v acc) (+ acc (vector-ref v 0))) 0)
+(define m (build 50000 (quote ())))
+(define mfill (lambda (l m) (if (null? l) m (mfill (cdr l) (hamt-set m (car l) (cons (car l) (car l)))))))
+(define m2 (mfill m (hamt)))
+(hamt-count m2)
+(define big (lambda (n acc) (if (= n 0) acc (big (- n 1) (* acc 3)))))
+(define b (big 2000 1))
+(gc)
+(len l 0)
+(vsum 0 0)
+(hamt-ref m2 49999)
+(= b (big 2000 1))
+(define adders (lambda (n acc) (if (= n 0) acc (adders (- n 1) (cons (lambda (x) (+ x n)) acc)))))
+(define apply-all (lambda (l acc) (if (null? l) acc (apply-all (cdr l) ((car l) acc)))))
+(apply-all (adders 10000 (quote ())) 0)
+(define k-loop (lambda (n acc) (if (= n 0) acc (k-loop (- n 1) (+ acc (call/cc (lambda (k) (k n))))))))
+(k-loop 10000 0)
+(gc)
+(sum l 0)
@@ -0,0 +1,33 @@
+(define m (hamt 1 (quote one) 2 (quote two)))
+(hamt? m)
+(hamt-count m)
+(hamt-ref m 1)
+(hamt-ref m 3)
+(hamt-ref m 3 (quote none))
+(define m2 (hamt-set m 3 (quote three)))
+(hamt-count m)
+(hamt-count m2)
+(hamt-contains? m 3)
+(hamt-contains? m2 3)
+(define m3 (hamt-delete m2 1))
+(hamt-contains? m3 1)
+(hamt-contains? m2 1)
+(hamt-ref (alist->hamt (cons (cons (quote a) 1) (cons (cons (quote b) 2) (quote ())))) (quote b))
+(define fill (lambda (i n m) (if (= i n) m (fill (+ i 1) n (hamt-set m i (* 2 i))))))
+(define big (fill 0 50000 (hamt)))
+(hamt-count big)
+(hamt-ref big 49999)
+(hamt-ref big 12345)
+(define less (hamt-delete big 12345))
+(hamt-contains? less 12345)
+(hamt-contains? big 12345)
+(hamt-count less)
+(define t (hamt-transient (hamt)))
+(define tfill (lambda (i n) (if (= i n) t (tfill2 (hamt-set! t i i) i n))))
+(define tfill2 (lambda (x i n) (tfill (+ i 1) n)))
+(tfill 0 1000)
+(define p (hamt-persistent! t))
+(hamt-count p)
+(hamt-ref p 999)
+(hamt-set! p 1 1)
+(hamt-ref 1 1)
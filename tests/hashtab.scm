@@ -0,0 +1,48 @@
+(define h (make-hash-table))
+(hash-table? h)
+(hash-table-set! h 1 10)
+(hash-table-set! h (quote (a b)) 20)
+(hash-table-set! h "str" 30)
+(hash-table-ref h 1)
+(hash-table-ref h (quote (a b)))
+(hash-table-ref h "str")
+(hash-table-ref h 2)
+(hash-table-ref h 2 (lambda () (quote missing)))
+(hash-table-ref/default h 2 42)
+(hash-table-ref/default h 1 42)
+(hash-table-contains? h 1)
+(hash-table-delete! h 1)
+(hash-table-contains? h 1)
+(hash-table-count h)
+(define e (make-hash-table (quote eq)))
+(hash-table-set! e (quote k) 1)
+(hash-table-ref/default e (quote k) 0)
+(hash-table-ref/default e (cons 1 2) 0)
+(define st (make-hash-table (quote string)))
+(hash-table-set! st "a" 1)
+(hash-table-set! st 1 1)
+(make-hash-table (quote bogus))
+(define big (make-hash-table))
+(define fill (lambda (i n) (if (= i n) big (fill2 (hash-table-set! big i (* i i)) i n))))
+(define fill2 (lambda (x i n) (fill (+ i 1) n)))
+(fill 0 20000)
+(hash-table-count big)
+(hash-table-ref big 19999)
+(hash-table-fold big (lambda (k v acc) (+ acc k)) 0)
+(hash-table-fold big (lambda (k v acc) (+ acc 1)) 0)
+(define total 0)
+(hash-table-walk big (lambda (k v) (define total (+ total v))))
+total
+(hash-table-walk big (lambda (k v) (hash-table-set! big k (+ v 1))))
+(hash-table-ref big 3)
+(hash-table-walk big (lambda (k v) (hash-table-set! big (+ k 100000) v)))
+(< 20000 (hash-table-count big))
+(hash-table-walk big (lambda (k v) (car k)))
+(hash-table-fold big)
+(hash-table-walk 1 car)
+(hash-table-fold h (lambda (k v acc) (call/cc (lambda (c) (c (+ acc v))))) 0)
+(define drop (lambda (i n) (if (= i n) (hash-table-contains? big 19999) (drop2 (hash-table-delete! big i) i n))))
+(define drop2 (lambda (x i n) (drop (+ i 1) n)))
+(drop 0 20000)
+(hash-table-ref/default big 500 (quote gone))
+(hash-table-ref/default big 100500 (quote gone))
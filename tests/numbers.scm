@@ -0,0 +1,29 @@
+42
+-17
+0x1f
+1.5
+-0.25
+1e3
+2.5e-3
+0.1
+1x
+1e
+(+ 1 2 3)
+(- 10 4 3)
+(* 6 7)
+(/ 7 2)
+(/ 1.0 4)
+(+ 1 0.5)
+(< 1 2)
+(< 2 1)
+(= 3 3)
+(> 3 1.5)
+0x7fffffffffffffff
+-0x10
+1.7976931348623157e308
+5e-324
+123.456e2
+-0.0
++5
+1.
+.5
@@ -0,0 +1,32 @@
+(define iota (lambda (n acc) (if (= n 0) acc (iota (- n 1) (cons n acc)))))
+(define f (list->f64vector (iota 37 (quote ()))))
+(f64vector-length f)
+(f64vector-sum f)
+(f64vector-dot f f)
+(f64vector-min f)
+(f64vector-max f)
+(f64vector->list (f64vector-scale (f64vector 1 2 3) 0.5))
+(f64vector->list (f64vector-add (f64vector 1 2 3) (f64vector 10 20 30)))
+(f64vector-ref f 36)
+(f64vector-set! f 36 -1.5)
+(f64vector-min f)
+(f64vector-ref f 37)
+(f64vector-add (f64vector 1) (f64vector 1 2))
+(define g (list->f64vector (iota 1000 (quote ()))))
+(f64vector-sum g)
+(f64vector-dot g g)
+(f64vector-max (f64vector-scale g -1))
+(define s (list->s64vector (iota 1001 (quote ()))))
+(s64vector-sum s)
+(s64vector-dot s s)
+(s64vector-min (s64vector-scale s -3))
+(s64vector-max (s64vector-add s s))
+(s64vector->list (s64vector 4 -5 6))
+(s64vector-ref s 1000)
+(s64vector-set! s 0 1.5)
+(make-s64vector 2 9)
+(s64vector? s)
+(f64vector? s)
+(make-f64vector 4611686018427387903)
+(make-s64vector 2305843009213693951 1)
+(f64vector-length (make-f64vector 0))
@@ -0,0 +1,27 @@
+(cons 1 2)
+(car (cons 1 2))
+(cdr (cons 1 2))
+(cadr (cons 1 (cons 2 (quote ()))))
+(car (quote (a b c)))
+(cdr (quote (a b c)))
+(reverse (quote (1 2 3)))
+(reverse (quote ()))
+(car 1)
+(cdr 5)
+(cadr 7)
+(car (quote ()))
+(cdr (quote ()))
+(cadr (quote (1)))
+(car)
+(car 4611686018427387903)
+(null? (quote ()))
+(null? (quote (1)))
+(eq? (quote a) (quote a))
+(equal? (quote (1 (2 #(3)))) (quote (1 (2 #(3)))))
+(cons)
+(cons 1)
+(cons 1 2 3)
+(eval)
+(eval (quote (cons 1 2)) 3)
+(eval (quote (cons 1 2)))
+(eval 5)
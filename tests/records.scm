@@ -0,0 +1,20 @@
+(define-record-type point (make-point x y) point? (x point-x set-point-x!) (y point-y))
+(define p (make-point 1 2))
+(point? p)
+(point? 1)
+(point-x p)
+(point-y p)
+(set-point-x! p 10)
+(point-x p)
+(point-x 1)
+(make-point 1)
+(define-record-type wide (make-wide a b c d e f g) wide? (a wide-a) (b wide-b) (c wide-c) (d wide-d) (e wide-e) (f wide-f) (g wide-g set-wide-g!))
+(define w (make-wide 1 2 3 4 5 6 7))
+(wide-g w)
+(set-wide-g! w (make-point 3 4))
+(point-y (wide-g w))
+(wide? p)
+(define sum-x (lambda (n acc) (if (= n 0) acc (sum-x (- n 1) (+ acc (point-x (make-point n n)))))))
+(sum-x 10000 0)
+(define-record-type)
+(define-record-type bad (make-bad z) bad? (x bad-x))
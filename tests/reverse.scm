@@ -0,0 +1,9 @@
+(reverse (quote (1 2 3)))
+(reverse (quote ()))
+(reverse (cons 1 (cons (cons 2 3) (quote ()))))
+(reverse)
+(reverse 5)
+(reverse "abc")
+(reverse (cons 1 2))
+(reverse (quote (1)) (quote (2)))
+(reverse (quote (a b)))
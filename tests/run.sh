@@ -0,0 +1,57 @@
+#!/bin/sh
+#
+# Runs each tests/*.scm with the given scheme and compares what it
+# prints to stdout with the .out file beside it.  A script must also
+# exit cleanly, so a crash fails even if the output so far matched.
+# Every script then runs again with SCHEME_SIMD capping the kernels at
+# each level, against the same expected output.  Given pool as well,
+# all the scripts run together on its workers, and what it prints must
+# be every .out file in turn.
+#
+# Usage: tests/run.sh scheme [pool]
+
+scheme=$1
+pool=$2
+dir=$(dirname "$0")
+tmp=${TMPDIR:-/tmp}/scheme-check.$$
+all=$tmp.all
+failed=0
+trap 'rm -f "$tmp" "$all"' EXIT
+
+check()
+{
+	# check name expected command ...
+	name=$1
+	expected=$2
+	shift 2
+	"$@" >"$tmp" 2>/dev/null
+	status=$?
+	if [ $status -ne 0 ]; then
+		echo "FAIL $name: exit status $status"
+		failed=1
+	elif ! cmp -s "$tmp" "$expected"; then
+		echo "FAIL $name: output differs"
+		diff "$expected" "$tmp" | head -10
+		failed=1
+	else
+		echo "ok   $name"
+	fi
+}
+
+for level in "" scalar sse2 sse4.2; do
+	for t in "$dir"/*.scm; do
+		[ -e "$t" ] || continue
+		name=$(basename "$t")
+		[ -n "$level" ] && name="$name with SCHEME_SIMD=$level"
+		check "$name" "${t%.scm}.out" \
+			env SCHEME_SIMD="$level" "$scheme" "$t"
+	done
+done
+
+if [ -n "$pool" ]; then
+	cat "$dir"/*.out >"$all"
+	check "all scripts with $(basename "$pool") -j 4" "$all" \
+		"$pool" -j 4 "$dir"/*.scm
+fi
+
+exit $failed
@@ -0,0 +1,21 @@
+(define s "hello, world")
+(string-length s)
+(substring s 7 12)
+(substring s 5 2)
+(string-append "ab" "" "cd")
+(string? s)
+(string? (quote s))
+(define b (make-string-builder))
+(define fill (lambda (n) (if (= n 0) b (fill2 (string-builder-append! b "abcdefghij") n))))
+(define fill2 (lambda (x n) (fill (- n 1))))
+(fill 100)
+(string-builder-append! b "needle")
+(fill 10)
+(string-builder-length b)
+(define long (string-builder->string b))
+(string-length long)
+(define t (substring long 995 1010))
+t
+(string-length (string-append long long))
+(substring t 2 7)
+(string-length (substring long 1100 1106))
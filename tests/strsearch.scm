@@ -0,0 +1,31 @@
+(define s "hello, world")
+(string-index s ", ")
+(string-index s "xyz")
+(string-search s "world")
+(string-search s "o" 5)
+(string-search s "")
+(string-search s "worlds")
+(string-split "a,b,,c" ",")
+(string-split "" ",")
+(string=? "abc" "abc" "abc")
+(string=? "abc" "abd")
+(string-prefix? "he" s)
+(string-suffix? "world" s)
+(string-suffix? "hello" s)
+(define b (make-string-builder))
+(define fill (lambda (n) (if (= n 0) b (fill2 (string-builder-append! b "abcdefghij") n))))
+(define fill2 (lambda (x n) (fill (- n 1))))
+(fill 100)
+(string-builder-append! b "needle")
+(fill 10)
+(define long (string-builder->string b))
+(string-search long "needle")
+(string-search long "needlf")
+(string-index long "zn")
+(string-index long "j" 999)
+(define t (substring long 995 1010))
+(string-split t "n")
+(string=? long (string-append (substring long 0 500) (substring long 500 1106)))
+(string=? long (string-append (substring long 0 500) "x" (substring long 501 1106)))
+(string-prefix? (substring long 0 1000) long)
+(string-suffix? "hij" long)
@@ -0,0 +1,19 @@
+(define v (make-vector 3 0))
+(vector-set! v 0 (quote a))
+(vector-set! v 2 (cons 1 2))
+v
+(vector-ref v 2)
+(vector-length v)
+(vector-ref v 3)
+(vector-ref v -1)
+(vector-ref 1 0)
+(vector->list #(1 2 3))
+(list->vector (quote (x y)))
+(vector-fill! v 7)
+v
+(vector? #())
+(vector? (quote ()))
+(make-vector -1)
+(make-vector 2305843009213693952 0)
+(make-vector 2305843009213693951)
+(vector-length (make-vector 0))
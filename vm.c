@@ -0,0 +1,781 @@
+#include "vm.h"
+#include "builtins.h"
+#include "env.h"
+#include "gc.h"
+#include "print.h"
+#include "record.h"
+#include "scheme.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * With GCC and Clang each instruction jumps straight to the next one's
+ * handler through a table of label addresses.  Elsewhere it is a plain
+ * switch in a loop.
+ */
+#if defined(__GNUC__)
+#define VM_COMPUTED_GOTO
+#endif
+
+int op_operands(enum Op op)
+{
+	switch (op) {
+	case OpLocal:
+	case OpForm:
+		return 2;
+	case OpConst:
+	case OpLocal0:
+	case OpGlobal:
+	case OpDefine:
+	case OpClosure:
+	case OpCall:
+	case OpTailCall:
+	case OpJump:
+	case OpJumpFalse:
+		return 1;
+	case OpNil:
+	case OpNilCall:
+	case OpReturn:
+		return 0;
+	}
+	return 0;
+}
+
+const char *op_name(enum Op op)
+{
+	switch (op) {
+	case OpConst:
+		return "const";
+	case OpLocal0:
+		return "local0";
+	case OpLocal:
+		return "local";
+	case OpGlobal:
+		return "global";
+	case OpDefine:
+		return "define";
+	case OpClosure:
+		return "closure";
+	case OpForm:
+		return "form";
+	case OpCall:
+		return "call";
+	case OpTailCall:
+		return "tailcall";
+	case OpJump:
+		return "jump";
+	case OpJumpFalse:
+		return "jumpfalse";
+	case OpNil:
+		return "nil";
+	case OpNilCall:
+		return "nilcall";
+	case OpReturn:
+		return "return";
+	}
+	return "?";
+}
+
+static bool vm_arith(struct Machine *m, builtinFunc f, struct Object *a,
+		struct Object *b, struct Object **res)
+{
+	/*
+	 * Arithmetic and comparison of two fixnums, without building an
+	 * argument list.  This tests the function rather than the name,
+	 * so rebinding + still works.  A result too big for a fixnum is
+	 * left to the builtin.
+	 */
+	if (!obj_is_fixnum(a) || !obj_is_fixnum(b))
+		return false;
+	int64_t x = fixnum_value(a);
+	int64_t y = fixnum_value(b);
+	int64_t z;
+	if (f == num_eq) {
+		*res = truth(m, x == y);
+		return true;
+	} else if (f == num_lt) {
+		*res = truth(m, x < y);
+		return true;
+	} else if (f == num_gt) {
+		*res = truth(m, x > y);
+		return true;
+	} else if (f == sum) {
+		z = x + y;
+	} else if (f == subtract) {
+		z = x - y;
+	} else if (f == prod) {
+		/* Fixnums are within 2^62 of 0, so -1 * y can't overflow. */
+		z = (uint64_t)x * (uint64_t)y;
+		if (x && z / x != y)
+			return false;
+	} else {
+		return false;
+	}
+	if (z < FIXNUM_MIN || z > FIXNUM_MAX)
+		return false;
+	*res = make_fixnum(z);
+	return true;
+}
+
+static struct Object *vm_apply_builtin(struct Machine *m, struct Object *fn,
+				struct Object **args, int n)
+{
+	/* Builtins take a list; args is on the stack, so it is rooted. */
+	struct Object *res;
+	if (n == 2 && vm_arith(m, fn->builtinFunc.f, args[0], args[1], &res))
+		return res;
+	struct Object *list = create_pair_object(m, 0, 0);
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &list);
+	for (int i = n; list && i; --i)
+		list = create_pair_object(m, args[i - 1], list);
+	if (list)
+		res = fn->builtinFunc.f(m, list);
+	else
+		res = create_error_object(m);
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+/*
+ * The stack is a chain of chunks, each a GC object holding an array
+ * of slots.  An activation starts with a record of its caller's
+ * registers (code, frame, pc and base) and continues with its operand
+ * stack.  An activation whose record is at slot 0 of a chunk has its
+ * caller in the chunk below.  A record of zeros marks where vm_run()
+ * was entered from C.
+ *
+ * call/cc seals every chunk in the chain and keeps a pointer to it,
+ * so capturing costs nothing like a stack copy.  Sealed chunks are
+ * never written again: an activation that is resumed or returned to in
+ * one is first copied into a fresh chunk, one activation at a time.
+ *
+ * Inside vm_run() the registers live in locals.  They are saved to the
+ * Machine before anything that might collect or run other code, and
+ * loaded again after anything that might have changed them.
+ */
+
+#define VM_RECORD 4
+
+static void vm_set_chunk(struct Machine *m, struct Object *chunk)
+{
+	chunk->chunk.dirty = true;
+	m->chunk = chunk;
+}
+
+static struct Object *vm_reserve(struct Machine *m, size_t top, size_t need)
+{
+	/*
+	 * The chunk for an activation needing need slots, when the current
+	 * chunk is in use up to top: that chunk if it has room, or else a
+	 * new one stacked on it.
+	 */
+	struct Object *c = m->chunk;
+	if (c->chunk.size - top >= need)
+		return c;
+	struct Object *nc = create_chunk_object(m, c, top,
+				need > VM_CHUNK_SLOTS ? need : VM_CHUNK_SLOTS);
+	if (nc)
+		vm_set_chunk(m, nc);
+	return nc;
+}
+
+static void vm_push_record(struct Machine *m, struct Object *chunk,
+			bool fromC, struct Object *code, struct Object *frame)
+{
+	/* Start an activation of code at the top of chunk. */
+	struct Object **rec = chunk->chunk.slots + chunk->chunk.count;
+	if (fromC) {
+		rec[0] = rec[1] = rec[2] = rec[3] = 0;
+	} else {
+		rec[0] = m->code;
+		rec[1] = m->env;
+		rec[2] = make_fixnum(m->pc);
+		rec[3] = make_fixnum(m->base);
+	}
+	m->base = chunk->chunk.count;
+	chunk->chunk.count += VM_RECORD;
+	m->code = code;
+	m->env = frame;
+	m->pc = 0;
+}
+
+static bool vm_copy_activation(struct Machine *m, struct Object *code,
+			struct Object *chunk, size_t base, size_t top)
+{
+	/*
+	 * Make a copy of the activation of code at base in the sealed
+	 * chunk the current one, so that it can run.  The ones below it
+	 * stay put.  code is 0 for the C code at the very bottom.
+	 */
+	size_t need = code ? VM_RECORD + code->code.maxStack : 0;
+	if (need < top - base)
+		need = top - base;
+	struct Object *parent = base ? chunk : chunk->chunk.parent;
+	size_t parentTop = base ? base : chunk->chunk.parentTop;
+	struct Object *nc = create_chunk_object(m, parent, parentTop,
+				need > VM_CHUNK_SLOTS ? need : VM_CHUNK_SLOTS);
+	if (!nc)
+		return false;
+	for (size_t i = base; i != top; ++i)
+		nc->chunk.slots[i - base] = chunk->chunk.slots[i];
+	nc->chunk.count = top - base;
+	vm_set_chunk(m, nc);
+	m->base = 0;
+	return true;
+}
+
+static void vm_push(struct Machine *m, struct Object *obj)
+{
+	/* The activation reserved room for all it pushes. */
+	m->chunk->chunk.slots[m->chunk->chunk.count++] = obj;
+}
+
+static struct Object *vm_frame(struct Machine *m, struct Object *fn,
+			struct Object **args, int n)
+{
+	/* A frame for calling the closure fn, or 0 on failure. */
+	struct Object *frame = create_frame_object(m, fn->closure.env,
+						fn->closure.args, n);
+	if (!frame)
+		return 0;
+	/* The frame is brand new, so no write barrier is needed. */
+	for (int i = 0; i != n; ++i)
+		frame->frame.slots[i] = args[i];
+	return frame;
+}
+
+static bool vm_enter(struct Machine *m, struct Object *fn, int n)
+{
+	/*
+	 * Start an activation of the closure fn on the n values on top
+	 * of the stack, which are popped along with fn.
+	 */
+	struct Object *code = fn->closure.code;
+	if (n != code->code.arity) {
+		fprintf(stderr, "Wrong number of arguments to a closure.\n");
+		return false;
+	}
+	struct Object *c = m->chunk;
+	size_t top = c->chunk.count - n - 1;
+	struct Object *nc = vm_reserve(m, top,
+				VM_RECORD + code->code.maxStack);
+	if (!nc)
+		return false;
+	struct Object *frame = vm_frame(m, fn, c->chunk.slots + top + 1, n);
+	if (!frame) {
+		m->chunk = c;
+		return false;
+	}
+	c->chunk.count = top;
+	vm_push_record(m, nc, false, code, frame);
+	if (m->profile.stack)
+		profile_enter(&m->profile, m->callDepth + 1, code->code.name);
+	if (++m->callDepth > m->maxCallDepth)
+		m->maxCallDepth = m->callDepth;
+	return true;
+}
+
+static bool vm_replace(struct Machine *m, struct Object *fn, int n)
+{
+	/*
+	 * A tail call: the closure fn takes over the current activation,
+	 * keeping its record.
+	 */
+	struct Object *code = fn->closure.code;
+	if (n != code->code.arity) {
+		fprintf(stderr, "Wrong number of arguments to a closure.\n");
+		return false;
+	}
+	struct Object *c = m->chunk;
+	struct Object *frame = vm_frame(m, fn,
+				c->chunk.slots + c->chunk.count - n, n);
+	if (!frame)
+		return false;
+	size_t need = VM_RECORD + code->code.maxStack;
+	if (c->chunk.size - m->base < need) {
+		/* Move the record to a chunk with room. */
+		struct Object *parent = m->base ? c : c->chunk.parent;
+		size_t parentTop = m->base ? m->base : c->chunk.parentTop;
+		size_t roots = gc_roots_save(m);
+		gc_push_root(m, &frame);
+		struct Object *nc = create_chunk_object(m, parent, parentTop,
+				need > VM_CHUNK_SLOTS ? need : VM_CHUNK_SLOTS);
+		gc_roots_restore(m, roots);
+		if (!nc)
+			return false;
+		for (size_t i = 0; i != VM_RECORD; ++i)
+			nc->chunk.slots[i] = c->chunk.slots[m->base + i];
+		nc->chunk.count = 0;
+		c->chunk.count = m->base;
+		vm_set_chunk(m, nc);
+		m->base = 0;
+		c = nc;
+	}
+	c->chunk.count = m->base + VM_RECORD;
+	if (m->profile.stack)
+		profile_enter(&m->profile, m->callDepth, code->code.name);
+	m->env = frame;
+	m->code = code;
+	m->pc = 0;
+	return true;
+}
+
+static bool vm_return(struct Machine *m, struct Object **res)
+{
+	/*
+	 * Pop the current activation and push *res for its caller.  True
+	 * means that the caller is the C code that entered vm_run(),
+	 * which should get *res instead.
+	 */
+	struct Object *c = m->chunk;
+	struct Object **rec = c->chunk.slots + m->base;
+	if (!rec[3])
+		return true;
+	m->code = rec[0];
+	m->env = rec[1];
+	m->pc = fixnum_value(rec[2]);
+	size_t base = fixnum_value(rec[3]);
+	--m->callDepth;
+	if (m->base) {
+		c->chunk.count = m->base;
+		m->base = base;
+	} else {
+		/* The caller is in the chunk below. */
+		struct Object *p = c->chunk.parent;
+		size_t top = c->chunk.parentTop;
+		if (p->chunk.sealed) {
+			size_t roots = gc_roots_save(m);
+			gc_push_root(m, res);
+			bool ok = vm_copy_activation(m, m->code, p, base,
+						top);
+			gc_roots_restore(m, roots);
+			if (!ok) {
+				*res = 0;
+				return true;
+			}
+		} else {
+			p->chunk.count = top;
+			vm_set_chunk(m, p);
+			m->base = base;
+		}
+	}
+	vm_push(m, *res);
+	return false;
+}
+
+static struct Object *vm_capture(struct Machine *m)
+{
+	/*
+	 * The continuation of the current activation, which then carries
+	 * on in a copy of itself.
+	 */
+	for (struct Object *c = m->chunk; c && !c->chunk.sealed;
+	     c = c->chunk.parent) {
+		c->chunk.sealed = true;
+		gc_write_barrier(m, c);
+	}
+	struct Continuation k = {
+		.chunk = m->chunk, .code = m->code, .frame = m->env,
+		.pc = m->pc, .base = m->base, .top = m->chunk->chunk.count,
+		.depth = m->callDepth, .run = m->runDepth == 1 ? 0 : m->run
+	};
+	struct Object *obj = create_continuation_object(m, k);
+	if (!obj)
+		return 0;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &obj);
+	bool ok = vm_copy_activation(m, k.code, k.chunk, k.base, k.top);
+	gc_roots_restore(m, roots);
+	return ok ? obj : 0;
+}
+
+static bool vm_resume(struct Machine *m, struct Object *k)
+{
+	/*
+	 * Make k's activation current again.  A continuation's chain
+	 * bottoms out where its vm_run() was entered, so it can only be
+	 * resumed inside that same run, or in any run at the top level,
+	 * where what lies below is always the same.
+	 */
+	struct Continuation *c = &k->continuation;
+	if (c->run ? c->run != m->run : m->runDepth != 1) {
+		fprintf(stderr, "A continuation can only be resumed "
+			"inside the eval that captured it.\n");
+		return false;
+	}
+	if (!vm_copy_activation(m, c->code, c->chunk, c->base, c->top))
+		return false;
+	m->code = c->code;
+	m->env = c->frame;
+	m->pc = c->pc;
+	m->callDepth = c->depth;
+	return true;
+}
+
+static bool vm_call(struct Machine *m, int n, bool tail,
+		struct Object **res)
+{
+	/*
+	 * Call the value under the n on top of the stack.  Registers
+	 * must be saved before and loaded after.  True means that the
+	 * current activation returned to C with *res.
+	 */
+	struct Object *c = m->chunk;
+	struct Object **args = c->chunk.slots + c->chunk.count - n;
+	struct Object *fn = args[-1];
+	struct Object *k;
+	switch (obj_type(fn)) {
+	case TypeClosure:
+		++m->stats.closureCalls;
+		if (tail ? vm_replace(m, fn, n) : vm_enter(m, fn, n))
+			return false;
+		break;
+	case TypeContinuation:
+		if (n != 1) {
+			fprintf(stderr, "A continuation takes one value.\n");
+			break;
+		}
+		*res = args[0];
+		size_t roots = gc_roots_save(m);
+		gc_push_root(m, res);
+		bool ok = vm_resume(m, fn);
+		gc_roots_restore(m, roots);
+		if (!ok)
+			break;
+		vm_push(m, *res);
+		return false;
+	case TypeBuiltinFunc:
+		if (fn->builtinFunc.f == callcc) {
+			/*
+			 * Even in tail position, this returns into the
+			 * current activation, which is then left as usual.
+			 */
+			if (n != 1) {
+				fprintf(stderr, "call/cc takes one procedure.\n");
+				break;
+			}
+			*res = args[0];
+			c->chunk.count -= 2;
+			size_t roots = gc_roots_save(m);
+			gc_push_root(m, res);
+			k = vm_capture(m);
+			gc_roots_restore(m, roots);
+			if (!k)
+				return true;
+			/* Now call the procedure on k, from a copy. */
+			vm_push(m, *res);
+			vm_push(m, k);
+			return vm_call(m, 1, false, res);
+		}
+		++m->stats.builtinCalls;
+		*res = vm_apply_builtin(m, fn, args, n);
+		if (tail)
+			return vm_return(m, res);
+		m->chunk->chunk.count -= n + 1;
+		vm_push(m, *res);
+		return false;
+	case TypeRecordProc:
+		++m->stats.builtinCalls;
+		*res = record_apply(m, fn, args, n);
+		if (tail)
+			return vm_return(m, res);
+		m->chunk->chunk.count -= n + 1;
+		vm_push(m, *res);
+		return false;
+	case TypeBuiltinForm:
+		fprintf(stderr, "A special form can only be called by name.\n");
+		break;
+	default:
+		fprintf(stderr, "The first element isn't something executable\n");
+		break;
+	}
+	/* Failed; the value of the call is an error. */
+	m->chunk->chunk.count -= n;
+	*res = create_error_object(m);
+	m->chunk->chunk.slots[m->chunk->chunk.count - 1] = *res;
+	return false;
+}
+
+struct Object *vm_run(struct Machine *m, struct Object *code,
+		struct Object *frame)
+{
+	/*
+	 * Run code with frame as its innermost frame.  Closures called
+	 * from here run in the same loop.  Only builtins that evaluate,
+	 * such as eval, or that call procedures through vm_apply(), come
+	 * back in from C.
+	 */
+	struct Object *res = 0;
+	struct Object *oldChunk = m->chunk;
+	struct Object *oldCode = m->code;
+	struct Object *oldEnv = m->env;
+	size_t oldCount = oldChunk->chunk.count;
+	size_t oldPc = m->pc;
+	size_t oldBase = m->base;
+	size_t oldDepth = m->callDepth;
+	size_t oldRun = m->run;
+	/* A tail call from code renames the activation it runs at. */
+	struct Profile *prof = &m->profile;
+	ptrdiff_t oldName = prof->stack && oldDepth < prof->stackSize
+		? prof->stack[oldDepth] : PROFILE_UNKNOWN;
+	size_t roots = gc_roots_save(m);
+	gc_push_root(m, &oldChunk);
+	gc_push_root(m, &oldCode);
+	gc_push_root(m, &oldEnv);
+	gc_push_root(m, &res);
+	++m->runDepth;
+	m->run = ++m->runCount;
+
+	struct Object *chunk = vm_reserve(m, oldCount,
+					VM_RECORD + code->code.maxStack);
+	if (!chunk) {
+		res = create_error_object(m);
+		goto leave;
+	}
+	vm_push_record(m, chunk, true, code, frame);
+
+	struct Object **stack;
+	struct Object **sp;
+	struct Object **base;
+	struct Object **consts;
+	const int *ops;
+	const int *pc;
+	struct Object *f;
+	struct GlobalCell *cell;
+	int n;
+
+#define VM_SAVE() (m->chunk->chunk.count = sp - stack, \
+		m->pc = pc - ops, m->base = base - stack)
+#define VM_LOAD() (stack = m->chunk->chunk.slots, \
+		sp = stack + m->chunk->chunk.count, base = stack + m->base, \
+		code = m->code, consts = code->code.consts, \
+		ops = code->code.ops, pc = ops + m->pc, frame = m->env)
+#ifdef VM_COMPUTED_GOTO
+	static void *const labels[OP_COUNT] = {
+		[OpConst] = &&L_OpConst,
+		[OpLocal0] = &&L_OpLocal0,
+		[OpLocal] = &&L_OpLocal,
+		[OpGlobal] = &&L_OpGlobal,
+		[OpDefine] = &&L_OpDefine,
+		[OpClosure] = &&L_OpClosure,
+		[OpForm] = &&L_OpForm,
+		[OpCall] = &&L_OpCall,
+		[OpTailCall] = &&L_OpTailCall,
+		[OpJump] = &&L_OpJump,
+		[OpJumpFalse] = &&L_OpJumpFalse,
+		[OpNil] = &&L_OpNil,
+		[OpNilCall] = &&L_OpNilCall,
+		[OpReturn] = &&L_OpReturn
+	};
+#define VM_CASE(op) L_##op:
+#define VM_NEXT() goto *labels[*pc++]
+#define VM_DISPATCH() VM_NEXT();
+#else
+#define VM_CASE(op) case op:
+#define VM_NEXT() continue
+#define VM_DISPATCH() for (;;) switch (*pc++)
+#endif
+
+	VM_LOAD();
+	VM_DISPATCH() {
+	VM_CASE(OpConst)
+		*sp++ = consts[*pc++];
+		VM_NEXT();
+	VM_CASE(OpLocal0)
+		*sp++ = frame->frame.slots[*pc++];
+		VM_NEXT();
+	VM_CASE(OpLocal)
+		f = frame;
+		for (n = *pc++; n; --n)
+			f = f->frame.parent;
+		*sp++ = f->frame.slots[*pc++];
+		VM_NEXT();
+	VM_CASE(OpGlobal)
+		cell = consts[*pc++]->globalRef.cell;
+		f = cell->value;
+		if (!f) {
+			fprintf(stderr, "Failed to find %s in environment.\n",
+				symbol_name(&m->symbols, cell->sym));
+			VM_SAVE();
+			f = create_error_object(m);
+		}
+		*sp++ = f;
+		VM_NEXT();
+	VM_CASE(OpDefine)
+		cell = consts[*pc++]->globalRef.cell;
+		cell->value = sp[-1];
+		gc_cell_barrier(m, cell);
+		VM_SAVE();
+		sp[-1] = create_pair_object(m, 0, 0);
+		VM_NEXT();
+	VM_CASE(OpClosure)
+		f = consts[*pc++];
+		VM_SAVE();
+		*sp++ = create_closure_object(m, f->code.params, f, frame);
+		VM_NEXT();
+	VM_CASE(OpForm)
+		/* Forms may evaluate, which can move the registers. */
+		f = consts[*pc++];
+		n = *pc++;
+		VM_SAVE();
+		res = f->builtinForm.f(m, consts[n]);
+		VM_LOAD();
+		*sp++ = res;
+		VM_NEXT();
+	VM_CASE(OpCall)
+		n = *pc++;
+		/* A false comparison allocates its (), so save first. */
+		VM_SAVE();
+		if (n == 2 && obj_type(sp[-3]) == TypeBuiltinFunc
+		    && vm_arith(m, sp[-3]->builtinFunc.f, sp[-2], sp[-1], &f)) {
+			++m->stats.builtinCalls;
+			sp -= 2;
+			sp[-1] = f;
+			VM_NEXT();
+		}
+		if (vm_call(m, n, false, &res))
+			goto leave;
+		VM_LOAD();
+		VM_NEXT();
+	VM_CASE(OpTailCall)
+		n = *pc++;
+		VM_SAVE();
+		if (vm_call(m, n, true, &res))
+			goto leave;
+		VM_LOAD();
+		VM_NEXT();
+	VM_CASE(OpJump)
+		pc = ops + *pc;
+		VM_NEXT();
+	VM_CASE(OpJumpFalse)
+		if (obj_is_nil(*--sp))
+			pc = ops + *pc;
+		else
+			++pc;
+		VM_NEXT();
+	VM_CASE(OpNil)
+		VM_SAVE();
+		*sp++ = create_pair_object(m, 0, 0);
+		VM_NEXT();
+	VM_CASE(OpNilCall)
+		fprintf(stderr, "Can't evaluate ().\n");
+		VM_SAVE();
+		*sp++ = create_error_object(m);
+		VM_NEXT();
+	VM_CASE(OpReturn)
+		res = sp[-1];
+		VM_SAVE();
+		if (vm_return(m, &res))
+			goto leave;
+		VM_LOAD();
+		VM_NEXT();
+	}
+#undef VM_SAVE
+#undef VM_LOAD
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_DISPATCH
+leave:
+	/*
+	 * Back to the registers of whoever called.  If a continuation
+	 * sealed their activation meanwhile, they carry on in a copy.
+	 */
+	m->code = oldCode;
+	m->env = oldEnv;
+	m->pc = oldPc;
+	m->callDepth = oldDepth;
+	if (prof->stack && oldDepth < prof->stackSize)
+		prof->stack[oldDepth] = oldName;
+	m->run = oldRun;
+	--m->runDepth;
+	if (oldChunk->chunk.sealed) {
+		if (!vm_copy_activation(m, m->code, oldChunk, oldBase,
+					oldCount))
+			res = 0;
+	} else {
+		oldChunk->chunk.count = oldCount;
+		vm_set_chunk(m, oldChunk);
+		m->base = oldBase;
+	}
+	gc_roots_restore(m, roots);
+	return res;
+}
+
+struct Object *vm_applier(struct Machine *m, int n)
+{
+	/*
+	 * Code that calls consts[0] on consts[1] to consts[n], for a
+	 * builtin that calls a procedure over and over with vm_apply().
+	 */
+	struct Object *code = create_code_object(m, 0);
+	if (!code)
+		return 0;
+	struct Code *c = &code->code;
+	c->ops = malloc((2 * (n + 1) + 3) * sizeof(*c->ops));
+	c->consts = calloc(n + 1, sizeof(*c->consts));
+	if (!c->ops || !c->consts)
+		return 0;
+	c->size = 2 * (n + 1) + 3;
+	c->constSize = c->constCount = n + 1;
+	c->maxStack = n + 1;
+	for (int i = 0; i <= n; ++i) {
+		c->ops[c->count++] = OpConst;
+		c->ops[c->count++] = i;
+	}
+	c->ops[c->count++] = OpTailCall;
+	c->ops[c->count++] = n;
+	c->ops[c->count++] = OpReturn;
+	return code;
+}
+
+struct Object *vm_apply(struct Machine *m, struct Object *applier,
+			struct Object *fn, struct Object **args)
+{
+	/* Call fn on as many args as applier was made for. */
+	struct Code *c = &applier->code;
+	c->consts[0] = fn;
+	for (size_t i = 1; i != c->constCount; ++i)
+		c->consts[i] = args[i - 1];
+	gc_write_barrier(m, applier);
+	return vm_run(m, applier, m->env);
+}
+
+void disassemble(struct Machine *m, struct Object *code)
+{
+	/* One instruction per line, then any nested lambdas' code. */
+	struct Code *c = &code->code;
+	printer_printf(&m->out, "code: %d params, stack %d\n", c->arity,
+		       c->maxStack);
+	for (size_t i = 0; i < c->count; i += 1 + op_operands(c->ops[i])) {
+		enum Op op = c->ops[i];
+		printer_printf(&m->out, "%6zu  %-8s", i, op_name(op));
+		for (int j = 1; j <= op_operands(op); ++j)
+			printer_printf(&m->out, " %d", c->ops[i + j]);
+		switch (op) {
+		case OpGlobal:
+		case OpDefine:
+			printer_printf(&m->out, "\t; %s", symbol_name(&m->symbols,
+				c->consts[c->ops[i + 1]]->globalRef.cell->sym));
+			break;
+		case OpConst:
+			printer_puts(&m->out, "\t; ");
+			obj_print(m, c->consts[c->ops[i + 1]]);
+			break;
+		case OpForm:
+			printer_puts(&m->out, "\t; ");
+			obj_print(m, c->consts[c->ops[i + 2]]);
+			break;
+		default:
+			break;
+		}
+		printer_puts(&m->out, "\n");
+	}
+	for (size_t k = 0; k != c->constCount; ++k) {
+		struct Object *obj = c->consts[k];
+		if (obj && obj_type(obj) == TypeCode) {
+			printer_puts(&m->out, "\n");
+			disassemble(m, obj);
+		}
+	}
+}
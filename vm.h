@@ -0,0 +1,43 @@
+#ifndef VM_H
+#define VM_H
+
+#include "scheme_forward.h"
+
+/*
+ * Code objects hold a flat array of ints: an opcode followed by its
+ * operands.  The stack belongs to the Machine and lives in chunks; a
+ * closure call pushes an activation onto it rather than recursing in
+ * C.  See vm.c.
+ */
+enum Op {
+	OpConst,	/* k: push consts[k] */
+	OpLocal0,	/* slot: push a slot of the current frame */
+	OpLocal,	/* depth slot: push a slot of an enclosing frame */
+	OpGlobal,	/* k: push the value of the cell consts[k] refers to */
+	OpDefine,	/* k: pop into the cell consts[k] refers to, push () */
+	OpClosure,	/* k: push a closure of the code in consts[k] */
+	OpForm,		/* k j: apply the form consts[k] to consts[j] */
+	OpCall,		/* n: call sp[-n - 1] on the n values above it */
+	OpTailCall,	/* n: the same, returning what the callee returns */
+	OpJump,		/* to: continue at ops[to] */
+	OpJumpFalse,	/* to: pop, and jump if it was () */
+	OpNil,		/* push a new () */
+	OpNilCall,	/* report an attempt to evaluate () */
+	OpReturn	/* return the top of the stack */
+};
+
+#define OP_COUNT (OpReturn + 1)
+
+/* Slots in a stack chunk, unless one activation needs more. */
+#define VM_CHUNK_SLOTS 1024
+
+int op_operands(enum Op op);
+const char *op_name(enum Op op);
+struct Object *vm_run(struct Machine *m, struct Object *code,
+		struct Object *frame);
+struct Object *vm_applier(struct Machine *m, int n);
+struct Object *vm_apply(struct Machine *m, struct Object *applier,
+			struct Object *fn, struct Object **args);
+void disassemble(struct Machine *m, struct Object *code);
+
+#endif